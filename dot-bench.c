@@ -0,0 +1,267 @@
+/*
+ * dot-bench.c - check and profile the scrambler of Digi 002/003 family
+ *
+ * The encoder under test is the one of the driver, included from
+ * sound/firewire/digi00x/digi00x-dot.h. It is compared bit by bit with the
+ * reference, which is the byte-wise scrambler the driver used before the
+ * salts were tabled, then both of them are timed over packets of 18 channels.
+ *
+ * gcc -O2 ./dot-bench.c -o ./dot-bench
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <time.h>
+
+typedef uint8_t __u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint32_t __be32;
+
+#ifndef __always_inline
+#define __always_inline	inline __attribute__((always_inline))
+#endif
+#define cpu_to_be32(x)	htobe32(x)
+
+/* the number of data blocks in a packet at 48.0 kHz, in blocking mode */
+#define FRAMES_PER_PACKET	8
+#define MAX_CHANNELS		18
+
+/* as in sound/firewire/digi00x/digi00x.h */
+struct dot_state {
+	__u8 carry;
+	__u8 idx;
+	unsigned int off;
+};
+
+#include "./sound/firewire/digi00x/digi00x-dot.h"
+
+/* the reference, as the driver scrambled before */
+
+static void dot_encode_step(struct dot_state *state, __be32 *const buffer)
+{
+	__u8 * const data = (__u8 *) buffer;
+
+	if (data[MAGIC_DOT_BYTE] != 0x00) {
+		state->off = 0;
+		state->idx = data[MAGIC_DOT_BYTE] ^ state->carry;
+	}
+	data[MAGIC_DOT_BYTE] ^= state->carry;
+	state->carry = dot_scrt(state->idx, ++(state->off));
+}
+
+/*
+ * A data block has one quadlet for MIDI after the PCM samples, as in the
+ * packets to the device.
+ */
+static void write_packet_ref(struct dot_state *state, __be32 *buffer,
+			     const void *src, unsigned int channels, bool s32)
+{
+	const u16 *src16 = src;
+	const u32 *src32 = src;
+	unsigned int i, c;
+	u32 sample;
+
+	for (i = 0; i < FRAMES_PER_PACKET; ++i) {
+		for (c = 0; c < channels; ++c) {
+			if (s32)
+				sample = *src32++ >> 8;
+			else
+				sample = *src16++ << 8;
+			buffer[c] = cpu_to_be32(sample | 0x40000000);
+			dot_encode_step(state, &buffer[c]);
+		}
+		buffer += channels + 1;
+	}
+}
+
+static void write_packet(struct dot_state *state, __be32 *buffer,
+			 const void *src, unsigned int channels, bool s32)
+{
+	struct dot_state local = *state;
+	const u16 *src16 = src;
+	const u32 *src32 = src;
+	unsigned int i;
+
+	for (i = 0; i < FRAMES_PER_PACKET; ++i) {
+		if (s32) {
+			switch (channels) {
+			case 18:
+				encode_block_s32(&local, buffer, src32, 18);
+				break;
+			case 10:
+				encode_block_s32(&local, buffer, src32, 10);
+				break;
+			default:
+				encode_block_s32(&local, buffer, src32,
+						 channels);
+				break;
+			}
+			src32 += channels;
+		} else {
+			switch (channels) {
+			case 18:
+				encode_block_s16(&local, buffer, src16, 18);
+				break;
+			case 10:
+				encode_block_s16(&local, buffer, src16, 10);
+				break;
+			default:
+				encode_block_s16(&local, buffer, src16,
+						 channels);
+				break;
+			}
+			src16 += channels;
+		}
+		buffer += channels + 1;
+	}
+
+	*state = local;
+}
+
+enum pattern {
+	PATTERN_RANDOM = 0,
+	PATTERN_SPARSE,
+	PATTERN_MIXED,
+	PATTERN_ZERO,
+	PATTERN_COUNT,
+};
+
+static const char *const pattern_names[PATTERN_COUNT] = {
+	[PATTERN_RANDOM]	= "random",
+	[PATTERN_SPARSE]	= "sparse",
+	[PATTERN_MIXED]		= "mixed",
+	[PATTERN_ZERO]		= "zero",
+};
+
+/*
+ * The sparse samples have zero in the magic byte, so that the salt runs over
+ * many channels.
+ */
+static void fill_samples(u16 *s16, u32 *s32, unsigned int count,
+			 enum pattern pattern)
+{
+	unsigned int i;
+	u32 v;
+
+	for (i = 0; i < count; i++) {
+		v = (u32)rand() ^ ((u32)rand() << 16);
+		if (pattern == PATTERN_SPARSE ||
+		    (pattern == PATTERN_MIXED && rand() % 8 != 0)) {
+			s16[i] = v & 0x00ff;
+			s32[i] = v & 0xff00ffff;
+		} else if (pattern == PATTERN_ZERO) {
+			s16[i] = 0;
+			s32[i] = 0;
+		} else {
+			s16[i] = v;
+			s32[i] = v;
+		}
+	}
+}
+
+static bool compare(unsigned int channels, bool s32, enum pattern pattern,
+		    unsigned int packets)
+{
+	static u16 s16_samples[FRAMES_PER_PACKET * MAX_CHANNELS];
+	static u32 s32_samples[FRAMES_PER_PACKET * MAX_CHANNELS];
+	static __be32 ref[FRAMES_PER_PACKET * (MAX_CHANNELS + 1)];
+	static __be32 out[FRAMES_PER_PACKET * (MAX_CHANNELS + 1)];
+	struct dot_state ref_state = {0}, state = {0};
+	const void *src = s32 ? (void *)s32_samples : (void *)s16_samples;
+	unsigned int p;
+
+	for (p = 0; p < packets; p++) {
+		fill_samples(s16_samples, s32_samples,
+			     FRAMES_PER_PACKET * channels, pattern);
+		memset(ref, 0, sizeof(ref));
+		memset(out, 0, sizeof(out));
+
+		write_packet_ref(&ref_state, ref, src, channels, s32);
+		write_packet(&state, out, src, channels, s32);
+
+		if (memcmp(ref, out, sizeof(ref)) != 0 ||
+		    ref_state.carry != state.carry ||
+		    ref_state.idx != state.idx) {
+			printf("Mismatch:\t%u ch, %s, %s, packet %u\n",
+			       channels, s32 ? "s32" : "s16",
+			       pattern_names[pattern], p);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static double elapsed_ns(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+static void benchmark(bool s32, unsigned int packets)
+{
+	static u16 s16_samples[FRAMES_PER_PACKET * MAX_CHANNELS];
+	static u32 s32_samples[FRAMES_PER_PACKET * MAX_CHANNELS];
+	static __be32 buffer[FRAMES_PER_PACKET * (MAX_CHANNELS + 1)];
+	const void *src = s32 ? (void *)s32_samples : (void *)s16_samples;
+	struct dot_state state = {0};
+	struct timespec t0, t1, t2;
+	unsigned int p;
+
+	fill_samples(s16_samples, s32_samples,
+		     FRAMES_PER_PACKET * MAX_CHANNELS, PATTERN_MIXED);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (p = 0; p < packets; p++)
+		write_packet_ref(&state, buffer, src, MAX_CHANNELS, s32);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (p = 0; p < packets; p++)
+		write_packet(&state, buffer, src, MAX_CHANNELS, s32);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	/* keep the buffer alive */
+	printf("%s, %u ch:\treference %.1f ns/packet, current %.1f ns/packet"
+	       " (%08x)\n", s32 ? "s32" : "s16", MAX_CHANNELS,
+	       elapsed_ns(&t0, &t1) / packets, elapsed_ns(&t1, &t2) / packets,
+	       buffer[0]);
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int channels[] = {18, 10, 7};
+	unsigned int packets = 100000;
+	unsigned int i, w;
+	enum pattern pattern;
+	bool ok = true;
+
+	if (argc > 1)
+		packets = strtoul(argv[1], NULL, 0);
+	if (packets == 0) {
+		printf("Usage: %s [packets]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fill_dot_salts();
+	srand(1);
+
+	for (i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+		for (w = 0; w < 2; w++) {
+			for (pattern = 0; pattern < PATTERN_COUNT; pattern++)
+				ok &= compare(channels[i], w, pattern,
+					      packets);
+		}
+	}
+	printf("Comparison:\t%s\n", ok ? "identical" : "different");
+
+	benchmark(false, packets * 10);
+	benchmark(true, packets * 10);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,9 +20,17 @@ struct snd_firewire_event_lock_status {
 	unsigned int status; /* 0/1 = unlocked/locked */
 };
 
+/*
+ * Each notification of DICE is queued with the bus generation and the
+ * CLOCK_MONOTONIC time when it arrived, and one read() returns one of them.
+ * A read with the size of the first two fields returns them only.
+ */
 struct snd_firewire_event_dice_notification {
 	unsigned int type;
 	unsigned int notification; /* DICE-specific bits */
+	unsigned int generation;
+	unsigned int dropped; /* the number of notifications lost before */
+	__u64 timestamp; /* in nanoseconds */
 };
 
 #define SND_EFW_TRANSACTION_USER_SEQNUM_MAX	((__u32)((__u16)~0) - 1)
@@ -41,6 +49,24 @@ struct snd_firewire_event_efw_response {
 	__be32 response[0];	/* some responses */
 };
 
+/*
+ * Fireworks responses can also be consumed by mmap() of the hwdep device. The
+ * first page of the mapping is this header, and the ring of responses follows
+ * from the second page. The first mmap() after open() chooses the size of the
+ * ring by the size of the mapping, when no response is pending. The driver
+ * advances @head after storing responses, and the client advances @tail after
+ * consuming them. Both count bytes and wrap at 2^32; the position in the ring
+ * is the count modulo @size. Each response starts with struct
+ * snd_efw_transaction, and responses which find no room are counted in
+ * @dropped.
+ */
+struct snd_efw_response_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 size;
+	__u32 dropped;
+};
+
 struct snd_firewire_event_digi00x_message {
 	unsigned int type;
 	__u32 message;	/* Digi00x-specific message */
@@ -33,6 +33,10 @@ static void print_event_dice(struct snd_firewire_event_dice_notification *msg)
 {
 	printf("\nDice Norification:\n");
 	printf("Notification: 0x%x\n", msg->notification);
+	printf("Generation: %u\n", msg->generation);
+	printf("Timestamp: %llu\n", (unsigned long long)msg->timestamp);
+	if (msg->dropped > 0)
+		printf("Dropped: %u\n", msg->dropped);
 	return;
 }
 
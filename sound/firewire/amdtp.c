@@ -9,9 +9,11 @@
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/firewire.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <sound/control.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
 #include <sound/rawmidi.h>
@@ -70,6 +72,10 @@
 #define IN_PACKET_HEADER_SIZE	4
 #define OUT_PACKET_HEADER_SIZE	0
 
+static bool pcm_meters = true;
+module_param(pcm_meters, bool, 0444);
+MODULE_PARM_DESC(pcm_meters, "add control elements for levels of PCM samples");
+
 static void pcm_period_tasklet(unsigned long data);
 
 static void amdtp_fill_midi(struct amdtp_stream *s,
@@ -92,6 +98,7 @@ int amdtp_stream_init(struct amdtp_stream *s, struct fw_unit *unit,
 	s->context = ERR_PTR(-1);
 	mutex_init(&s->mutex);
 	tasklet_init(&s->period_tasklet, pcm_period_tasklet, (unsigned long)s);
+	spin_lock_init(&s->pcm_levels_lock);
 	s->packet_index = 0;
 
 	init_waitqueue_head(&s->callback_wait);
@@ -240,6 +247,11 @@ sfc_found:
 		s->pcm_positions[i] = i;
 	s->midi_position = s->pcm_channels;
 
+	/* a stream carries the PCM frames alone until it joins a group */
+	s->follower = NULL;
+	s->following = false;
+	s->pcm_channel_offset = 0;
+
 	/*
 	 * We do not know the actual MIDI FIFO size of most devices.  Just
 	 * assume two bytes, i.e., one byte can be received over the bus while
@@ -307,6 +319,10 @@ void amdtp_stream_set_pcm_format(struct amdtp_stream *s,
 			s->transfer_samples = amdtp_read_s32;
 		break;
 	}
+
+	/* followers take their samples from the same PCM buffer */
+	if (s->follower)
+		amdtp_stream_set_pcm_format(s->follower, format);
 }
 EXPORT_SYMBOL(amdtp_stream_set_pcm_format);
 
@@ -318,10 +334,23 @@ EXPORT_SYMBOL(amdtp_stream_set_pcm_format);
  */
 void amdtp_stream_pcm_prepare(struct amdtp_stream *s)
 {
+	if (s->follower)
+		amdtp_stream_pcm_prepare(s->follower);
+
 	tasklet_kill(&s->period_tasklet);
 	s->pcm_buffer_pointer = 0;
 	s->pcm_period_pointer = 0;
 	s->pointer_flush = true;
+	s->pcm_start_pending = false;
+
+	s->pcm_meter_frames = 0;
+	memset(s->pcm_meter_peaks, 0, sizeof(s->pcm_meter_peaks));
+	memset(s->pcm_meter_squares, 0, sizeof(s->pcm_meter_squares));
+
+	spin_lock_irq(&s->pcm_levels_lock);
+	memset(s->pcm_peak_levels, 0, sizeof(s->pcm_peak_levels));
+	memset(s->pcm_power_levels, 0, sizeof(s->pcm_power_levels));
+	spin_unlock_irq(&s->pcm_levels_lock);
 }
 EXPORT_SYMBOL(amdtp_stream_pcm_prepare);
 
@@ -403,28 +432,177 @@ static unsigned int calculate_syt(struct amdtp_stream *s,
 	}
 }
 
+/*
+ * With dual wire, one data block carries two PCM frames, and the samples of
+ * one channel are in adjacent quadlets: the block is the zip of the frames.
+ * The position map tells the same, but these functions copy the frames with
+ * plain strides instead of looking up each sample.
+ */
+static void write_s32_dual(struct amdtp_stream *s,
+			   struct snd_pcm_substream *pcm,
+			   __be32 *buffer, unsigned int frames)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+	unsigned int channels, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	const u32 *src, *next, *base;
+
+	channels = s->pcm_channels / 2;
+	base = (const u32 *)runtime->dma_area + s->pcm_channel_offset;
+	src = base + s->pcm_buffer_pointer * runtime->channels;
+	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
+
+	for (i = 0; i < frames; ++i) {
+		next = src + runtime->channels;
+		if (--remaining_frames == 0) {
+			next = base;
+			remaining_frames = runtime->buffer_size;
+		}
+
+		for (c = 0; c < channels; ++c) {
+			buffer[c * 2] = cpu_to_be32((src[c] >> 8) | 0x40000000);
+			buffer[c * 2 + 1] =
+				cpu_to_be32((next[c] >> 8) | 0x40000000);
+		}
+		if (meter) {
+			for (c = 0; c < channels; ++c) {
+				amdtp_stream_pcm_meter(s, c, (s32)src[c] >> 8);
+				amdtp_stream_pcm_meter(s, c, (s32)next[c] >> 8);
+			}
+		}
+
+		src = next + runtime->channels;
+		if (--remaining_frames == 0) {
+			src = base;
+			remaining_frames = runtime->buffer_size;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+static void write_s16_dual(struct amdtp_stream *s,
+			   struct snd_pcm_substream *pcm,
+			   __be32 *buffer, unsigned int frames)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+	unsigned int channels, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	const u16 *src, *next, *base;
+
+	channels = s->pcm_channels / 2;
+	base = (const u16 *)runtime->dma_area + s->pcm_channel_offset;
+	src = base + s->pcm_buffer_pointer * runtime->channels;
+	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
+
+	for (i = 0; i < frames; ++i) {
+		next = src + runtime->channels;
+		if (--remaining_frames == 0) {
+			next = base;
+			remaining_frames = runtime->buffer_size;
+		}
+
+		for (c = 0; c < channels; ++c) {
+			buffer[c * 2] = cpu_to_be32((src[c] << 8) | 0x42000000);
+			buffer[c * 2 + 1] =
+				cpu_to_be32((next[c] << 8) | 0x42000000);
+		}
+		if (meter) {
+			for (c = 0; c < channels; ++c) {
+				amdtp_stream_pcm_meter(s, c,
+						       (s16)src[c] * 256);
+				amdtp_stream_pcm_meter(s, c,
+						       (s16)next[c] * 256);
+			}
+		}
+
+		src = next + runtime->channels;
+		if (--remaining_frames == 0) {
+			src = base;
+			remaining_frames = runtime->buffer_size;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+static void read_s32_dual(struct amdtp_stream *s,
+			  struct snd_pcm_substream *pcm,
+			  __be32 *buffer, unsigned int frames)
+{
+	struct snd_pcm_runtime *runtime = pcm->runtime;
+	unsigned int channels, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	u32 *dst, *next, *base;
+
+	channels = s->pcm_channels / 2;
+	base = (u32 *)runtime->dma_area + s->pcm_channel_offset;
+	dst = base + s->pcm_buffer_pointer * runtime->channels;
+	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
+
+	for (i = 0; i < frames; ++i) {
+		next = dst + runtime->channels;
+		if (--remaining_frames == 0) {
+			next = base;
+			remaining_frames = runtime->buffer_size;
+		}
+
+		for (c = 0; c < channels; ++c) {
+			dst[c] = be32_to_cpu(buffer[c * 2]) << 8;
+			next[c] = be32_to_cpu(buffer[c * 2 + 1]) << 8;
+		}
+		if (meter) {
+			for (c = 0; c < channels; ++c) {
+				amdtp_stream_pcm_meter(s, c, (s32)dst[c] >> 8);
+				amdtp_stream_pcm_meter(s, c, (s32)next[c] >> 8);
+			}
+		}
+
+		dst = next + runtime->channels;
+		if (--remaining_frames == 0) {
+			dst = base;
+			remaining_frames = runtime->buffer_size;
+		}
+		buffer += s->data_block_quadlets;
+	}
+}
+
+/*
+ * The samples of a stream are at pcm_channel_offset in each PCM frame, and
+ * the rest of the frame belongs to the other streams in the group. The
+ * double_pcm_frames flag is set with the stream parameters, which can be
+ * later than the PCM format, thus dual wire is checked here.
+ */
 static void amdtp_write_s32(struct amdtp_stream *s,
 			    struct snd_pcm_substream *pcm,
 			    __be32 *buffer, unsigned int frames)
 {
 	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int channels, remaining_frames, i, c;
-	const u32 *src;
+	unsigned int channels, skip, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	const u32 *src, *base;
+
+	if (s->double_pcm_frames) {
+		write_s32_dual(s, pcm, buffer, frames);
+		return;
+	}
 
 	channels = s->pcm_channels;
-	src = (void *)runtime->dma_area +
-			frames_to_bytes(runtime, s->pcm_buffer_pointer);
+	skip = runtime->channels - channels;
+	base = (const u32 *)runtime->dma_area + s->pcm_channel_offset;
+	src = base + s->pcm_buffer_pointer * runtime->channels;
 	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
 
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c) {
 			buffer[s->pcm_positions[c]] =
 					cpu_to_be32((*src >> 8) | 0x40000000);
+			if (meter)
+				amdtp_stream_pcm_meter(s, c, (s32)*src >> 8);
 			src++;
 		}
-		buffer += s->data_block_quadlets;
+		src += skip;
 		if (--remaining_frames == 0)
-			src = (void *)runtime->dma_area;
+			src = base;
+		buffer += s->data_block_quadlets;
 	}
 }
 
@@ -433,23 +611,33 @@ static void amdtp_write_s16(struct amdtp_stream *s,
 			    __be32 *buffer, unsigned int frames)
 {
 	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int channels, remaining_frames, i, c;
-	const u16 *src;
+	unsigned int channels, skip, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	const u16 *src, *base;
+
+	if (s->double_pcm_frames) {
+		write_s16_dual(s, pcm, buffer, frames);
+		return;
+	}
 
 	channels = s->pcm_channels;
-	src = (void *)runtime->dma_area +
-			frames_to_bytes(runtime, s->pcm_buffer_pointer);
+	skip = runtime->channels - channels;
+	base = (const u16 *)runtime->dma_area + s->pcm_channel_offset;
+	src = base + s->pcm_buffer_pointer * runtime->channels;
 	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
 
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c) {
 			buffer[s->pcm_positions[c]] =
 					cpu_to_be32((*src << 8) | 0x42000000);
+			if (meter)
+				amdtp_stream_pcm_meter(s, c, (s16)*src * 256);
 			src++;
 		}
-		buffer += s->data_block_quadlets;
+		src += skip;
 		if (--remaining_frames == 0)
-			src = (void *)runtime->dma_area;
+			src = base;
+		buffer += s->data_block_quadlets;
 	}
 }
 
@@ -458,22 +646,32 @@ static void amdtp_read_s32(struct amdtp_stream *s,
 			   __be32 *buffer, unsigned int frames)
 {
 	struct snd_pcm_runtime *runtime = pcm->runtime;
-	unsigned int channels, remaining_frames, i, c;
-	u32 *dst;
+	unsigned int channels, skip, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	u32 *dst, *base;
+
+	if (s->double_pcm_frames) {
+		read_s32_dual(s, pcm, buffer, frames);
+		return;
+	}
 
 	channels = s->pcm_channels;
-	dst  = (void *)runtime->dma_area +
-			frames_to_bytes(runtime, s->pcm_buffer_pointer);
+	skip = runtime->channels - channels;
+	base = (u32 *)runtime->dma_area + s->pcm_channel_offset;
+	dst = base + s->pcm_buffer_pointer * runtime->channels;
 	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
 
 	for (i = 0; i < frames; ++i) {
 		for (c = 0; c < channels; ++c) {
 			*dst = be32_to_cpu(buffer[s->pcm_positions[c]]) << 8;
+			if (meter)
+				amdtp_stream_pcm_meter(s, c, (s32)*dst >> 8);
 			dst++;
 		}
-		buffer += s->data_block_quadlets;
+		dst += skip;
 		if (--remaining_frames == 0)
-			dst = (void *)runtime->dma_area;
+			dst = base;
+		buffer += s->data_block_quadlets;
 	}
 }
 
@@ -567,12 +765,41 @@ static void amdtp_pull_midi(struct amdtp_stream *s,
 	}
 }
 
+/* Hand over the levels of the last period to control elements. */
+static void publish_pcm_levels(struct amdtp_stream *s)
+{
+	unsigned long flags;
+	unsigned int c;
+	u64 power;
+
+	spin_lock_irqsave(&s->pcm_levels_lock, flags);
+	for (c = 0; c < s->pcm_channels; c++) {
+		s->pcm_peak_levels[c] = s->pcm_meter_peaks[c];
+		power = s->pcm_meter_squares[c];
+		if (s->pcm_meter_frames > 0)
+			power = div_u64(power, s->pcm_meter_frames);
+		s->pcm_power_levels[c] = power;
+	}
+	spin_unlock_irqrestore(&s->pcm_levels_lock, flags);
+
+	s->pcm_meter_frames = 0;
+	memset(s->pcm_meter_peaks, 0, sizeof(s->pcm_meter_peaks));
+	memset(s->pcm_meter_squares, 0, sizeof(s->pcm_meter_squares));
+}
+
 static void update_pcm_pointers(struct amdtp_stream *s,
 				struct snd_pcm_substream *pcm,
 				unsigned int frames)
 {
 	unsigned int ptr;
 
+	/*
+	 * Count PCM frames, as the transfer_samples callback meters them. In
+	 * dual wire, both frames of a data block go into the same channel.
+	 */
+	if (s->pcm_meter)
+		s->pcm_meter_frames += frames << s->double_pcm_frames;
+
 	/*
 	 * In IEC 61883-6, one data block represents one event. In ALSA, one
 	 * event equals to one PCM frame. But Dice has a quirk to transfer
@@ -590,7 +817,11 @@ static void update_pcm_pointers(struct amdtp_stream *s,
 	if (s->pcm_period_pointer >= pcm->runtime->period_size) {
 		s->pcm_period_pointer -= pcm->runtime->period_size;
 		s->pointer_flush = false;
-		tasklet_hi_schedule(&s->period_tasklet);
+		/* the first stream of a group reports periods of the PCM */
+		if (!s->following)
+			tasklet_hi_schedule(&s->period_tasklet);
+		if (s->pcm_meter)
+			publish_pcm_levels(s);
 	}
 }
 
@@ -644,20 +875,22 @@ static inline int queue_in_packet(struct amdtp_stream *s)
 			    amdtp_stream_get_max_payload(s), false);
 }
 
-static void handle_out_packet(struct amdtp_stream *s, unsigned int syt)
+static unsigned int out_packet_data_blocks(struct amdtp_stream *s,
+					   unsigned int syt)
 {
-	__be32 *buffer;
-	unsigned int data_blocks, payload_length;
-	struct snd_pcm_substream *pcm;
-
-	if (s->packet_index < 0)
-		return;
-
 	/* this module generate empty packet for 'no data' */
 	if (!(s->flags & CIP_BLOCKING) || (syt != CIP_SYT_NO_INFO))
-		data_blocks = calculate_data_blocks(s);
+		return calculate_data_blocks(s);
 	else
-		data_blocks = 0;
+		return 0;
+}
+
+static void fill_out_packet(struct amdtp_stream *s, unsigned int syt,
+			    unsigned int data_blocks,
+			    struct snd_pcm_substream *pcm)
+{
+	__be32 *buffer;
+	unsigned int payload_length;
 
 	buffer = s->buffer.packets[s->packet_index].buffer;
 	buffer[0] = cpu_to_be32(ACCESS_ONCE(s->source_node_id_field) |
@@ -667,7 +900,6 @@ static void handle_out_packet(struct amdtp_stream *s, unsigned int syt)
 				(s->sfc << CIP_FDF_SFC_SHIFT) | syt);
 	buffer += 2;
 
-	pcm = ACCESS_ONCE(s->pcm);
 	if (pcm)
 		s->transfer_samples(s, pcm, buffer, data_blocks);
 	else
@@ -688,12 +920,68 @@ static void handle_out_packet(struct amdtp_stream *s, unsigned int syt)
 		update_pcm_pointers(s, pcm, data_blocks);
 }
 
-static void handle_in_packet(struct amdtp_stream *s,
-			     unsigned int payload_quadlets,
-			     __be32 *buffer)
+static void handle_out_packet(struct amdtp_stream *s, unsigned int syt,
+			      unsigned int data_blocks)
+{
+	struct snd_pcm_substream *pcm;
+	struct amdtp_stream *f;
+
+	if (s->packet_index < 0)
+		return;
+
+	pcm = ACCESS_ONCE(s->pcm);
+	fill_out_packet(s, syt, data_blocks, pcm);
+
+	/*
+	 * The followers transfer the other channels of the same PCM frames,
+	 * with the same timestamp, so they decide on the PCM at once.
+	 */
+	for (f = s->follower; f != NULL; f = f->follower) {
+		if (f->callbacked && f->packet_index >= 0)
+			fill_out_packet(f, syt, data_blocks, pcm);
+	}
+}
+
+static void flush_followers(struct amdtp_stream *s)
+{
+	struct amdtp_stream *f;
+
+	for (f = s->follower; f != NULL; f = f->follower) {
+		if (f->callbacked)
+			fw_iso_context_queue_flush(f->context);
+	}
+}
+
+static inline unsigned int cycle_diff(unsigned int after, unsigned int before)
+{
+	return (after + CYCLES_PER_SECOND - before) % CYCLES_PER_SECOND;
+}
+
+/*
+ * The streams in a group start to capture at the same cycle, so that the
+ * samples in one PCM frame come from the same packet cycle.
+ */
+static bool pcm_capture_started(struct amdtp_stream *s, unsigned int cycle)
+{
+	smp_rmb();
+
+	if (s->pcm_start_pending) {
+		if (cycle_diff(cycle, s->pcm_start_cycle) >=
+						CYCLES_PER_SECOND / 2)
+			return false;
+		s->pcm_start_pending = false;
+	}
+
+	return true;
+}
+
+/* Returns the number of data blocks in the packet. */
+static unsigned int handle_in_packet(struct amdtp_stream *s,
+				     unsigned int payload_quadlets,
+				     __be32 *buffer, unsigned int cycle)
 {
 	u32 cip_header[2];
-	unsigned int data_blocks, data_block_quadlets, data_block_counter,
+	unsigned int data_blocks = 0, data_block_quadlets, data_block_counter,
 		     dbc_interval;
 	struct snd_pcm_substream *pcm = NULL;
 	bool lost;
@@ -767,6 +1055,8 @@ static void handle_in_packet(struct amdtp_stream *s,
 		buffer += 2;
 
 		pcm = ACCESS_ONCE(s->pcm);
+		if (pcm && !pcm_capture_started(s, cycle))
+			pcm = NULL;
 		if (pcm)
 			s->transfer_samples(s, pcm, buffer, data_blocks);
 
@@ -786,10 +1076,11 @@ end:
 	if (pcm)
 		update_pcm_pointers(s, pcm, data_blocks);
 
-	return;
+	return data_blocks;
 err:
 	s->packet_index = -1;
 	amdtp_stream_pcm_abort(s);
+	return 0;
 }
 
 static void out_stream_callback(struct fw_iso_context *context, u32 cycle,
@@ -808,9 +1099,34 @@ static void out_stream_callback(struct fw_iso_context *context, u32 cycle,
 
 	for (i = 0; i < packets; ++i) {
 		syt = calculate_syt(s, ++cycle);
-		handle_out_packet(s, syt);
+		handle_out_packet(s, syt, out_packet_data_blocks(s, syt));
 	}
 	fw_iso_context_queue_flush(s->context);
+	flush_followers(s);
+}
+
+/*
+ * A non-blocking stream carries as many data blocks as the packet from the
+ * device and counts them from the same value, so that the time stamp copied
+ * from the packet points at the same data block in both. A blocking stream
+ * has its time stamp at the first data block of any packet with data.
+ */
+static void handle_slave_packet(struct amdtp_stream *master, unsigned int syt,
+				unsigned int data_blocks)
+{
+	struct amdtp_stream *s = master->sync_slave;
+
+	if (!(s->flags & CIP_BLOCKING) &&
+	    !(master->flags & CIP_DBC_IS_END_EVENT) &&
+	    master->data_block_counter != UINT_MAX) {
+		s->data_block_counter =
+			(master->data_block_counter - data_blocks) & 0xff;
+		data_blocks = min(data_blocks, s->syt_interval);
+	} else {
+		data_blocks = out_packet_data_blocks(s, syt);
+	}
+
+	handle_out_packet(s, syt, data_blocks);
 }
 
 static void in_stream_callback(struct fw_iso_context *context, u32 cycle,
@@ -818,28 +1134,38 @@ static void in_stream_callback(struct fw_iso_context *context, u32 cycle,
 			       void *private_data)
 {
 	struct amdtp_stream *s = private_data;
-	unsigned int p, syt, packets, payload_quadlets;
+	unsigned int p, syt, packets, payload_quadlets, data_blocks;
 	__be32 *buffer, *headers = header;
 
 	/* The number of packets in buffer */
 	packets = header_length / IN_PACKET_HEADER_SIZE;
 
+	/*
+	 * The timestamp is of the last packet, and the device transmits one
+	 * packet in every cycle.
+	 */
+	cycle &= 0x1fff;
+	ACCESS_ONCE(s->last_cycle) = cycle;
+	cycle = cycle_diff(cycle, packets - 1);
+
 	for (p = 0; p < packets; p++) {
 		if (s->packet_index < 0)
 			break;
 
 		buffer = s->buffer.packets[s->packet_index].buffer;
-
-		/* Process sync slave stream */
-		if (s->sync_slave && s->sync_slave->callbacked) {
-			syt = be32_to_cpu(buffer[1]) & CIP_SYT_MASK;
-			handle_out_packet(s->sync_slave, syt);
-		}
+		syt = be32_to_cpu(buffer[1]) & CIP_SYT_MASK;
 
 		/* The number of quadlets in this packet */
 		payload_quadlets =
 			(be32_to_cpu(headers[p]) >> ISO_DATA_LENGTH_SHIFT) / 4;
-		handle_in_packet(s, payload_quadlets, buffer);
+		data_blocks = handle_in_packet(s, payload_quadlets, buffer,
+					       cycle);
+		cycle = (cycle + 1) % CYCLES_PER_SECOND;
+
+		/* Process sync slave stream */
+		if (s->packet_index >= 0 &&
+		    s->sync_slave && s->sync_slave->callbacked)
+			handle_slave_packet(s, syt, data_blocks);
 	}
 
 	/* Queueing error or detecting discontinuity */
@@ -853,8 +1179,10 @@ static void in_stream_callback(struct fw_iso_context *context, u32 cycle,
 	}
 
 	/* when sync to device, flush the packets for slave stream */
-	if (s->sync_slave && s->sync_slave->callbacked)
+	if (s->sync_slave && s->sync_slave->callbacked) {
 		fw_iso_context_queue_flush(s->sync_slave->context);
+		flush_followers(s->sync_slave);
+	}
 
 	fw_iso_context_queue_flush(s->context);
 }
@@ -883,7 +1211,7 @@ static void amdtp_stream_first_callback(struct fw_iso_context *context,
 
 	if (s->direction == AMDTP_IN_STREAM)
 		context->callback.sc = in_stream_callback;
-	else if ((s->flags & CIP_BLOCKING) && (s->flags & CIP_SYNC_TO_DEVICE))
+	else if (s->following || (s->flags & CIP_SYNC_TO_DEVICE))
 		context->callback.sc = slave_stream_callback;
 	else
 		context->callback.sc = out_stream_callback;
@@ -1016,13 +1344,34 @@ EXPORT_SYMBOL(amdtp_stream_start);
  */
 unsigned long amdtp_stream_pcm_pointer(struct amdtp_stream *s)
 {
+	struct snd_pcm_substream *pcm;
+	struct amdtp_stream *f;
+	unsigned int ptr, follower_ptr, size;
+
 	/* this optimization is allowed to be racy */
 	if (s->pointer_flush && amdtp_stream_running(s))
 		fw_iso_context_flush_completions(s->context);
 	else
 		s->pointer_flush = true;
 
-	return ACCESS_ONCE(s->pcm_buffer_pointer);
+	ptr = ACCESS_ONCE(s->pcm_buffer_pointer);
+
+	/*
+	 * In-streams in a group are handled in their own callbacks. A frame is
+	 * captured when the stream behind the others has it.
+	 */
+	pcm = ACCESS_ONCE(s->pcm);
+	if (s->direction != AMDTP_IN_STREAM || !s->follower || !pcm)
+		return ptr;
+
+	size = pcm->runtime->buffer_size;
+	for (f = s->follower; f != NULL; f = f->follower) {
+		follower_ptr = ACCESS_ONCE(f->pcm_buffer_pointer);
+		if ((ptr + size - follower_ptr) % size < size / 2)
+			ptr = follower_ptr;
+	}
+
+	return ptr;
 }
 EXPORT_SYMBOL(amdtp_stream_pcm_pointer);
 
@@ -1081,3 +1430,153 @@ void amdtp_stream_pcm_abort(struct amdtp_stream *s)
 		snd_pcm_stop_xrun(pcm);
 }
 EXPORT_SYMBOL(amdtp_stream_pcm_abort);
+
+/**
+ * amdtp_stream_pcm_trigger_group - start/stop a PCM device on a stream group
+ * @s: the first AMDTP stream of the group
+ * @pcm: the PCM device to be started, or %NULL to stop the current device
+ *
+ * This is called by amdtp_stream_pcm_trigger() for streams with followers.
+ */
+void amdtp_stream_pcm_trigger_group(struct amdtp_stream *s,
+				    struct snd_pcm_substream *pcm)
+{
+	struct amdtp_stream *f;
+	unsigned int cycle, latest;
+
+	/*
+	 * Start to capture at a cycle which no stream has handled yet. None of
+	 * them can be ahead of the latest cycle reported by a callback by more
+	 * than the queue length.
+	 */
+	if (pcm && s->direction == AMDTP_IN_STREAM) {
+		latest = ACCESS_ONCE(s->last_cycle);
+		for (f = s->follower; f != NULL; f = f->follower) {
+			cycle = ACCESS_ONCE(f->last_cycle);
+			if (cycle_diff(cycle, latest) < CYCLES_PER_SECOND / 2)
+				latest = cycle;
+		}
+
+		cycle = (latest + QUEUE_LENGTH) % CYCLES_PER_SECOND;
+		for (f = s; f != NULL; f = f->follower) {
+			f->pcm_start_cycle = cycle;
+			f->pcm_start_pending = true;
+		}
+		smp_wmb();
+	}
+
+	for (f = s; f != NULL; f = f->follower)
+		ACCESS_ONCE(f->pcm) = pcm;
+}
+EXPORT_SYMBOL(amdtp_stream_pcm_trigger_group);
+
+#define PCM_METER_MAX	0x7fffff
+
+enum pcm_meter_type {
+	PCM_METER_PEAK = 0,
+	PCM_METER_RMS,
+};
+
+static int pcm_meter_info(struct snd_kcontrol *kctl,
+			  struct snd_ctl_elem_info *einf)
+{
+	einf->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	einf->count = AMDTP_MAX_CHANNELS_FOR_PCM;
+	einf->value.integer.min = 0;
+	einf->value.integer.max = PCM_METER_MAX;
+
+	return 0;
+}
+
+/* The levels of a stream are at the position of its channels in PCM frames. */
+static void copy_pcm_levels(struct amdtp_stream *s, unsigned long type,
+			    long *values)
+{
+	unsigned int c, channels;
+
+	if (s->pcm_channel_offset >= AMDTP_MAX_CHANNELS_FOR_PCM)
+		return;
+	channels = min(s->pcm_channels >> s->double_pcm_frames,
+		       AMDTP_MAX_CHANNELS_FOR_PCM - s->pcm_channel_offset);
+	values += s->pcm_channel_offset;
+
+	spin_lock_irq(&s->pcm_levels_lock);
+	for (c = 0; c < channels; c++) {
+		if (type == PCM_METER_PEAK)
+			values[c] = s->pcm_peak_levels[c];
+		else
+			values[c] = s->pcm_power_levels[c];
+	}
+	spin_unlock_irq(&s->pcm_levels_lock);
+}
+
+static int pcm_meter_get(struct snd_kcontrol *kctl,
+			 struct snd_ctl_elem_value *uval)
+{
+	struct amdtp_stream *s = snd_kcontrol_chip(kctl);
+	long *values = uval->value.integer.value;
+	unsigned int c;
+
+	for (c = 0; c < AMDTP_MAX_CHANNELS_FOR_PCM; c++)
+		values[c] = 0;
+	for (; s != NULL; s = s->follower)
+		copy_pcm_levels(s, kctl->private_value, values);
+
+	for (c = 0; c < AMDTP_MAX_CHANNELS_FOR_PCM; c++) {
+		/* the power is in the scale of 16 bit samples */
+		if (kctl->private_value == PCM_METER_RMS)
+			values[c] = int_sqrt(values[c]) << 8;
+		values[c] = min_t(long, values[c], PCM_METER_MAX);
+	}
+
+	return 0;
+}
+
+/**
+ * amdtp_stream_add_pcm_meters - add control elements for levels of PCM samples
+ * @s: the AMDTP stream, which must be initialized
+ * @card: the sound card to add the elements to
+ *
+ * This function adds two read-only elements, with the peak level and the root
+ * mean square level of each PCM channel in the last period. Both are in the
+ * scale of 24 bit samples. The levels are accumulated while the samples are
+ * copied, so they cost no transaction to the device.
+ */
+int amdtp_stream_add_pcm_meters(struct amdtp_stream *s, struct snd_card *card)
+{
+	static const char *const names[][2] = {
+		[AMDTP_OUT_STREAM] = {
+			[PCM_METER_PEAK] = "PCM Playback Peak",
+			[PCM_METER_RMS] = "PCM Playback RMS",
+		},
+		[AMDTP_IN_STREAM] = {
+			[PCM_METER_PEAK] = "PCM Capture Peak",
+			[PCM_METER_RMS] = "PCM Capture RMS",
+		},
+	};
+	struct snd_kcontrol_new meter_ctl = {
+		.iface	= SNDRV_CTL_ELEM_IFACE_PCM,
+		.access	= SNDRV_CTL_ELEM_ACCESS_READ |
+			  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info	= pcm_meter_info,
+		.get	= pcm_meter_get,
+	};
+	unsigned int i;
+	int err;
+
+	if (!pcm_meters)
+		return 0;
+
+	for (i = PCM_METER_PEAK; i <= PCM_METER_RMS; i++) {
+		meter_ctl.name = names[s->direction][i];
+		meter_ctl.private_value = i;
+		err = snd_ctl_add(card, snd_ctl_new1(&meter_ctl, s));
+		if (err < 0)
+			return err;
+	}
+
+	s->pcm_meter = true;
+
+	return 0;
+}
+EXPORT_SYMBOL(amdtp_stream_add_pcm_meters);
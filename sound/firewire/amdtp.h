@@ -3,7 +3,9 @@
 
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/kernel.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <sound/asound.h>
 #include "packets-buffer.h"
 
@@ -18,6 +20,8 @@
  *	the overall sample rate comes out right.
  * @CIP_SYNC_TO_DEVICE: In sync to device mode, time stamp in out packets is
  *	generated by in packets. Defaultly this driver generates timestamp.
+ *	Non-blocking out packets also take the number of data blocks and the
+ *	data block counter from the in packets.
  * @CIP_EMPTY_WITH_TAG0: Only for in-stream. Empty in-packets have TAG0.
  * @CIP_DBC_IS_END_EVENT: Only for in-stream. The value of dbc in an in-packet
  *	corresponds to the end of event in the packet. Out of IEC 61883.
@@ -100,6 +104,7 @@ enum cip_sfc {
 
 struct fw_unit;
 struct fw_iso_context;
+struct snd_card;
 struct snd_pcm_substream;
 struct snd_pcm_runtime;
 struct snd_rawmidi_substream;
@@ -124,6 +129,8 @@ struct amdtp_stream {
 				 struct snd_pcm_substream *pcm,
 				 __be32 *buffer, unsigned int frames);
 	u8 pcm_positions[AMDTP_MAX_CHANNELS_FOR_PCM];
+	/* the index of the first channel of this stream in the PCM frames */
+	unsigned int pcm_channel_offset;
 	void (*transfer_midi)(struct amdtp_stream *s,
 			      __be32 *buffer, unsigned int frame);
 	u8 midi_position;
@@ -149,6 +156,16 @@ struct amdtp_stream {
 	bool pointer_flush;
 	bool double_pcm_frames;
 
+	/* levels of PCM samples, accumulated in the current period */
+	bool pcm_meter;
+	unsigned int pcm_meter_frames;
+	u32 pcm_meter_peaks[AMDTP_MAX_CHANNELS_FOR_PCM];
+	u64 pcm_meter_squares[AMDTP_MAX_CHANNELS_FOR_PCM];
+	/* and the ones of the last period, for control elements */
+	spinlock_t pcm_levels_lock;
+	u32 pcm_peak_levels[AMDTP_MAX_CHANNELS_FOR_PCM];
+	u32 pcm_power_levels[AMDTP_MAX_CHANNELS_FOR_PCM];
+
 	struct snd_rawmidi_substream *midi[AMDTP_MAX_CHANNELS_FOR_MIDI * 8];
 	int midi_fifo_limit;
 	int midi_fifo_used[AMDTP_MAX_CHANNELS_FOR_MIDI * 8];
@@ -159,6 +176,18 @@ struct amdtp_stream {
 	bool callbacked;
 	wait_queue_head_t callback_wait;
 	struct amdtp_stream *sync_slave;
+
+	/*
+	 * The next stream in the same direction, which carries the next
+	 * channels of the same PCM substream.  Out-streams in a group are
+	 * driven by the callback of the first one, in-streams start to capture
+	 * at the same cycle.
+	 */
+	struct amdtp_stream *follower;
+	bool following;
+	unsigned int last_cycle;
+	unsigned int pcm_start_cycle;
+	bool pcm_start_pending;
 };
 
 int amdtp_stream_init(struct amdtp_stream *s, struct fw_unit *unit,
@@ -183,6 +212,9 @@ void amdtp_stream_set_pcm_format(struct amdtp_stream *s,
 void amdtp_stream_pcm_prepare(struct amdtp_stream *s);
 unsigned long amdtp_stream_pcm_pointer(struct amdtp_stream *s);
 void amdtp_stream_pcm_abort(struct amdtp_stream *s);
+void amdtp_stream_pcm_trigger_group(struct amdtp_stream *s,
+				    struct snd_pcm_substream *pcm);
+int amdtp_stream_add_pcm_meters(struct amdtp_stream *s, struct snd_card *card);
 
 extern const unsigned int amdtp_syt_intervals[CIP_SFC_COUNT];
 extern const unsigned int amdtp_rate_table[CIP_SFC_COUNT];
@@ -236,7 +268,30 @@ static inline bool amdtp_stream_pcm_running(struct amdtp_stream *s)
 static inline void amdtp_stream_pcm_trigger(struct amdtp_stream *s,
 					    struct snd_pcm_substream *pcm)
 {
-	ACCESS_ONCE(s->pcm) = pcm;
+	if (s->follower)
+		amdtp_stream_pcm_trigger_group(s, pcm);
+	else
+		ACCESS_ONCE(s->pcm) = pcm;
+}
+
+/**
+ * amdtp_stream_pcm_meter - accumulate the level of a PCM sample
+ * @s: the AMDTP stream
+ * @c: the index of the PCM channel
+ * @sample: the value of the sample, as a signed 24 bit integer
+ *
+ * Call this function for each sample in the transfer_samples callback,
+ * when @s->pcm_meter is true.
+ */
+static inline void amdtp_stream_pcm_meter(struct amdtp_stream *s,
+					  unsigned int c, s32 sample)
+{
+	u32 level = abs(sample);
+	s32 coarse = sample >> 8;
+
+	if (level > s->pcm_meter_peaks[c])
+		s->pcm_meter_peaks[c] = level;
+	s->pcm_meter_squares[c] += coarse * coarse;
 }
 
 /**
@@ -279,6 +334,33 @@ static inline void amdtp_stream_set_sync(enum cip_flags sync_mode,
 	slave->sync_slave = NULL;
 }
 
+/**
+ * amdtp_stream_set_follower - carry more channels of the PCM in another stream
+ * @s: the first stream of a group, or the last follower in it
+ * @follower: the stream to append to the group, or %NULL to end it at @s
+ *
+ * Call this function after amdtp_stream_set_parameters() for both streams,
+ * which must have the same direction and sampling rate.  The PCM frames hold
+ * the channels of the first stream, then the ones of its followers in order.
+ * Functions for the PCM substream are called for the first stream only, and
+ * the followers must be started before it and stopped after it.  The follower
+ * takes the PCM format of @s, thus this can be called after
+ * amdtp_stream_set_pcm_format() for the first stream, too.
+ */
+static inline void amdtp_stream_set_follower(struct amdtp_stream *s,
+					     struct amdtp_stream *follower)
+{
+	s->follower = follower;
+	if (follower == NULL)
+		return;
+
+	follower->following = true;
+	follower->transfer_samples = s->transfer_samples;
+	follower->pcm_meter = s->pcm_meter;
+	follower->pcm_channel_offset = s->pcm_channel_offset +
+				(s->pcm_channels >> s->double_pcm_frames);
+}
+
 /**
  * amdtp_stream_wait_callback - sleep till callbacked or timeout
  * @s: the AMDTP stream
@@ -127,7 +127,9 @@ bebob_card_free(struct snd_card *card)
 {
 	struct snd_bebob *bebob = card->private_data;
 
+	snd_fw_meter_sampler_destroy(&bebob->meter);
 	snd_bebob_stream_destroy_duplex(bebob);
+	fcp_avc_cache_destroy(&bebob->avc_cache);
 	fw_unit_put(bebob->unit);
 
 	kfree(bebob->maudio_special_quirk);
@@ -141,6 +143,30 @@ bebob_card_free(struct snd_card *card)
 	mutex_destroy(&bebob->mutex);
 }
 
+static int
+get_meters(void *private_data, u32 *values, unsigned int channels)
+{
+	struct snd_bebob *bebob = private_data;
+
+	return bebob->spec->meter->get(bebob, values,
+				       channels * sizeof(u32));
+}
+
+static int
+init_meters(struct snd_bebob *bebob)
+{
+	int err;
+
+	err = snd_fw_meter_sampler_init(&bebob->meter,
+					bebob->spec->meter->num * 2,
+					get_meters, bebob);
+	if (err < 0)
+		return err;
+
+	return snd_fw_meter_sampler_add_control(&bebob->meter, bebob->card,
+						"Hardware Meter");
+}
+
 static const struct snd_bebob_spec *
 get_saffire_spec(struct fw_unit *unit)
 {
@@ -217,6 +243,9 @@ bebob_probe(struct fw_unit *unit,
 
 	bebob->card = card;
 	bebob->unit = fw_unit_get(unit);
+	snd_fw_transaction_stats_init(&bebob->transaction_stats, bebob->unit);
+	fcp_avc_cache_init(&bebob->avc_cache, bebob->unit,
+			   &bebob->transaction_stats);
 	bebob->spec = spec;
 	mutex_init(&bebob->mutex);
 	spin_lock_init(&bebob->lock);
@@ -237,6 +266,12 @@ bebob_probe(struct fw_unit *unit,
 	if (err < 0)
 		goto error;
 
+	if (spec->meter != NULL) {
+		err = init_meters(bebob);
+		if (err < 0)
+			goto error;
+	}
+
 	snd_bebob_proc_init(bebob);
 
 	if ((bebob->midi_input_ports > 0) ||
@@ -258,6 +293,13 @@ bebob_probe(struct fw_unit *unit,
 	if (err < 0)
 		goto error;
 
+	err = amdtp_stream_add_pcm_meters(&bebob->rx_stream, card);
+	if (err < 0)
+		goto error;
+	err = amdtp_stream_add_pcm_meters(&bebob->tx_stream, card);
+	if (err < 0)
+		goto error;
+
 	if (!bebob->maudio_special_quirk) {
 		err = snd_card_register(card);
 		if (err < 0) {
@@ -36,9 +36,13 @@
 #include "../iso-resources.h"
 #include "../amdtp.h"
 #include "../cmp.h"
+#include "../meter.h"
 
 /* basic register addresses on DM1000/DM1100/DM1500 */
 #define BEBOB_ADDR_REG_INFO	0xffffc8020000ULL
+
+/* Offset from information register */
+#define INFO_OFFSET_SW_DATE	0x20
 #define BEBOB_ADDR_REG_REQ	0xffffc8021000ULL
 
 struct snd_bebob;
@@ -103,8 +107,16 @@ struct snd_bebob {
 	struct snd_bebob_stream_formation
 		rx_stream_formations[SND_BEBOB_STRM_FMT_ENTRIES];
 
+	struct fcp_avc_cache avc_cache;
+	struct snd_fw_transaction_stats transaction_stats;
+	struct snd_fw_meter_sampler meter;
+
 	int sync_input_plug;
 
+	/* the time for the last transition of sampling rate, and the longest */
+	unsigned int transition_ms;
+	unsigned int max_transition_ms;
+
 	/* for uapi */
 	int dev_lock_count;
 	bool dev_lock_changed;
@@ -195,6 +207,10 @@ int avc_bridgeco_get_plug_ch_pos(struct fw_unit *unit,
 int avc_bridgeco_get_plug_type(struct fw_unit *unit,
 			       u8 addr[AVC_BRIDGECO_ADDR_BYTES],
 			       enum avc_bridgeco_plug_type *type);
+int avc_bridgeco_get_plug_types(struct fw_unit *unit,
+				u8 (*addrs)[AVC_BRIDGECO_ADDR_BYTES],
+				enum avc_bridgeco_plug_type *types,
+				unsigned int count);
 int avc_bridgeco_get_plug_section_type(struct fw_unit *unit,
 				       u8 addr[AVC_BRIDGECO_ADDR_BYTES],
 				       unsigned int id, u8 *type);
@@ -204,6 +220,10 @@ int avc_bridgeco_get_plug_input(struct fw_unit *unit,
 int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
 				   u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
 				   unsigned int *len, unsigned int eid);
+int avc_bridgeco_get_plug_strm_fmt_list(struct fw_unit *unit,
+					u8 addr[AVC_BRIDGECO_ADDR_BYTES],
+					u8 **bufs, unsigned int *lens,
+					unsigned int count);
 
 /* for AMDTP streaming */
 int snd_bebob_stream_get_rate(struct snd_bebob *bebob, unsigned int *rate);
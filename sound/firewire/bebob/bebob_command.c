@@ -103,6 +103,23 @@ avc_bridgeco_fill_plug_info_extension_command(u8 *buf, u8 *addr,
 	buf[9] = itype;	/* info type */
 }
 
+static int check_plug_type(u8 *buf, int err, enum avc_bridgeco_plug_type *type)
+{
+	if ((err >= 0) && (err < 8))
+		err = -EIO;
+	else if (buf[0] == 0x08) /* NOT IMPLEMENTED */
+		err = -ENOSYS;
+	else if (buf[0] == 0x0a) /* REJECTED */
+		err = -EINVAL;
+	else if (buf[0] == 0x0b) /* IN TRANSITION */
+		err = -EAGAIN;
+	if (err < 0)
+		return err;
+
+	*type = buf[10];
+	return 0;
+}
+
 int avc_bridgeco_get_plug_type(struct fw_unit *unit,
 			       u8 addr[AVC_BRIDGECO_ADDR_BYTES],
 			       enum avc_bridgeco_plug_type *type)
@@ -120,21 +137,55 @@ int avc_bridgeco_get_plug_type(struct fw_unit *unit,
 	err = fcp_avc_transaction(unit, buf, 12, buf, 12,
 				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
 				  BIT(6) | BIT(7) | BIT(9));
-	if ((err >= 0) && (err < 8))
-		err = -EIO;
-	else if (buf[0] == 0x08) /* NOT IMPLEMENTED */
-		err = -ENOSYS;
-	else if (buf[0] == 0x0a) /* REJECTED */
-		err = -EINVAL;
-	else if (buf[0] == 0x0b) /* IN TRANSITION */
-		err = -EAGAIN;
-	if (err < 0)
+	err = check_plug_type(buf, err, type);
+
+	kfree(buf);
+	return err;
+}
+
+/* The commands are sent at once, then the responses are waited for. */
+int avc_bridgeco_get_plug_types(struct fw_unit *unit,
+				u8 (*addrs)[AVC_BRIDGECO_ADDR_BYTES],
+				enum avc_bridgeco_plug_type *types,
+				unsigned int count)
+{
+	struct fcp_avc_request *requests;
+	u8 *bufs;
+	unsigned int i;
+	int err;
+
+	requests = kcalloc(count, sizeof(*requests), GFP_KERNEL);
+	if (requests == NULL)
+		return -ENOMEM;
+	bufs = kcalloc(count, 12, GFP_KERNEL);
+	if (bufs == NULL) {
+		err = -ENOMEM;
 		goto end;
+	}
 
-	*type = buf[10];
-	err = 0;
+	for (i = 0; i < count; i++) {
+		/* Info type is 'plug type'. */
+		avc_bridgeco_fill_plug_info_extension_command(bufs + i * 12,
+							      addrs[i], 0x00);
+
+		requests[i].unit = unit;
+		requests[i].command = bufs + i * 12;
+		requests[i].command_size = 12;
+		requests[i].response = bufs + i * 12;
+		requests[i].response_size = 12;
+		requests[i].response_match_bytes =
+				BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
+				BIT(6) | BIT(7) | BIT(9);
+	}
+
+	err = fcp_avc_transaction_batch(requests, count);
+	for (i = 0; err >= 0 && i < count; i++)
+		err = check_plug_type(bufs + i * 12, requests[i].result,
+				      &types[i]);
+
+	kfree(bufs);
 end:
-	kfree(buf);
+	kfree(requests);
 	return err;
 }
 
@@ -239,27 +290,19 @@ end:
 	return err;
 }
 
-int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
-				   u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
-				   unsigned int *len, unsigned int eid)
+static void fill_strm_fmt_command(u8 *buf, u8 addr[AVC_BRIDGECO_ADDR_BYTES],
+				  unsigned int eid)
 {
-	int err;
-
-	/* check given buffer */
-	if ((buf == NULL) || (*len < 12)) {
-		err = -EINVAL;
-		goto end;
-	}
-
 	buf[0] = 0x01;	/* AV/C STATUS */
 	buf[2] = 0x2f;	/* AV/C STREAM FORMAT SUPPORT */
 	buf[3] = 0xc1;	/* Bridgeco extension - List Request */
 	avc_bridgeco_fill_extension_addr(buf, addr);
 	buf[10] = 0xff & eid;	/* Entry ID */
+}
 
-	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
-				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
-				  BIT(6) | BIT(7) | BIT(10));
+static int check_strm_fmt(u8 *buf, int err, unsigned int *len,
+			  unsigned int eid)
+{
 	if ((err >= 0) && (err < 12))
 		err = -EIO;
 	else if (buf[0] == 0x08)        /* NOT IMPLEMENTED */
@@ -271,12 +314,83 @@ int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
 	else if (buf[10] != eid)
 		err = -EIO;
 	if (err < 0)
-		goto end;
+		return err;
 
 	/* Pick up 'stream format info'. */
 	memmove(buf, buf + 11, err - 11);
 	*len = err - 11;
-	err = 0;
+	return 0;
+}
+
+int avc_bridgeco_get_plug_strm_fmt(struct fw_unit *unit,
+				   u8 addr[AVC_BRIDGECO_ADDR_BYTES], u8 *buf,
+				   unsigned int *len, unsigned int eid)
+{
+	int err;
+
+	/* check given buffer */
+	if ((buf == NULL) || (*len < 12))
+		return -EINVAL;
+
+	fill_strm_fmt_command(buf, addr, eid);
+
+	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
+				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
+				  BIT(6) | BIT(7) | BIT(10));
+	return check_strm_fmt(buf, err, len, eid);
+}
+
+/*
+ * Get the entries of the list from the first at once. The entries after the
+ * last one are rejected by the device, thus the number of available entries
+ * is returned, or a negative error code if the first entry is not available.
+ */
+int avc_bridgeco_get_plug_strm_fmt_list(struct fw_unit *unit,
+					u8 addr[AVC_BRIDGECO_ADDR_BYTES],
+					u8 **bufs, unsigned int *lens,
+					unsigned int count)
+{
+	struct fcp_avc_request *requests;
+	unsigned int eid;
+	int err;
+
+	for (eid = 0; eid < count; eid++) {
+		if ((bufs[eid] == NULL) || (lens[eid] < 12))
+			return -EINVAL;
+	}
+
+	requests = kcalloc(count, sizeof(*requests), GFP_KERNEL);
+	if (requests == NULL)
+		return -ENOMEM;
+
+	for (eid = 0; eid < count; eid++) {
+		fill_strm_fmt_command(bufs[eid], addr, eid);
+
+		requests[eid].unit = unit;
+		requests[eid].command = bufs[eid];
+		requests[eid].command_size = 12;
+		requests[eid].response = bufs[eid];
+		requests[eid].response_size = lens[eid];
+		requests[eid].response_match_bytes =
+				BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
+				BIT(6) | BIT(7) | BIT(10);
+	}
+
+	err = fcp_avc_transaction_batch(requests, count);
+	if (err < 0)
+		goto end;
+
+	for (eid = 0; eid < count; eid++) {
+		err = check_strm_fmt(bufs[eid], requests[eid].result,
+				     &lens[eid], eid);
+		/* No entries remained. */
+		if (err == -EINVAL && eid > 0)
+			break;
+		if (err < 0)
+			goto end;
+	}
+	err = eid;
 end:
+	kfree(requests);
 	return err;
 }
@@ -64,9 +64,10 @@ saffire_read_block(struct snd_bebob *bebob, u64 offset,
 	int err;
 	__be32 *tmp = (__be32 *)buf;
 
-	err =  snd_fw_transaction(bebob->unit, TCODE_READ_BLOCK_REQUEST,
-				  SAFFIRE_ADDRESS_BASE + offset,
-				  tmp, size, 0);
+	err = snd_fw_transaction_counted(&bebob->transaction_stats,
+					 TCODE_READ_BLOCK_REQUEST,
+					 SAFFIRE_ADDRESS_BASE + offset,
+					 tmp, size, 0);
 	if (err < 0)
 		goto end;
 
@@ -82,9 +83,10 @@ saffire_read_quad(struct snd_bebob *bebob, u64 offset, u32 *value)
 	int err;
 	__be32 tmp;
 
-	err = snd_fw_transaction(bebob->unit, TCODE_READ_QUADLET_REQUEST,
-				 SAFFIRE_ADDRESS_BASE + offset,
-				 &tmp, sizeof(__be32), 0);
+	err = snd_fw_transaction_counted(&bebob->transaction_stats,
+					 TCODE_READ_QUADLET_REQUEST,
+					 SAFFIRE_ADDRESS_BASE + offset,
+					 &tmp, sizeof(__be32), 0);
 	if (err < 0)
 		goto end;
 
@@ -98,9 +100,10 @@ saffire_write_quad(struct snd_bebob *bebob, u64 offset, u32 value)
 {
 	__be32 data = cpu_to_be32(value);
 
-	return snd_fw_transaction(bebob->unit, TCODE_WRITE_QUADLET_REQUEST,
-				  SAFFIRE_ADDRESS_BASE + offset,
-				  &data, sizeof(__be32), 0);
+	return snd_fw_transaction_counted(&bebob->transaction_stats,
+					  TCODE_WRITE_QUADLET_REQUEST,
+					  SAFFIRE_ADDRESS_BASE + offset,
+					  &data, sizeof(__be32), 0);
 }
 
 static const char *const saffirepro_10_clk_src_labels[] = {
@@ -35,9 +35,6 @@
  * functionality is between 0xffc700700000 to 0xffc70070009c.
  */
 
-/* Offset from information register */
-#define INFO_OFFSET_SW_DATE	0x20
-
 /* Bootloader Protocol Version 1 */
 #define MAUDIO_BOOTLOADER_CUE1	0x00000001
 /*
@@ -134,9 +131,10 @@ end:
 static inline int
 get_meter(struct snd_bebob *bebob, void *buf, unsigned int size)
 {
-	return snd_fw_transaction(bebob->unit, TCODE_READ_BLOCK_REQUEST,
-				  MAUDIO_SPECIFIC_ADDRESS + METER_OFFSET,
-				  buf, size, 0);
+	return snd_fw_transaction_counted(&bebob->transaction_stats,
+				TCODE_READ_BLOCK_REQUEST,
+				MAUDIO_SPECIFIC_ADDRESS + METER_OFFSET,
+				buf, size, 0);
 }
 
 static int
@@ -86,7 +86,7 @@ proc_read_meters(struct snd_info_entry *entry,
 	if (buf == NULL)
 		return;
 
-	if (spec->get(bebob, buf, size) < 0)
+	if (snd_fw_meter_sampler_read(&bebob->meter, buf) < 0)
 		goto end;
 
 	for (i = 0, c = 1; i < channels; i++) {
@@ -140,6 +140,8 @@ proc_read_clock(struct snd_info_entry *entry,
 
 	if (rate_spec->get(bebob, &rate) >= 0)
 		snd_iprintf(buffer, "Sampling rate: %d\n", rate);
+	snd_iprintf(buffer, "Rate transition: %u msec (max %u msec)\n",
+		    bebob->transition_ms, bebob->max_transition_ms);
 
 	if (clk_spec) {
 		if (clk_spec->get(bebob, &id) >= 0)
@@ -154,6 +156,34 @@ proc_read_clock(struct snd_info_entry *entry,
 	}
 }
 
+static void
+proc_read_avc_cache(struct snd_info_entry *entry,
+		    struct snd_info_buffer *buffer)
+{
+	struct snd_bebob *bebob = entry->private_data;
+
+	snd_iprintf(buffer, "Hits:\t%lu\n", bebob->avc_cache.hits);
+	snd_iprintf(buffer, "Misses:\t%lu\n", bebob->avc_cache.misses);
+}
+
+static void
+proc_read_bandwidth(struct snd_info_entry *entry,
+		    struct snd_info_buffer *buffer)
+{
+	struct snd_bebob *bebob = entry->private_data;
+
+	fw_iso_resources_dump_plan(bebob->unit, buffer);
+}
+
+static void
+proc_read_transactions(struct snd_info_entry *entry,
+		       struct snd_info_buffer *buffer)
+{
+	struct snd_bebob *bebob = entry->private_data;
+
+	snd_fw_transaction_stats_dump(&bebob->transaction_stats, buffer);
+}
+
 static void
 add_node(struct snd_bebob *bebob, struct snd_info_entry *root, const char *name,
 	 void (*op)(struct snd_info_entry *e, struct snd_info_buffer *b))
@@ -187,9 +217,12 @@ void snd_bebob_proc_init(struct snd_bebob *bebob)
 		return;
 	}
 
+	add_node(bebob, root, "avc_cache", proc_read_avc_cache);
+	add_node(bebob, root, "bandwidth", proc_read_bandwidth);
 	add_node(bebob, root, "clock", proc_read_clock);
 	add_node(bebob, root, "firmware", proc_read_hw_info);
 	add_node(bebob, root, "formation", proc_read_formation);
+	add_node(bebob, root, "transactions", proc_read_transactions);
 
 	if (bebob->spec->meter != NULL)
 		add_node(bebob, root, "meter", proc_read_meters);
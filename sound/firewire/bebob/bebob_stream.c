@@ -92,9 +92,39 @@ end:
 	return err;
 }
 
+struct rate_transition {
+	struct snd_bebob *bebob;
+	unsigned int rate;
+};
+
+static int
+check_rate(void *private_data)
+{
+	struct rate_transition *t = private_data;
+	enum avc_general_plug_dir dir;
+	unsigned int rate;
+	int err;
+
+	for (dir = 0; dir < AVC_GENERAL_PLUG_DIR_COUNT; dir++) {
+		err = avc_general_poll_sig_fmt(t->bebob->unit, &rate, dir, 0);
+		if (err == -EAGAIN)
+			return 0;
+		if (err < 0)
+			return err;
+		if (rate != t->rate)
+			return 0;
+	}
+
+	return 1;
+}
+
 int
 snd_bebob_stream_set_rate(struct snd_bebob *bebob, unsigned int rate)
 {
+	struct rate_transition t = {
+		.bebob = bebob,
+		.rate = rate,
+	};
 	int err;
 
 	err = avc_general_set_sig_fmt(bebob->unit, rate,
@@ -109,9 +139,17 @@ snd_bebob_stream_set_rate(struct snd_bebob *bebob, unsigned int rate)
 
 	/*
 	 * Some devices need a bit time for transition.
-	 * 300msec is got by some experiments.
+	 * 300msec is got by some experiments, thus it's the ceiling.
 	 */
-	msleep(300);
+	err = snd_fw_wait_transition(check_rate, &t, 300,
+				     &bebob->transition_ms);
+	if (err < 0)
+		dev_dbg(&bebob->unit->device,
+			"no report of the transition to %d: %d\n", rate, err);
+	err = 0;
+
+	bebob->max_transition_ms = max(bebob->max_transition_ms,
+				       bebob->transition_ms);
 end:
 	return err;
 }
@@ -321,13 +359,13 @@ init_both_connections(struct snd_bebob *bebob)
 {
 	int err;
 
-	err = cmp_connection_init(&bebob->in_conn,
-				  bebob->unit, CMP_INPUT, 0);
+	err = cmp_connection_init(&bebob->in_conn, bebob->unit,
+				  &bebob->transaction_stats, CMP_INPUT, 0);
 	if (err < 0)
 		goto end;
 
-	err = cmp_connection_init(&bebob->out_conn,
-				  bebob->unit, CMP_OUTPUT, 0);
+	err = cmp_connection_init(&bebob->out_conn, bebob->unit,
+				  &bebob->transaction_stats, CMP_OUTPUT, 0);
 	if (err < 0)
 		cmp_connection_destroy(&bebob->in_conn);
 end:
@@ -358,6 +396,31 @@ check_connection_used_by_others(struct snd_bebob *bebob, struct amdtp_stream *s)
 	return err;
 }
 
+/*
+ * The streams are checked together against the bandwidth left on the bus,
+ * thus the second connection can not fail for bandwidth after the first one.
+ */
+static int
+check_bandwidth(struct snd_bebob *bebob, unsigned int rate)
+{
+	struct fw_iso_resources *resources[2] = {
+		&bebob->out_conn.resources,
+		&bebob->in_conn.resources,
+	};
+	unsigned int max_payload_bytes[2] = {
+		amdtp_stream_get_max_payload(&bebob->tx_stream),
+		amdtp_stream_get_max_payload(&bebob->rx_stream),
+	};
+	int err;
+
+	err = fw_iso_resources_check(resources, max_payload_bytes, 2,
+				     fw_parent_device(bebob->unit)->max_speed);
+	if (err < 0)
+		dev_err(&bebob->unit->device,
+			"no bandwidth for the streams at %u Hz\n", rate);
+	return err;
+}
+
 static int
 make_both_connections(struct snd_bebob *bebob, unsigned int rate)
 {
@@ -377,6 +440,10 @@ make_both_connections(struct snd_bebob *bebob, unsigned int rate)
 	amdtp_stream_set_parameters(&bebob->rx_stream,
 				    rate, pcm_channels, midi_channels * 8);
 
+	err = check_bandwidth(bebob, rate);
+	if (err < 0)
+		goto end;
+
 	/* establish connections for both streams */
 	err = cmp_connection_establish(&bebob->out_conn,
 			amdtp_stream_get_max_payload(&bebob->tx_stream));
@@ -407,6 +474,16 @@ break_both_connections(struct snd_bebob *bebob)
 		msleep(200);
 }
 
+/* The connections are kept for a while to be reused by next start. */
+static void
+release_both_connections(struct snd_bebob *bebob)
+{
+	cmp_connection_release(&bebob->in_conn);
+	cmp_connection_release(&bebob->out_conn);
+
+	bebob->connected = false;
+}
+
 static void
 destroy_both_connections(struct snd_bebob *bebob)
 {
@@ -494,6 +571,7 @@ int snd_bebob_stream_start_duplex(struct snd_bebob *bebob, unsigned int rate)
 	enum cip_flags sync_mode;
 	unsigned int curr_rate;
 	bool updated = false;
+	bool reclaimed;
 	int err = 0;
 
 	/*
@@ -550,7 +628,7 @@ int snd_bebob_stream_start_duplex(struct snd_bebob *bebob, unsigned int rate)
 		amdtp_stream_stop(master);
 	if (amdtp_streaming_error(slave))
 		amdtp_stream_stop(slave);
-	if (!updated &&
+	if (!updated && bebob->connected &&
 	    !amdtp_stream_running(master) && !amdtp_stream_running(slave))
 		break_both_connections(bebob);
 
@@ -574,6 +652,13 @@ int snd_bebob_stream_start_duplex(struct snd_bebob *bebob, unsigned int rate)
 		amdtp_stream_set_sync(sync_mode, master, slave);
 		bebob->master = master;
 
+		/*
+		 * Connections released at last stop still keep the device at
+		 * the same rate. Then it is not needed to set it again.
+		 */
+		reclaimed = cmp_connection_reclaim(&bebob->out_conn);
+		reclaimed &= cmp_connection_reclaim(&bebob->in_conn);
+
 		/*
 		 * NOTE:
 		 * If establishing connections at first, Yamaha GO46
@@ -581,12 +666,13 @@ int snd_bebob_stream_start_duplex(struct snd_bebob *bebob, unsigned int rate)
 		 *
 		 * For firmware customized by M-Audio, refer to next NOTE.
 		 */
-		if (bebob->maudio_special_quirk == NULL) {
+		if (bebob->maudio_special_quirk == NULL && !reclaimed) {
 			err = rate_spec->set(bebob, rate);
 			if (err < 0) {
 				dev_err(&bebob->unit->device,
 					"fail to set sampling rate: %d\n",
 					err);
+				break_both_connections(bebob);
 				goto end;
 			}
 		}
@@ -679,7 +765,12 @@ void snd_bebob_stream_stop_duplex(struct snd_bebob *bebob)
 		if (atomic_read(master_substreams) == 0) {
 			amdtp_stream_pcm_abort(master);
 			amdtp_stream_stop(master);
-			break_both_connections(bebob);
+
+			/* These models need the transition at next start. */
+			if (bebob->maudio_special_quirk != NULL)
+				break_both_connections(bebob);
+			else
+				release_both_connections(bebob);
 		}
 	}
 
@@ -801,13 +892,15 @@ static int
 fill_stream_formations(struct snd_bebob *bebob, enum avc_bridgeco_plug_dir dir,
 		       unsigned short pid)
 {
-	u8 *buf;
+	u8 *buf, *bufs[SND_BEBOB_STRM_FMT_ENTRIES];
+	unsigned int lens[SND_BEBOB_STRM_FMT_ENTRIES];
 	struct snd_bebob_stream_formation *formations;
-	unsigned int len, eid;
+	unsigned int count, eid;
 	u8 addr[AVC_BRIDGECO_ADDR_BYTES];
 	int err;
 
-	buf = kmalloc(FORMAT_MAXIMUM_LENGTH, GFP_KERNEL);
+	buf = kmalloc_array(SND_BEBOB_STRM_FMT_ENTRIES, FORMAT_MAXIMUM_LENGTH,
+			    GFP_KERNEL);
 	if (buf == NULL)
 		return -ENOMEM;
 
@@ -817,84 +910,196 @@ fill_stream_formations(struct snd_bebob *bebob, enum avc_bridgeco_plug_dir dir,
 		formations = bebob->tx_stream_formations;
 
 	for (eid = 0; eid < SND_BEBOB_STRM_FMT_ENTRIES; eid++) {
-		len = FORMAT_MAXIMUM_LENGTH;
-		avc_bridgeco_fill_unit_addr(addr, dir,
-					    AVC_BRIDGECO_PLUG_UNIT_ISOC, pid);
-		err = avc_bridgeco_get_plug_strm_fmt(bebob->unit, addr, buf,
-						     &len, eid);
-		/* No entries remained. */
-		if (err == -EINVAL && eid > 0) {
-			err = 0;
-			break;
-		} else if (err < 0) {
-			dev_err(&bebob->unit->device,
-			"fail to get stream format %d for isoc %s plug %d:%d\n",
-				eid,
-				(dir == AVC_BRIDGECO_PLUG_DIR_IN) ? "in" :
-								    "out",
-				pid, err);
-			break;
-		}
+		bufs[eid] = buf + eid * FORMAT_MAXIMUM_LENGTH;
+		lens[eid] = FORMAT_MAXIMUM_LENGTH;
+	}
 
-		err = parse_stream_formation(buf, len, formations);
+	/* Request all of entries at once. */
+	avc_bridgeco_fill_unit_addr(addr, dir,
+				    AVC_BRIDGECO_PLUG_UNIT_ISOC, pid);
+	err = avc_bridgeco_get_plug_strm_fmt_list(bebob->unit, addr, bufs, lens,
+						  SND_BEBOB_STRM_FMT_ENTRIES);
+	if (err < 0) {
+		dev_err(&bebob->unit->device,
+			"fail to get stream formats for isoc %s plug %d:%d\n",
+			(dir == AVC_BRIDGECO_PLUG_DIR_IN) ? "in" : "out",
+			pid, err);
+		goto end;
+	}
+	count = err;
+
+	for (eid = 0; eid < count; eid++) {
+		err = parse_stream_formation(bufs[eid], lens[eid], formations);
 		if (err < 0)
 			break;
 	}
-
+end:
 	kfree(buf);
 	return err;
 }
 
+/*
+ * The result of discovery is cached per GUID and firmware, so that rebinding
+ * the unit takes no AV/C commands.
+ */
+struct bebob_discovery {
+	struct snd_bebob_stream_formation
+		tx_stream_formations[SND_BEBOB_STRM_FMT_ENTRIES];
+	struct snd_bebob_stream_formation
+		rx_stream_formations[SND_BEBOB_STRM_FMT_ENTRIES];
+	unsigned int midi_input_ports;
+	unsigned int midi_output_ports;
+	int sync_input_plug;
+};
+
+static void
+save_discovery(struct snd_bebob *bebob, u64 firmware)
+{
+	struct bebob_discovery discovery;
+
+	memcpy(discovery.tx_stream_formations, bebob->tx_stream_formations,
+	       sizeof(discovery.tx_stream_formations));
+	memcpy(discovery.rx_stream_formations, bebob->rx_stream_formations,
+	       sizeof(discovery.rx_stream_formations));
+	discovery.midi_input_ports = bebob->midi_input_ports;
+	discovery.midi_output_ports = bebob->midi_output_ports;
+	discovery.sync_input_plug = bebob->sync_input_plug;
+
+	snd_fw_discovery_save(bebob->unit, firmware,
+			      &discovery, sizeof(discovery));
+}
+
+static bool
+load_discovery(struct snd_bebob *bebob, u64 firmware)
+{
+	struct bebob_discovery *discovery;
+	size_t size;
+
+	discovery = snd_fw_discovery_load(bebob->unit, firmware, &size);
+	if (discovery == NULL)
+		return false;
+	if (size != sizeof(*discovery)) {
+		kfree(discovery);
+		return false;
+	}
+
+	memcpy(bebob->tx_stream_formations, discovery->tx_stream_formations,
+	       sizeof(bebob->tx_stream_formations));
+	memcpy(bebob->rx_stream_formations, discovery->rx_stream_formations,
+	       sizeof(bebob->rx_stream_formations));
+	bebob->midi_input_ports = discovery->midi_input_ports;
+	bebob->midi_output_ports = discovery->midi_output_ports;
+	bebob->sync_input_plug = discovery->sync_input_plug;
+
+	kfree(discovery);
+	return true;
+}
+
 static int
-seek_msu_sync_input_plug(struct snd_bebob *bebob)
+discover_plugs(struct snd_bebob *bebob, u8 plugs[AVC_PLUG_INFO_BUF_BYTES],
+	       unsigned int msu_plugs)
 {
-	u8 plugs[AVC_PLUG_INFO_BUF_BYTES], addr[AVC_BRIDGECO_ADDR_BYTES];
-	unsigned int i;
-	enum avc_bridgeco_plug_type type;
+	struct snd_bebob_clock_spec *clk_spec = bebob->spec->clock;
+	u8 (*addrs)[AVC_BRIDGECO_ADDR_BYTES];
+	enum avc_bridgeco_plug_type *types;
+	unsigned int i, count, ext_in, ext_out, msu;
 	int err;
 
-	/* Get the number of Music Sub Unit for both direction. */
-	err = avc_general_get_plug_info(bebob->unit, 0x0c, 0x00, 0x00, plugs);
+	/* isoc in/out plug 0, ext in/out plugs and MSU in plugs */
+	ext_in = 2;
+	ext_out = ext_in + plugs[2];
+	msu = ext_out + plugs[3];
+	count = msu + msu_plugs;
+
+	addrs = kcalloc(count, sizeof(*addrs), GFP_KERNEL);
+	if (addrs == NULL)
+		return -ENOMEM;
+	types = kcalloc(count, sizeof(*types), GFP_KERNEL);
+	if (types == NULL) {
+		err = -ENOMEM;
+		goto end;
+	}
+
+	avc_bridgeco_fill_unit_addr(addrs[0], AVC_BRIDGECO_PLUG_DIR_IN,
+				    AVC_BRIDGECO_PLUG_UNIT_ISOC, 0);
+	avc_bridgeco_fill_unit_addr(addrs[1], AVC_BRIDGECO_PLUG_DIR_OUT,
+				    AVC_BRIDGECO_PLUG_UNIT_ISOC, 0);
+	for (i = 0; i < plugs[2]; i++)
+		avc_bridgeco_fill_unit_addr(addrs[ext_in + i],
+					    AVC_BRIDGECO_PLUG_DIR_IN,
+					    AVC_BRIDGECO_PLUG_UNIT_EXT, i);
+	for (i = 0; i < plugs[3]; i++)
+		avc_bridgeco_fill_unit_addr(addrs[ext_out + i],
+					    AVC_BRIDGECO_PLUG_DIR_OUT,
+					    AVC_BRIDGECO_PLUG_UNIT_EXT, i);
+	for (i = 0; i < msu_plugs; i++)
+		avc_bridgeco_fill_msu_addr(addrs[msu + i],
+					   AVC_BRIDGECO_PLUG_DIR_IN, i);
+
+	/* The types of all plugs are requested at once. */
+	err = avc_bridgeco_get_plug_types(bebob->unit, addrs, types, count);
 	if (err < 0) {
 		dev_err(&bebob->unit->device,
-			"fail to get info for MSU in/out plugs: %d\n",
-			err);
+			"fail to get types for plugs: %d\n", err);
 		goto end;
 	}
 
-	/* seek destination plugs for 'MSU sync input' */
-	bebob->sync_input_plug = -1;
-	for (i = 0; i < plugs[0]; i++) {
-		avc_bridgeco_fill_msu_addr(addr, AVC_BRIDGECO_PLUG_DIR_IN, i);
-		err = avc_bridgeco_get_plug_type(bebob->unit, addr, &type);
-		if (err < 0) {
-			dev_err(&bebob->unit->device,
-				"fail to get type for MSU in plug %d: %d\n",
-				i, err);
-			goto end;
-		}
+	if ((types[0] != AVC_BRIDGECO_PLUG_TYPE_ISOC) ||
+	    (types[1] != AVC_BRIDGECO_PLUG_TYPE_ISOC)) {
+		err = -ENOSYS;
+		goto end;
+	}
 
-		if (type == AVC_BRIDGECO_PLUG_TYPE_SYNC) {
-			bebob->sync_input_plug = i;
-			break;
+	/* count external plugs for MIDI */
+	bebob->midi_input_ports = 0;
+	for (i = 0; i < plugs[2]; i++) {
+		if (types[ext_in + i] == AVC_BRIDGECO_PLUG_TYPE_MIDI)
+			bebob->midi_input_ports++;
+	}
+	bebob->midi_output_ports = 0;
+	for (i = 0; i < plugs[3]; i++) {
+		if (types[ext_out + i] == AVC_BRIDGECO_PLUG_TYPE_MIDI)
+			bebob->midi_output_ports++;
+	}
+
+	/* seek destination plugs for 'MSU sync input' */
+	if (!clk_spec) {
+		bebob->sync_input_plug = -1;
+		for (i = 0; i < msu_plugs; i++) {
+			if (types[msu + i] == AVC_BRIDGECO_PLUG_TYPE_SYNC) {
+				bebob->sync_input_plug = i;
+				break;
+			}
 		}
 	}
 end:
+	kfree(types);
+	kfree(addrs);
 	return err;
 }
 
 int snd_bebob_stream_discover(struct snd_bebob *bebob)
 {
 	struct snd_bebob_clock_spec *clk_spec = bebob->spec->clock;
-	u8 plugs[AVC_PLUG_INFO_BUF_BYTES], addr[AVC_BRIDGECO_ADDR_BYTES];
-	enum avc_bridgeco_plug_type type;
-	unsigned int i;
+	struct device *dev = &bebob->unit->device;
+	u8 plugs[AVC_PLUG_INFO_BUF_BYTES], msu_plugs[AVC_PLUG_INFO_BUF_BYTES];
+	ktime_t stamp = ktime_get();
+	bool cacheable;
+	u64 firmware;
 	int err;
 
+	/* The build date of firmware identifies it. */
+	cacheable = snd_bebob_read_block(bebob->unit, INFO_OFFSET_SW_DATE,
+					 &firmware, sizeof(firmware)) >= 0;
+	if (cacheable && load_discovery(bebob, firmware)) {
+		snd_fw_trace_phase(dev, "discovery from cache", &stamp);
+		return 0;
+	}
+
 	/* the number of plugs for isoc in/out, ext in/out  */
 	err = avc_general_get_plug_info(bebob->unit, 0x1f, 0x07, 0x00, plugs);
 	if (err < 0) {
-		dev_err(&bebob->unit->device,
+		dev_err(dev,
 		"fail to get info for isoc/external in/out plugs: %d\n",
 			err);
 		goto end;
@@ -909,71 +1114,35 @@ int snd_bebob_stream_discover(struct snd_bebob *bebob)
 		goto end;
 	}
 
-	avc_bridgeco_fill_unit_addr(addr, AVC_BRIDGECO_PLUG_DIR_IN,
-				    AVC_BRIDGECO_PLUG_UNIT_ISOC, 0);
-	err = avc_bridgeco_get_plug_type(bebob->unit, addr, &type);
-	if (err < 0) {
-		dev_err(&bebob->unit->device,
-			"fail to get type for isoc in plug 0: %d\n", err);
-		goto end;
-	} else if (type != AVC_BRIDGECO_PLUG_TYPE_ISOC) {
-		err = -ENOSYS;
-		goto end;
+	/* Get the number of Music Sub Unit for check source of clock later. */
+	msu_plugs[0] = 0;
+	if (!clk_spec) {
+		err = avc_general_get_plug_info(bebob->unit, 0x0c, 0x00, 0x00,
+						msu_plugs);
+		if (err < 0) {
+			dev_err(dev,
+				"fail to get info for MSU in/out plugs: %d\n",
+				err);
+			goto end;
+		}
 	}
-	err = fill_stream_formations(bebob, AVC_BRIDGECO_PLUG_DIR_IN, 0);
+	snd_fw_trace_phase(dev, "plug info", &stamp);
+
+	err = discover_plugs(bebob, plugs, msu_plugs[0]);
 	if (err < 0)
 		goto end;
+	snd_fw_trace_phase(dev, "plug types", &stamp);
 
-	avc_bridgeco_fill_unit_addr(addr, AVC_BRIDGECO_PLUG_DIR_OUT,
-				    AVC_BRIDGECO_PLUG_UNIT_ISOC, 0);
-	err = avc_bridgeco_get_plug_type(bebob->unit, addr, &type);
-	if (err < 0) {
-		dev_err(&bebob->unit->device,
-			"fail to get type for isoc out plug 0: %d\n", err);
-		goto end;
-	} else if (type != AVC_BRIDGECO_PLUG_TYPE_ISOC) {
-		err = -ENOSYS;
+	err = fill_stream_formations(bebob, AVC_BRIDGECO_PLUG_DIR_IN, 0);
+	if (err < 0)
 		goto end;
-	}
 	err = fill_stream_formations(bebob, AVC_BRIDGECO_PLUG_DIR_OUT, 0);
 	if (err < 0)
 		goto end;
+	snd_fw_trace_phase(dev, "stream formations", &stamp);
 
-	/* count external input plugs for MIDI */
-	bebob->midi_input_ports = 0;
-	for (i = 0; i < plugs[2]; i++) {
-		avc_bridgeco_fill_unit_addr(addr, AVC_BRIDGECO_PLUG_DIR_IN,
-					    AVC_BRIDGECO_PLUG_UNIT_EXT, i);
-		err = avc_bridgeco_get_plug_type(bebob->unit, addr, &type);
-		if (err < 0) {
-			dev_err(&bebob->unit->device,
-			"fail to get type for external in plug %d: %d\n",
-				i, err);
-			goto end;
-		} else if (type == AVC_BRIDGECO_PLUG_TYPE_MIDI) {
-			bebob->midi_input_ports++;
-		}
-	}
-
-	/* count external output plugs for MIDI */
-	bebob->midi_output_ports = 0;
-	for (i = 0; i < plugs[3]; i++) {
-		avc_bridgeco_fill_unit_addr(addr, AVC_BRIDGECO_PLUG_DIR_OUT,
-					    AVC_BRIDGECO_PLUG_UNIT_EXT, i);
-		err = avc_bridgeco_get_plug_type(bebob->unit, addr, &type);
-		if (err < 0) {
-			dev_err(&bebob->unit->device,
-			"fail to get type for external out plug %d: %d\n",
-				i, err);
-			goto end;
-		} else if (type == AVC_BRIDGECO_PLUG_TYPE_MIDI) {
-			bebob->midi_output_ports++;
-		}
-	}
-
-	/* for check source of clock later */
-	if (!clk_spec)
-		err = seek_msu_sync_input_plug(bebob);
+	if (cacheable)
+		save_discovery(bebob, firmware);
 end:
 	return err;
 }
@@ -37,6 +37,11 @@
 #define OPCR_OVERHEAD_ID_MASK	0x00003C00
 #define OPCR_OVERHEAD_ID_SHIFT	10
 
+static unsigned int linger_ms;
+module_param(linger_ms, uint, 0644);
+MODULE_PARM_DESC(linger_ms,
+		 "milliseconds to keep released connections for reuse (0 = off)");
+
 enum bus_reset_handling {
 	ABORT_ON_BUS_RESET,
 	SUCCEED_ON_BUS_RESET,
@@ -83,8 +88,8 @@ static int pcr_modify(struct cmp_connection *c,
 		old_arg = buffer[0];
 		buffer[1] = modify(c, buffer[0]);
 
-		err = snd_fw_transaction(
-				c->resources.unit, TCODE_LOCK_COMPARE_SWAP,
+		err = snd_fw_transaction_counted(
+				c->stats, TCODE_LOCK_COMPARE_SWAP,
 				pcr_address(c), buffer, 8,
 				FW_FIXED_GENERATION | c->resources.generation);
 
@@ -109,16 +114,30 @@ static int pcr_modify(struct cmp_connection *c,
 	return 0;
 }
 
+static void connection_break(struct cmp_connection *c);
+
+static void linger_work(struct work_struct *work)
+{
+	struct cmp_connection *c =
+		container_of(work, struct cmp_connection, linger.work);
+
+	mutex_lock(&c->mutex);
+	if (c->lingering)
+		connection_break(c);
+	mutex_unlock(&c->mutex);
+}
 
 /**
  * cmp_connection_init - initializes a connection manager
  * @c: the connection manager to initialize
  * @unit: a unit of the target device
+ * @stats: the statistics of @unit, to count the requests to the plugs in
  * @direction: input or output
  * @pcr_index: the index of the iPCR/oPCR on the target device
  */
 int cmp_connection_init(struct cmp_connection *c,
 			struct fw_unit *unit,
+			struct snd_fw_transaction_stats *stats,
 			enum cmp_direction direction,
 			unsigned int pcr_index)
 {
@@ -126,9 +145,10 @@ int cmp_connection_init(struct cmp_connection *c,
 	u32 mpr;
 	int err;
 
+	c->stats = stats;
 	c->direction = direction;
-	err = snd_fw_transaction(unit, TCODE_READ_QUADLET_REQUEST,
-				 mpr_address(c), &mpr_be, 4, 0);
+	err = snd_fw_transaction_counted(stats, TCODE_READ_QUADLET_REQUEST,
+					 mpr_address(c), &mpr_be, 4, 0);
 	if (err < 0)
 		return err;
 	mpr = be32_to_cpu(mpr_be);
@@ -141,6 +161,8 @@ int cmp_connection_init(struct cmp_connection *c,
 		return err;
 
 	c->connected = false;
+	c->lingering = false;
+	INIT_DELAYED_WORK(&c->linger, linger_work);
 	mutex_init(&c->mutex);
 	c->last_pcr_value = cpu_to_be32(0x80000000);
 	c->pcr_index = pcr_index;
@@ -156,14 +178,26 @@ EXPORT_SYMBOL(cmp_connection_init);
  * cmp_connection_check_used - check connection is already esablished or not
  * @c: the connection manager to be checked
  * @used: the pointer to store the result of checking the connection
+ *
+ * A connection established by this manager, including a lingering one, is not
+ * reported as used.
  */
 int cmp_connection_check_used(struct cmp_connection *c, bool *used)
 {
 	__be32 pcr;
+	bool own;
 	int err;
 
-	err = snd_fw_transaction(
-			c->resources.unit, TCODE_READ_QUADLET_REQUEST,
+	mutex_lock(&c->mutex);
+	own = c->connected;
+	mutex_unlock(&c->mutex);
+	if (own) {
+		*used = false;
+		return 0;
+	}
+
+	err = snd_fw_transaction_counted(
+			c->stats, TCODE_READ_QUADLET_REQUEST,
 			pcr_address(c), &pcr, 4, 0);
 	if (err >= 0)
 		*used = !!(pcr & cpu_to_be32(PCR_BCAST_CONN |
@@ -179,6 +213,13 @@ EXPORT_SYMBOL(cmp_connection_check_used);
  */
 void cmp_connection_destroy(struct cmp_connection *c)
 {
+	cancel_delayed_work_sync(&c->linger);
+
+	mutex_lock(&c->mutex);
+	if (c->lingering)
+		connection_break(c);
+	mutex_unlock(&c->mutex);
+
 	WARN_ON(c->connected);
 	mutex_destroy(&c->mutex);
 	fw_iso_resources_destroy(&c->resources);
@@ -269,20 +310,36 @@ static int pcr_set_check(struct cmp_connection *c, __be32 pcr)
  * bandwidth) and setting the target's input/output plug control register.
  * When this function succeeds, the caller is responsible for starting
  * transmitting packets.
+ *
+ * A lingering connection is taken over as is when it was established for the
+ * same payload, otherwise it is broken before establishing new one.
  */
 int cmp_connection_establish(struct cmp_connection *c,
 			     unsigned int max_payload_bytes)
 {
 	int err;
 
-	if (WARN_ON(c->connected))
-		return -EISCONN;
+	cancel_delayed_work_sync(&c->linger);
+
+	mutex_lock(&c->mutex);
+
+	if (c->lingering) {
+		c->lingering = false;
+		if (c->max_payload_bytes == max_payload_bytes) {
+			mutex_unlock(&c->mutex);
+			return 0;
+		}
+		connection_break(c);
+	}
+
+	if (WARN_ON(c->connected)) {
+		err = -EISCONN;
+		goto err_mutex;
+	}
 
 	c->speed = min(c->max_speed,
 		       fw_parent_device(c->resources.unit)->max_speed);
 
-	mutex_lock(&c->mutex);
-
 retry_after_bus_reset:
 	err = fw_iso_resources_allocate(&c->resources,
 					max_payload_bytes, c->speed);
@@ -304,6 +361,7 @@ retry_after_bus_reset:
 		goto err_resources;
 
 	c->connected = true;
+	c->max_payload_bytes = max_payload_bytes;
 
 	mutex_unlock(&c->mutex);
 
@@ -361,6 +419,7 @@ err_resources:
 	fw_iso_resources_free(&c->resources);
 err_unconnect:
 	c->connected = false;
+	c->lingering = false;
 	mutex_unlock(&c->mutex);
 
 	return err;
@@ -372,6 +431,23 @@ static __be32 pcr_break_modify(struct cmp_connection *c, __be32 pcr)
 	return pcr & ~cpu_to_be32(PCR_BCAST_CONN | PCR_P2P_CONN_MASK);
 }
 
+static void connection_break(struct cmp_connection *c)
+{
+	int err;
+
+	if (!c->connected)
+		return;
+
+	err = pcr_modify(c, pcr_break_modify, NULL, SUCCEED_ON_BUS_RESET);
+	if (err < 0)
+		cmp_error(c, "plug is still connected\n");
+
+	fw_iso_resources_free(&c->resources);
+
+	c->connected = false;
+	c->lingering = false;
+}
+
 /**
  * cmp_connection_break - break the connection to the target
  * @c: the connection manager
@@ -382,23 +458,62 @@ static __be32 pcr_break_modify(struct cmp_connection *c, __be32 pcr)
  */
 void cmp_connection_break(struct cmp_connection *c)
 {
-	int err;
+	cancel_delayed_work_sync(&c->linger);
 
 	mutex_lock(&c->mutex);
+	connection_break(c);
+	mutex_unlock(&c->mutex);
+}
+EXPORT_SYMBOL(cmp_connection_break);
 
-	if (!c->connected) {
-		mutex_unlock(&c->mutex);
+/**
+ * cmp_connection_release - give back the connection which is not used anymore
+ * @c: the connection manager
+ *
+ * This function is an alternative of cmp_connection_break() for the case that
+ * the connection is likely to be established again soon. The connection and its
+ * isochronous resources are kept for 'linger_ms' module parameter, then broken
+ * unless cmp_connection_establish() takes them over. Before calling this
+ * function, the caller should cease transmitting packets.
+ */
+void cmp_connection_release(struct cmp_connection *c)
+{
+	unsigned int delay = READ_ONCE(linger_ms);
+
+	if (delay == 0) {
+		cmp_connection_break(c);
 		return;
 	}
 
-	err = pcr_modify(c, pcr_break_modify, NULL, SUCCEED_ON_BUS_RESET);
-	if (err < 0)
-		cmp_error(c, "plug is still connected\n");
+	mutex_lock(&c->mutex);
+	if (c->connected) {
+		c->lingering = true;
+		schedule_delayed_work(&c->linger, msecs_to_jiffies(delay));
+	}
+	mutex_unlock(&c->mutex);
+}
+EXPORT_SYMBOL(cmp_connection_release);
 
-	fw_iso_resources_free(&c->resources);
+/**
+ * cmp_connection_reclaim - hold the released connection for reuse
+ * @c: the connection manager
+ *
+ * Returns true when the connection is lingering. Then it is not broken by
+ * timeout and the target still has the configuration at the last
+ * establishment, thus the caller can skip reconfiguration of the target which
+ * is required for a new connection. The caller must call
+ * cmp_connection_establish() or cmp_connection_break() later.
+ */
+bool cmp_connection_reclaim(struct cmp_connection *c)
+{
+	bool lingering;
 
-	c->connected = false;
+	cancel_delayed_work_sync(&c->linger);
 
+	mutex_lock(&c->mutex);
+	lingering = c->lingering;
 	mutex_unlock(&c->mutex);
+
+	return lingering;
 }
-EXPORT_SYMBOL(cmp_connection_break);
+EXPORT_SYMBOL(cmp_connection_reclaim);
@@ -3,9 +3,11 @@
 
 #include <linux/mutex.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 #include "iso-resources.h"
 
 struct fw_unit;
+struct snd_fw_transaction_stats;
 
 enum cmp_direction {
 	CMP_INPUT = 0,
@@ -21,13 +23,21 @@ enum cmp_direction {
  *
  * There is no corresponding oPCR created on the local computer, so it is not
  * possible to overlay connections on top of this one.
+ *
+ * A connection given back by cmp_connection_release() lingers for a while so
+ * that the next cmp_connection_establish() with the same payload can reuse it
+ * without any bus transaction.
  */
 struct cmp_connection {
 	int speed;
 	/* private: */
 	bool connected;
+	bool lingering;
+	struct delayed_work linger;
+	unsigned int max_payload_bytes;
 	struct mutex mutex;
 	struct fw_iso_resources resources;
+	struct snd_fw_transaction_stats *stats;
 	__be32 last_pcr_value;
 	unsigned int pcr_index;
 	unsigned int max_speed;
@@ -36,6 +46,7 @@ struct cmp_connection {
 
 int cmp_connection_init(struct cmp_connection *connection,
 			struct fw_unit *unit,
+			struct snd_fw_transaction_stats *stats,
 			enum cmp_direction direction,
 			unsigned int pcr_index);
 int cmp_connection_check_used(struct cmp_connection *connection, bool *used);
@@ -45,5 +56,7 @@ int cmp_connection_establish(struct cmp_connection *connection,
 			     unsigned int max_payload);
 int cmp_connection_update(struct cmp_connection *connection);
 void cmp_connection_break(struct cmp_connection *connection);
+void cmp_connection_release(struct cmp_connection *connection);
+bool cmp_connection_reclaim(struct cmp_connection *connection);
 
 #endif
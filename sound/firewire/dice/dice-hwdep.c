@@ -15,10 +15,12 @@ static long hwdep_read(struct snd_hwdep *hwdep, char __user *buf,
 	struct snd_dice *dice = hwdep->private_data;
 	DEFINE_WAIT(wait);
 	union snd_firewire_event event;
+	struct snd_dice_notification *n;
 
 	spin_lock_irq(&dice->lock);
 
-	while (!dice->dev_lock_changed && dice->notification_bits == 0) {
+	while (!dice->dev_lock_changed &&
+	       dice->notification_head == dice->notification_tail) {
 		prepare_to_wait(&dice->hwdep_wait, &wait, TASK_INTERRUPTIBLE);
 		spin_unlock_irq(&dice->lock);
 		schedule();
@@ -36,10 +38,15 @@ static long hwdep_read(struct snd_hwdep *hwdep, char __user *buf,
 
 		count = min_t(long, count, sizeof(event.lock_status));
 	} else {
+		n = &dice->notifications[dice->notification_tail++ %
+						SND_DICE_NOTIFICATIONS];
 		event.dice_notification.type =
 					SNDRV_FIREWIRE_EVENT_DICE_NOTIFICATION;
-		event.dice_notification.notification = dice->notification_bits;
-		dice->notification_bits = 0;
+		event.dice_notification.notification = n->bits;
+		event.dice_notification.generation = n->generation;
+		event.dice_notification.dropped = dice->notifications_dropped;
+		event.dice_notification.timestamp = n->timestamp;
+		dice->notifications_dropped = 0;
 
 		count = min_t(long, count, sizeof(event.dice_notification));
 	}
@@ -61,7 +68,8 @@ static unsigned int hwdep_poll(struct snd_hwdep *hwdep, struct file *file,
 	poll_wait(file, &dice->hwdep_wait, wait);
 
 	spin_lock_irq(&dice->lock);
-	if (dice->dev_lock_changed || dice->notification_bits != 0)
+	if (dice->dev_lock_changed ||
+	    dice->notification_head != dice->notification_tail)
 		events = POLLIN | POLLRDNORM;
 	else
 		events = 0;
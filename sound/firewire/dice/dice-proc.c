@@ -10,14 +10,21 @@
 #include "dice.h"
 
 static int dice_proc_read_mem(struct snd_dice *dice, void *buffer,
+			      enum snd_dice_addr_type type,
 			      unsigned int offset_q, unsigned int quadlets)
 {
 	unsigned int i;
 	int err;
 
-	err = snd_fw_transaction(dice->unit, TCODE_READ_BLOCK_REQUEST,
-				 DICE_PRIVATE_SPACE + 4 * offset_q,
-				 buffer, 4 * quadlets, 0);
+	if (type == SND_DICE_ADDR_TYPE_PRIVATE)
+		err = snd_fw_transaction_counted(&dice->transaction_stats,
+					TCODE_READ_BLOCK_REQUEST,
+					DICE_PRIVATE_SPACE + 4 * offset_q,
+					buffer, 4 * quadlets, 0);
+	else
+		err = snd_dice_transaction_read_cached(dice, type,
+						       4 * offset_q,
+						       buffer, 4 * quadlets);
 	if (err < 0)
 		return err;
 
@@ -115,7 +122,14 @@ static void dice_proc_read(struct snd_info_entry *entry,
 	} buf;
 	unsigned int quadlets, stream, i;
 
-	if (dice_proc_read_mem(dice, sections, 0, ARRAY_SIZE(sections)) < 0)
+	/*
+	 * Show the current state of the device. Each section is read at once
+	 * into its shadow, and the streams are then taken from there.
+	 */
+	snd_dice_transaction_invalidate_all(dice);
+
+	if (dice_proc_read_mem(dice, sections, SND_DICE_ADDR_TYPE_PRIVATE,
+			       0, ARRAY_SIZE(sections)) < 0)
 		return;
 	snd_iprintf(buffer, "sections:\n");
 	for (i = 0; i < ARRAY_SIZE(section_names); ++i)
@@ -124,7 +138,8 @@ static void dice_proc_read(struct snd_info_entry *entry,
 			    sections[i * 2], sections[i * 2 + 1]);
 
 	quadlets = min_t(u32, sections[1], sizeof(buf.global) / 4);
-	if (dice_proc_read_mem(dice, &buf.global, sections[0], quadlets) < 0)
+	if (dice_proc_read_mem(dice, &buf.global, SND_DICE_ADDR_TYPE_GLOBAL,
+			       0, quadlets) < 0)
 		return;
 	snd_iprintf(buffer, "global:\n");
 	snd_iprintf(buffer, "  owner: %04x:%04x%08x\n",
@@ -168,12 +183,13 @@ static void dice_proc_read(struct snd_info_entry *entry,
 			    buf.global.clock_source_names);
 	}
 
-	if (dice_proc_read_mem(dice, &tx_rx_header, sections[2], 2) < 0)
+	if (dice_proc_read_mem(dice, &tx_rx_header, SND_DICE_ADDR_TYPE_TX,
+			       0, 2) < 0)
 		return;
 	quadlets = min_t(u32, tx_rx_header.size, sizeof(buf.tx) / 4);
 	for (stream = 0; stream < tx_rx_header.number; ++stream) {
-		if (dice_proc_read_mem(dice, &buf.tx, sections[2] + 2 +
-				       stream * tx_rx_header.size,
+		if (dice_proc_read_mem(dice, &buf.tx, SND_DICE_ADDR_TYPE_TX,
+				       2 + stream * tx_rx_header.size,
 				       quadlets) < 0)
 			break;
 		snd_iprintf(buffer, "tx %u:\n", stream);
@@ -194,12 +210,13 @@ static void dice_proc_read(struct snd_info_entry *entry,
 		}
 	}
 
-	if (dice_proc_read_mem(dice, &tx_rx_header, sections[4], 2) < 0)
+	if (dice_proc_read_mem(dice, &tx_rx_header, SND_DICE_ADDR_TYPE_RX,
+			       0, 2) < 0)
 		return;
 	quadlets = min_t(u32, tx_rx_header.size, sizeof(buf.rx) / 4);
 	for (stream = 0; stream < tx_rx_header.number; ++stream) {
-		if (dice_proc_read_mem(dice, &buf.rx, sections[4] + 2 +
-				       stream * tx_rx_header.size,
+		if (dice_proc_read_mem(dice, &buf.rx, SND_DICE_ADDR_TYPE_RX,
+				       2 + stream * tx_rx_header.size,
 				       quadlets) < 0)
 			break;
 		snd_iprintf(buffer, "rx %u:\n", stream);
@@ -223,7 +240,7 @@ static void dice_proc_read(struct snd_info_entry *entry,
 	quadlets = min_t(u32, sections[7], sizeof(buf.ext_sync) / 4);
 	if (quadlets >= 4) {
 		if (dice_proc_read_mem(dice, &buf.ext_sync,
-				       sections[6], 4) < 0)
+				       SND_DICE_ADDR_TYPE_SYNC, 0, 4) < 0)
 			return;
 		snd_iprintf(buffer, "ext status:\n");
 		snd_iprintf(buffer, "  clock source: %s\n",
@@ -243,10 +260,31 @@ static void dice_proc_read(struct snd_info_entry *entry,
 	}
 }
 
+static void dice_proc_read_bandwidth(struct snd_info_entry *entry,
+				     struct snd_info_buffer *buffer)
+{
+	struct snd_dice *dice = entry->private_data;
+
+	fw_iso_resources_dump_plan(dice->unit, buffer);
+}
+
+static void dice_proc_read_transactions(struct snd_info_entry *entry,
+					struct snd_info_buffer *buffer)
+{
+	struct snd_dice *dice = entry->private_data;
+
+	snd_fw_transaction_stats_dump(&dice->transaction_stats, buffer);
+}
+
 void snd_dice_create_proc(struct snd_dice *dice)
 {
 	struct snd_info_entry *entry;
 
 	if (!snd_card_proc_new(dice->card, "dice", &entry))
 		snd_info_set_text_ops(entry, dice, dice_proc_read);
+	if (!snd_card_proc_new(dice->card, "bandwidth", &entry))
+		snd_info_set_text_ops(entry, dice, dice_proc_read_bandwidth);
+	if (!snd_card_proc_new(dice->card, "transactions", &entry))
+		snd_info_set_text_ops(entry, dice,
+				      dice_proc_read_transactions);
 }
@@ -42,78 +42,162 @@ int snd_dice_stream_get_rate_mode(struct snd_dice *dice, unsigned int rate,
 }
 
 static void release_resources(struct snd_dice *dice,
-			      struct fw_iso_resources *resources)
+			      enum amdtp_stream_direction dir,
+			      unsigned int index)
 {
-	unsigned int channel;
+	__be32 channel;
 
 	/* Reset channel number */
 	channel = cpu_to_be32((u32)-1);
-	if (resources == &dice->tx_resources)
-		snd_dice_transaction_write_tx(dice, TX_ISOCHRONOUS,
+	if (dir == AMDTP_IN_STREAM) {
+		snd_dice_transaction_write_tx(dice, TX_ISOCHRONOUS +
+					      index * dice->tx_stream_size,
 					      &channel, 4);
-	else
-		snd_dice_transaction_write_rx(dice, RX_ISOCHRONOUS,
+		fw_iso_resources_free(&dice->tx_resources[index]);
+	} else {
+		snd_dice_transaction_write_rx(dice, RX_ISOCHRONOUS +
+					      index * dice->rx_stream_size,
 					      &channel, 4);
+		fw_iso_resources_free(&dice->rx_resources[index]);
+	}
+}
+
+static void release_all_resources(struct snd_dice *dice)
+{
+	unsigned int i;
+
+	for (i = 0; i < dice->tx_streams; i++)
+		release_resources(dice, AMDTP_IN_STREAM, i);
+	for (i = 0; i < dice->rx_streams; i++)
+		release_resources(dice, AMDTP_OUT_STREAM, i);
+}
+
+static unsigned int collect_resources(struct snd_dice *dice,
+				      struct fw_iso_resources **resources,
+				      unsigned int *max_payload_bytes)
+{
+	unsigned int i, count;
+
+	count = 0;
+	for (i = 0; i < dice->tx_streams; i++) {
+		resources[count] = &dice->tx_resources[i];
+		max_payload_bytes[count++] =
+			amdtp_stream_get_max_payload(&dice->tx_stream[i]);
+	}
+	for (i = 0; i < dice->rx_streams; i++) {
+		resources[count] = &dice->rx_resources[i];
+		max_payload_bytes[count++] =
+			amdtp_stream_get_max_payload(&dice->rx_stream[i]);
+	}
 
-	fw_iso_resources_free(resources);
+	return count;
 }
 
-static int keep_resources(struct snd_dice *dice,
-			  struct fw_iso_resources *resources,
-			  unsigned int max_payload_bytes)
+/*
+ * The streams are checked together against the bandwidth left on the bus
+ * before the rate is changed, thus the device is not left at a rate which
+ * its streams can not be started at.
+ */
+static int check_bandwidth(struct snd_dice *dice, unsigned int rate)
 {
-	unsigned int channel;
+	struct fw_iso_resources *resources[SND_DICE_MAX_STREAMS * 2];
+	unsigned int max_payload_bytes[SND_DICE_MAX_STREAMS * 2];
+	unsigned int count;
 	int err;
 
-	err = fw_iso_resources_allocate(resources, max_payload_bytes,
-				fw_parent_device(dice->unit)->max_speed);
+	count = collect_resources(dice, resources, max_payload_bytes);
+	err = fw_iso_resources_check(resources, max_payload_bytes, count,
+				     fw_parent_device(dice->unit)->max_speed);
+	if (err < 0)
+		dev_err(&dice->unit->device,
+			"no bandwidth for the streams at %u Hz\n", rate);
+	return err;
+}
+
+static int keep_resources(struct snd_dice *dice)
+{
+	struct fw_iso_resources *resources[SND_DICE_MAX_STREAMS * 2];
+	unsigned int max_payload_bytes[SND_DICE_MAX_STREAMS * 2];
+	unsigned int i, count;
+	__be32 channel;
+	int err;
+
+	count = collect_resources(dice, resources, max_payload_bytes);
+
+	/* All streams at once, or none of them. */
+	err = fw_iso_resources_allocate_batch(resources, max_payload_bytes,
+				count, fw_parent_device(dice->unit)->max_speed);
 	if (err < 0)
 		goto end;
 
-	/* Set channel number */
-	channel = cpu_to_be32(resources->channel);
-	if (resources == &dice->tx_resources)
-		err = snd_dice_transaction_write_tx(dice, TX_ISOCHRONOUS,
+	/* Set channel numbers */
+	for (i = 0; i < dice->tx_streams; i++) {
+		channel = cpu_to_be32(dice->tx_resources[i].channel);
+		err = snd_dice_transaction_write_tx(dice, TX_ISOCHRONOUS +
+						    i * dice->tx_stream_size,
 						    &channel, 4);
-	else
-		err = snd_dice_transaction_write_rx(dice, RX_ISOCHRONOUS,
+		if (err < 0)
+			goto error;
+	}
+	for (i = 0; i < dice->rx_streams; i++) {
+		channel = cpu_to_be32(dice->rx_resources[i].channel);
+		err = snd_dice_transaction_write_rx(dice, RX_ISOCHRONOUS +
+						    i * dice->rx_stream_size,
 						    &channel, 4);
-	if (err < 0)
-		release_resources(dice, resources);
+		if (err < 0)
+			goto error;
+	}
 end:
 	return err;
+error:
+	release_all_resources(dice);
+	return err;
 }
 
-static void stop_stream(struct snd_dice *dice, struct amdtp_stream *stream)
+/* The first stream drives the others, thus it is stopped at first. */
+static void halt_streams(struct snd_dice *dice,
+			 enum amdtp_stream_direction dir)
 {
-	amdtp_stream_pcm_abort(stream);
-	amdtp_stream_stop(stream);
+	struct amdtp_stream *streams;
+	unsigned int i, count;
+
+	if (dir == AMDTP_IN_STREAM) {
+		streams = dice->tx_stream;
+		count = dice->tx_streams;
+	} else {
+		streams = dice->rx_stream;
+		count = dice->rx_streams;
+	}
 
-	if (stream == &dice->tx_stream)
-		release_resources(dice, &dice->tx_resources);
-	else
-		release_resources(dice, &dice->rx_resources);
+	for (i = 0; i < count; i++) {
+		amdtp_stream_pcm_abort(&streams[i]);
+		amdtp_stream_stop(&streams[i]);
+	}
 }
 
-static int start_stream(struct snd_dice *dice, struct amdtp_stream *stream,
-			unsigned int rate)
+static void stop_streams(struct snd_dice *dice,
+			 enum amdtp_stream_direction dir)
 {
-	struct fw_iso_resources *resources;
-	unsigned int i, mode, pcm_chs, midi_ports;
-	int err;
+	unsigned int i, count;
 
-	err = snd_dice_stream_get_rate_mode(dice, rate, &mode);
-	if (err < 0)
-		goto end;
-	if (stream == &dice->tx_stream) {
-		resources = &dice->tx_resources;
-		pcm_chs = dice->tx_channels[mode];
-		midi_ports = dice->tx_midi_ports[mode];
-	} else {
-		resources = &dice->rx_resources;
-		pcm_chs = dice->rx_channels[mode];
-		midi_ports = dice->rx_midi_ports[mode];
-	}
+	halt_streams(dice, dir);
+
+	count = (dir == AMDTP_IN_STREAM) ? dice->tx_streams : dice->rx_streams;
+	for (i = 0; i < count; i++)
+		release_resources(dice, dir, i);
+}
+
+static void stop_all_streams(struct snd_dice *dice)
+{
+	stop_streams(dice, AMDTP_IN_STREAM);
+	stop_streams(dice, AMDTP_OUT_STREAM);
+}
+
+static void set_stream_parameters(struct amdtp_stream *stream,
+				  unsigned int mode, unsigned int rate,
+				  unsigned int pcm_chs, unsigned int midi_ports)
+{
+	unsigned int i;
 
 	/*
 	 * At 176.4/192.0 kHz, Dice has a quirk to transfer two PCM frames in
@@ -142,24 +226,92 @@ static int start_stream(struct snd_dice *dice, struct amdtp_stream *stream,
 			stream->pcm_positions[i + pcm_chs] = i * 2 + 1;
 		}
 	}
+}
 
-	err = keep_resources(dice, resources,
-			     amdtp_stream_get_max_payload(stream));
-	if (err < 0) {
-		dev_err(&dice->unit->device,
-			"fail to keep isochronous resources\n");
-		goto end;
+/*
+ * The streams in one direction carry one PCM substream, each of them the
+ * next channels in the PCM frames.
+ */
+static void set_streams_parameters(struct snd_dice *dice,
+				   enum amdtp_stream_direction dir,
+				   unsigned int mode, unsigned int rate)
+{
+	struct amdtp_stream *streams;
+	unsigned int i, count, *pcm_chs, *midi_ports;
+
+	if (dir == AMDTP_IN_STREAM) {
+		streams = dice->tx_stream;
+		count = dice->tx_streams;
+		pcm_chs = dice->tx_stream_channels[mode];
+		midi_ports = dice->tx_stream_midi_ports[mode];
+	} else {
+		streams = dice->rx_stream;
+		count = dice->rx_streams;
+		pcm_chs = dice->rx_stream_channels[mode];
+		midi_ports = dice->rx_stream_midi_ports[mode];
+	}
+
+	for (i = 0; i < count; i++) {
+		set_stream_parameters(&streams[i], mode, rate,
+				      pcm_chs[i], midi_ports[i]);
+		if (i > 0)
+			amdtp_stream_set_follower(&streams[i - 1],
+						  &streams[i]);
+	}
+	/* The group ends here, even if it had more streams at another rate. */
+	if (count > 0)
+		amdtp_stream_set_follower(&streams[count - 1], NULL);
+}
+
+/* The followers are started before the first stream, which drives them. */
+static int start_streams(struct snd_dice *dice,
+			 enum amdtp_stream_direction dir)
+{
+	struct amdtp_stream *streams;
+	struct fw_iso_resources *resources;
+	unsigned int i;
+	int err = 0;
+
+	if (dir == AMDTP_IN_STREAM) {
+		streams = dice->tx_stream;
+		resources = dice->tx_resources;
+		i = dice->tx_streams;
+	} else {
+		streams = dice->rx_stream;
+		resources = dice->rx_resources;
+		i = dice->rx_streams;
+	}
+
+	while (i-- > 0) {
+		err = amdtp_stream_start(&streams[i], resources[i].channel,
+				fw_parent_device(dice->unit)->max_speed);
+		if (err < 0)
+			break;
 	}
 
-	err = amdtp_stream_start(stream, resources->channel,
-				 fw_parent_device(dice->unit)->max_speed);
-	if (err < 0)
-		release_resources(dice, resources);
-end:
 	return err;
 }
 
-static int get_sync_mode(struct snd_dice *dice, enum cip_flags *sync_mode)
+static bool wait_first_callbacks(struct snd_dice *dice)
+{
+	unsigned int i;
+
+	for (i = 0; i < dice->tx_streams; i++) {
+		if (!amdtp_stream_wait_callback(&dice->tx_stream[i],
+						CALLBACK_TIMEOUT))
+			return false;
+	}
+	for (i = 0; i < dice->rx_streams; i++) {
+		if (!amdtp_stream_wait_callback(&dice->rx_stream[i],
+						CALLBACK_TIMEOUT))
+			return false;
+	}
+
+	return true;
+}
+
+static int get_sync_mode(struct snd_dice *dice, unsigned int mode,
+			 enum cip_flags *sync_mode)
 {
 	u32 source;
 	int err;
@@ -169,14 +321,19 @@ static int get_sync_mode(struct snd_dice *dice, enum cip_flags *sync_mode)
 		goto end;
 
 	switch (source) {
-	/* So-called 'SYT Match' modes, sync_to_syt value of packets received */
+	/*
+	 * So-called 'SYT Match' modes, sync_to_syt value of packets received.
+	 * The first stream drives the others with the same timestamps, thus
+	 * the device can sync to any of them.
+	 */
 	case CLOCK_SOURCE_ARX4:	/* in 4th stream */
 	case CLOCK_SOURCE_ARX3:	/* in 3rd stream */
 	case CLOCK_SOURCE_ARX2:	/* in 2nd stream */
-		err = -ENOSYS;
-		break;
-	case CLOCK_SOURCE_ARX1:	/* in 1st stream, which this driver uses */
-		*sync_mode = 0;
+	case CLOCK_SOURCE_ARX1:	/* in 1st stream */
+		if (source - CLOCK_SOURCE_ARX1 >= dice->rx_stream_count[mode])
+			err = -ENOSYS;
+		else
+			*sync_mode = 0;
 		break;
 	default:
 		*sync_mode = CIP_SYNC_TO_DEVICE;
@@ -189,28 +346,15 @@ end:
 int snd_dice_stream_start_duplex(struct snd_dice *dice, unsigned int rate)
 {
 	struct amdtp_stream *master, *slave;
-	unsigned int curr_rate;
+	enum amdtp_stream_direction master_dir, slave_dir;
+	unsigned int curr_rate, curr_mode, mode, i;
 	enum cip_flags sync_mode;
+	bool error, keep;
 	int err = 0;
 
 	if (dice->substreams_counter == 0)
 		goto end;
 
-	err = get_sync_mode(dice, &sync_mode);
-	if (err < 0)
-		goto end;
-	if (sync_mode == CIP_SYNC_TO_DEVICE) {
-		master = &dice->tx_stream;
-		slave  = &dice->rx_stream;
-	} else {
-		master = &dice->rx_stream;
-		slave  = &dice->tx_stream;
-	}
-
-	/* Some packet queueing errors. */
-	if (amdtp_streaming_error(master) || amdtp_streaming_error(slave))
-		stop_stream(dice, master);
-
 	/* Stop stream if rate is different. */
 	err = snd_dice_transaction_get_rate(dice, &curr_rate);
 	if (err < 0) {
@@ -220,51 +364,111 @@ int snd_dice_stream_start_duplex(struct snd_dice *dice, unsigned int rate)
 	}
 	if (rate == 0)
 		rate = curr_rate;
-	if (rate != curr_rate)
-		stop_stream(dice, master);
+	err = snd_dice_stream_get_rate_mode(dice, rate, &mode);
+	if (err < 0)
+		goto end;
+
+	err = get_sync_mode(dice, mode, &sync_mode);
+	if (err < 0)
+		goto end;
+	if (sync_mode == CIP_SYNC_TO_DEVICE) {
+		master_dir = AMDTP_IN_STREAM;
+		master = &dice->tx_stream[0];
+		slave_dir = AMDTP_OUT_STREAM;
+		slave  = &dice->rx_stream[0];
+	} else {
+		master_dir = AMDTP_OUT_STREAM;
+		master = &dice->rx_stream[0];
+		slave_dir = AMDTP_IN_STREAM;
+		slave  = &dice->tx_stream[0];
+	}
+
+	/* Some packet queueing errors. */
+	error = false;
+	for (i = 0; i < dice->tx_streams; i++)
+		error |= amdtp_streaming_error(&dice->tx_stream[i]);
+	for (i = 0; i < dice->rx_streams; i++)
+		error |= amdtp_streaming_error(&dice->rx_stream[i]);
+
+	/*
+	 * Within one rate mode, the streams keep their formats and the size of
+	 * their packets. Thus a change of rate keeps the isochronous resources
+	 * and the channels in the registers, and only restarts the streams.
+	 */
+	keep = false;
+	if (!error && rate != curr_rate && amdtp_stream_running(master) &&
+	    snd_dice_stream_get_rate_mode(dice, curr_rate, &curr_mode) >= 0)
+		keep = curr_mode == mode;
+	if (keep) {
+		halt_streams(dice, AMDTP_IN_STREAM);
+		halt_streams(dice, AMDTP_OUT_STREAM);
+	} else if (error || rate != curr_rate) {
+		stop_streams(dice, master_dir);
+	}
 
 	if (!amdtp_stream_running(master)) {
-		stop_stream(dice, slave);
+		if (!keep)
+			stop_streams(dice, slave_dir);
 		snd_dice_transaction_clear_enable(dice);
 
 		amdtp_stream_set_sync(sync_mode, master, slave);
 
+		dice->tx_streams = dice->tx_stream_count[mode];
+		dice->rx_streams = dice->rx_stream_count[mode];
+		set_streams_parameters(dice, AMDTP_IN_STREAM, mode, rate);
+		set_streams_parameters(dice, AMDTP_OUT_STREAM, mode, rate);
+
+		if (!keep) {
+			err = check_bandwidth(dice, rate);
+			if (err < 0)
+				goto end;
+		}
+
 		err = snd_dice_transaction_set_rate(dice, rate);
 		if (err < 0) {
 			dev_err(&dice->unit->device,
 				"fail to set sampling rate\n");
+			if (keep)
+				release_all_resources(dice);
 			goto end;
 		}
 
-		/* Start both streams. */
-		err = start_stream(dice, master, rate);
+		if (!keep) {
+			err = keep_resources(dice);
+			if (err < 0) {
+				dev_err(&dice->unit->device,
+					"fail to keep isochronous resources\n");
+				goto end;
+			}
+		}
+
+		/* Start all streams. */
+		err = start_streams(dice, master_dir);
 		if (err < 0) {
 			dev_err(&dice->unit->device,
-				"fail to start AMDTP master stream\n");
+				"fail to start AMDTP master streams\n");
+			stop_all_streams(dice);
 			goto end;
 		}
-		err = start_stream(dice, slave, rate);
+		err = start_streams(dice, slave_dir);
 		if (err < 0) {
 			dev_err(&dice->unit->device,
-				"fail to start AMDTP slave stream\n");
-			stop_stream(dice, master);
+				"fail to start AMDTP slave streams\n");
+			stop_all_streams(dice);
 			goto end;
 		}
 		err = snd_dice_transaction_set_enable(dice);
 		if (err < 0) {
 			dev_err(&dice->unit->device,
 				"fail to enable interface\n");
-			stop_stream(dice, master);
-			stop_stream(dice, slave);
+			stop_all_streams(dice);
 			goto end;
 		}
 
 		/* Wait first callbacks */
-		if (!amdtp_stream_wait_callback(master, CALLBACK_TIMEOUT) ||
-		    !amdtp_stream_wait_callback(slave, CALLBACK_TIMEOUT)) {
+		if (!wait_first_callbacks(dice)) {
 			snd_dice_transaction_clear_enable(dice);
-			stop_stream(dice, master);
-			stop_stream(dice, slave);
+			stop_all_streams(dice);
 			err = -ETIMEDOUT;
 		}
 	}
@@ -279,22 +483,22 @@ void snd_dice_stream_stop_duplex(struct snd_dice *dice)
 
 	snd_dice_transaction_clear_enable(dice);
 
-	stop_stream(dice, &dice->tx_stream);
-	stop_stream(dice, &dice->rx_stream);
+	stop_all_streams(dice);
 }
 
-static int init_stream(struct snd_dice *dice, struct amdtp_stream *stream)
+static int init_stream(struct snd_dice *dice,
+		       enum amdtp_stream_direction dir, unsigned int index)
 {
 	int err;
 	struct fw_iso_resources *resources;
-	enum amdtp_stream_direction dir;
+	struct amdtp_stream *stream;
 
-	if (stream == &dice->tx_stream) {
-		resources = &dice->tx_resources;
-		dir = AMDTP_IN_STREAM;
+	if (dir == AMDTP_IN_STREAM) {
+		resources = &dice->tx_resources[index];
+		stream = &dice->tx_stream[index];
 	} else {
-		resources = &dice->rx_resources;
-		dir = AMDTP_OUT_STREAM;
+		resources = &dice->rx_resources[index];
+		stream = &dice->rx_stream[index];
 	}
 
 	err = fw_iso_resources_init(resources, dice->unit);
@@ -315,48 +519,69 @@ end:
  * This function should be called before starting streams or after stopping
  * streams.
  */
-static void destroy_stream(struct snd_dice *dice, struct amdtp_stream *stream)
+static void destroy_stream(struct snd_dice *dice,
+			   enum amdtp_stream_direction dir,
+			   unsigned int index)
 {
-	struct fw_iso_resources *resources;
-
-	if (stream == &dice->tx_stream)
-		resources = &dice->tx_resources;
-	else
-		resources = &dice->rx_resources;
-
-	amdtp_stream_destroy(stream);
-	fw_iso_resources_destroy(resources);
+	if (dir == AMDTP_IN_STREAM) {
+		amdtp_stream_destroy(&dice->tx_stream[index]);
+		fw_iso_resources_destroy(&dice->tx_resources[index]);
+	} else {
+		amdtp_stream_destroy(&dice->rx_stream[index]);
+		fw_iso_resources_destroy(&dice->rx_resources[index]);
+	}
 }
 
 int snd_dice_stream_init_duplex(struct snd_dice *dice)
 {
+	unsigned int i, tx_count, rx_count;
 	int err;
 
 	dice->substreams_counter = 0;
 
-	err = init_stream(dice, &dice->tx_stream);
-	if (err < 0)
-		goto end;
+	/* Until starting, the registers of the first streams are reset. */
+	dice->tx_streams = 1;
+	dice->rx_streams = 1;
 
-	err = init_stream(dice, &dice->rx_stream);
-	if (err < 0)
-		destroy_stream(dice, &dice->tx_stream);
-end:
+	rx_count = 0;
+	for (tx_count = 0; tx_count < SND_DICE_MAX_STREAMS; tx_count++) {
+		err = init_stream(dice, AMDTP_IN_STREAM, tx_count);
+		if (err < 0)
+			goto error;
+	}
+	for (rx_count = 0; rx_count < SND_DICE_MAX_STREAMS; rx_count++) {
+		err = init_stream(dice, AMDTP_OUT_STREAM, rx_count);
+		if (err < 0)
+			goto error;
+	}
+
+	return 0;
+error:
+	for (i = 0; i < tx_count; i++)
+		destroy_stream(dice, AMDTP_IN_STREAM, i);
+	for (i = 0; i < rx_count; i++)
+		destroy_stream(dice, AMDTP_OUT_STREAM, i);
 	return err;
 }
 
 void snd_dice_stream_destroy_duplex(struct snd_dice *dice)
 {
+	unsigned int i;
+
 	snd_dice_transaction_clear_enable(dice);
 
-	destroy_stream(dice, &dice->tx_stream);
-	destroy_stream(dice, &dice->rx_stream);
+	for (i = 0; i < SND_DICE_MAX_STREAMS; i++) {
+		destroy_stream(dice, AMDTP_IN_STREAM, i);
+		destroy_stream(dice, AMDTP_OUT_STREAM, i);
+	}
 
 	dice->substreams_counter = 0;
 }
 
 void snd_dice_stream_update_duplex(struct snd_dice *dice)
 {
+	unsigned int i;
+
 	/*
 	 * On a bus reset, the DICE firmware disables streaming and then goes
 	 * off contemplating its own navel for hundreds of milliseconds before
@@ -367,11 +592,12 @@ void snd_dice_stream_update_duplex(struct snd_dice *dice)
 	 */
 	dice->global_enabled = false;
 
-	stop_stream(dice, &dice->rx_stream);
-	stop_stream(dice, &dice->tx_stream);
+	stop_all_streams(dice);
 
-	fw_iso_resources_update(&dice->rx_resources);
-	fw_iso_resources_update(&dice->tx_resources);
+	for (i = 0; i < dice->rx_streams; i++)
+		fw_iso_resources_update(&dice->rx_resources[i]);
+	for (i = 0; i < dice->tx_streams; i++)
+		fw_iso_resources_update(&dice->tx_resources[i]);
 }
 
 static void dice_lock_changed(struct snd_dice *dice)
@@ -11,6 +11,9 @@
 
 #define NOTIFICATION_TIMEOUT_MS	100
 
+/* Larger sections are shadowed up to this size, and read directly beyond. */
+#define SHADOW_MAX_SIZE		4096
+
 static u64 get_subaddr(struct snd_dice *dice, enum snd_dice_addr_type type,
 		       u64 offset)
 {
@@ -36,30 +39,161 @@ static u64 get_subaddr(struct snd_dice *dice, enum snd_dice_addr_type type,
 	return offset;
 }
 
+static struct snd_dice_shadow *get_shadow(struct snd_dice *dice,
+					  enum snd_dice_addr_type type)
+{
+	if (type < SND_DICE_ADDR_TYPE_GLOBAL || type > SND_DICE_ADDR_TYPE_SYNC)
+		return NULL;
+
+	return &dice->shadows[type - SND_DICE_ADDR_TYPE_GLOBAL];
+}
+
+/* This is called with dice->lock held. */
+static void invalidate_shadow(struct snd_dice *dice,
+			      enum snd_dice_addr_type type)
+{
+	struct snd_dice_shadow *shadow = get_shadow(dice, type);
+
+	shadow->valid = false;
+	shadow->seq++;
+}
+
+static void invalidate_shadows(struct snd_dice *dice)
+{
+	invalidate_shadow(dice, SND_DICE_ADDR_TYPE_GLOBAL);
+	invalidate_shadow(dice, SND_DICE_ADDR_TYPE_TX);
+	invalidate_shadow(dice, SND_DICE_ADDR_TYPE_RX);
+	invalidate_shadow(dice, SND_DICE_ADDR_TYPE_SYNC);
+}
+
+void snd_dice_transaction_invalidate(struct snd_dice *dice,
+				     enum snd_dice_addr_type type)
+{
+	unsigned long flags;
+
+	if (get_shadow(dice, type) == NULL)
+		return;
+
+	spin_lock_irqsave(&dice->lock, flags);
+	invalidate_shadow(dice, type);
+	spin_unlock_irqrestore(&dice->lock, flags);
+}
+
+void snd_dice_transaction_invalidate_all(struct snd_dice *dice)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dice->lock, flags);
+	invalidate_shadows(dice);
+	spin_unlock_irqrestore(&dice->lock, flags);
+}
+
 int snd_dice_transaction_write(struct snd_dice *dice,
 			       enum snd_dice_addr_type type,
 			       unsigned int offset, void *buf, unsigned int len)
 {
-	return snd_fw_transaction(dice->unit,
-				  (len == 4) ? TCODE_WRITE_QUADLET_REQUEST :
-					       TCODE_WRITE_BLOCK_REQUEST,
-				  get_subaddr(dice, type, offset), buf, len, 0);
+	int err;
+
+	err = snd_fw_transaction_counted(&dice->transaction_stats,
+				(len == 4) ? TCODE_WRITE_QUADLET_REQUEST :
+					     TCODE_WRITE_BLOCK_REQUEST,
+				get_subaddr(dice, type, offset), buf, len, 0);
+	snd_dice_transaction_invalidate(dice, type);
+
+	return err;
 }
 
 int snd_dice_transaction_read(struct snd_dice *dice,
 			      enum snd_dice_addr_type type, unsigned int offset,
 			      void *buf, unsigned int len)
 {
-	return snd_fw_transaction(dice->unit,
-				  (len == 4) ? TCODE_READ_QUADLET_REQUEST :
-					       TCODE_READ_BLOCK_REQUEST,
-				  get_subaddr(dice, type, offset), buf, len, 0);
+	return snd_fw_transaction_counted(&dice->transaction_stats,
+				(len == 4) ? TCODE_READ_QUADLET_REQUEST :
+					     TCODE_READ_BLOCK_REQUEST,
+				get_subaddr(dice, type, offset), buf, len, 0);
+}
+
+/*
+ * Read a whole section with as few block requests as the device accepts. The
+ * copy is left invalid when a notification arrives in the meantime, so that
+ * the next reader fetches the section again.
+ */
+static int fill_shadow(struct snd_dice *dice, enum snd_dice_addr_type type)
+{
+	struct fw_device *device = fw_parent_device(dice->unit);
+	struct snd_dice_shadow *shadow = get_shadow(dice, type);
+	unsigned int max_len, pos, len, seq;
+	int err;
+
+	max_len = clamp_t(unsigned int, 2 << device->max_rec,
+			  4, 512 << device->max_speed);
+
+	spin_lock_irq(&dice->lock);
+	seq = shadow->seq;
+	spin_unlock_irq(&dice->lock);
+
+	for (pos = 0; pos < shadow->size; pos += len) {
+		len = min(shadow->size - pos, max_len);
+		err = snd_dice_transaction_read(dice, type, pos,
+						(u8 *)shadow->regs + pos, len);
+		if (err < 0)
+			return err;
+	}
+
+	spin_lock_irq(&dice->lock);
+	shadow->valid = shadow->seq == seq;
+	spin_unlock_irq(&dice->lock);
+
+	return 0;
+}
+
+/**
+ * snd_dice_transaction_read_cached - read registers through the shadows
+ * @dice: the DICE
+ * @type: the section of the registers
+ * @offset: the offset of the registers in the section, in bytes
+ * @buf: the buffer for the values, in big endian
+ * @len: the length to read, in bytes
+ *
+ * The registers of the global, tx, rx and ext_sync sections are served from
+ * a copy of the section, which is read from the device at the first access
+ * after the device notified a change. Registers which the device changes
+ * without notification, like the measured sample rate, should be read with
+ * snd_dice_transaction_read() instead.
+ */
+int snd_dice_transaction_read_cached(struct snd_dice *dice,
+				     enum snd_dice_addr_type type,
+				     unsigned int offset,
+				     void *buf, unsigned int len)
+{
+	struct snd_dice_shadow *shadow = get_shadow(dice, type);
+	bool valid;
+	int err = 0;
+
+	if (shadow == NULL || shadow->regs == NULL ||
+	    offset + len > shadow->size)
+		return snd_dice_transaction_read(dice, type, offset, buf, len);
+
+	mutex_lock(&dice->shadow_mutex);
+
+	spin_lock_irq(&dice->lock);
+	valid = shadow->valid;
+	spin_unlock_irq(&dice->lock);
+
+	if (!valid)
+		err = fill_shadow(dice, type);
+	if (err >= 0)
+		memcpy(buf, (u8 *)shadow->regs + offset, len);
+
+	mutex_unlock(&dice->shadow_mutex);
+
+	return err;
 }
 
 static unsigned int get_clock_info(struct snd_dice *dice, __be32 *info)
 {
-	return snd_dice_transaction_read_global(dice, GLOBAL_CLOCK_SELECT,
-						info, 4);
+	return snd_dice_transaction_read_cached(dice, SND_DICE_ADDR_TYPE_GLOBAL,
+						GLOBAL_CLOCK_SELECT, info, 4);
 }
 
 static int set_clock_info(struct snd_dice *dice,
@@ -172,11 +306,13 @@ int snd_dice_transaction_set_enable(struct snd_dice *dice)
 		goto end;
 
 	value = cpu_to_be32(1);
-	err = snd_fw_transaction(dice->unit, TCODE_WRITE_QUADLET_REQUEST,
-				 get_subaddr(dice, SND_DICE_ADDR_TYPE_GLOBAL,
-					     GLOBAL_ENABLE),
-				 &value, 4,
-				 FW_FIXED_GENERATION | dice->owner_generation);
+	err = snd_fw_transaction_counted(&dice->transaction_stats,
+				TCODE_WRITE_QUADLET_REQUEST,
+				get_subaddr(dice, SND_DICE_ADDR_TYPE_GLOBAL,
+					    GLOBAL_ENABLE),
+				&value, 4,
+				FW_FIXED_GENERATION | dice->owner_generation);
+	snd_dice_transaction_invalidate(dice, SND_DICE_ADDR_TYPE_GLOBAL);
 	if (err < 0)
 		goto end;
 
@@ -190,11 +326,13 @@ void snd_dice_transaction_clear_enable(struct snd_dice *dice)
 	__be32 value;
 
 	value = 0;
-	snd_fw_transaction(dice->unit, TCODE_WRITE_QUADLET_REQUEST,
-			   get_subaddr(dice, SND_DICE_ADDR_TYPE_GLOBAL,
-				       GLOBAL_ENABLE),
-			   &value, 4, FW_QUIET |
-			   FW_FIXED_GENERATION | dice->owner_generation);
+	snd_fw_transaction_counted(&dice->transaction_stats,
+				   TCODE_WRITE_QUADLET_REQUEST,
+				   get_subaddr(dice, SND_DICE_ADDR_TYPE_GLOBAL,
+					       GLOBAL_ENABLE),
+				   &value, 4, FW_QUIET |
+				   FW_FIXED_GENERATION | dice->owner_generation);
+	snd_dice_transaction_invalidate(dice, SND_DICE_ADDR_TYPE_GLOBAL);
 
 	dice->global_enabled = false;
 }
@@ -205,6 +343,7 @@ static void dice_notification(struct fw_card *card, struct fw_request *request,
 			      void *data, size_t length, void *callback_data)
 {
 	struct snd_dice *dice = callback_data;
+	struct snd_dice_notification *n;
 	u32 bits;
 	unsigned long flags;
 
@@ -220,7 +359,28 @@ static void dice_notification(struct fw_card *card, struct fw_request *request,
 	bits = be32_to_cpup(data);
 
 	spin_lock_irqsave(&dice->lock, flags);
-	dice->notification_bits |= bits;
+	if (dice->notification_head - dice->notification_tail >=
+						SND_DICE_NOTIFICATIONS) {
+		dice->notification_tail++;
+		dice->notifications_dropped++;
+	}
+	n = &dice->notifications[dice->notification_head++ %
+						SND_DICE_NOTIFICATIONS];
+	n->bits = bits;
+	n->generation = generation;
+	n->timestamp = ktime_to_ns(ktime_get());
+
+	/* A new clock also changes the formats and the status of streams. */
+	if (bits & NOTIFY_CLOCK_ACCEPTED)
+		invalidate_shadows(dice);
+	if (bits & (NOTIFY_LOCK_CHG | NOTIFY_EXT_STATUS)) {
+		invalidate_shadow(dice, SND_DICE_ADDR_TYPE_GLOBAL);
+		invalidate_shadow(dice, SND_DICE_ADDR_TYPE_SYNC);
+	}
+	if (bits & NOTIFY_TX_CFG_CHG)
+		invalidate_shadow(dice, SND_DICE_ADDR_TYPE_TX);
+	if (bits & NOTIFY_RX_CFG_CHG)
+		invalidate_shadow(dice, SND_DICE_ADDR_TYPE_RX);
 	spin_unlock_irqrestore(&dice->lock, flags);
 
 	fw_send_response(card, request, RCODE_COMPLETE);
@@ -251,13 +411,16 @@ static int register_notification_address(struct snd_dice *dice, bool retry)
 
 		dice->owner_generation = device->generation;
 		smp_rmb(); /* node_id vs. generation */
-		err = snd_fw_transaction(dice->unit, TCODE_LOCK_COMPARE_SWAP,
+		err = snd_fw_transaction_counted(&dice->transaction_stats,
+					 TCODE_LOCK_COMPARE_SWAP,
 					 get_subaddr(dice,
 						     SND_DICE_ADDR_TYPE_GLOBAL,
 						     GLOBAL_OWNER),
 					 buffer, 2 * 8,
 					 FW_FIXED_GENERATION |
 							dice->owner_generation);
+		snd_dice_transaction_invalidate(dice,
+						SND_DICE_ADDR_TYPE_GLOBAL);
 		if (err == 0) {
 			/* success */
 			if (buffer[0] == cpu_to_be64(OWNER_NO_OWNER))
@@ -297,17 +460,52 @@ static void unregister_notification_address(struct snd_dice *dice)
 		((u64)device->card->node_id << OWNER_NODE_SHIFT) |
 		dice->notification_handler.offset);
 	buffer[1] = cpu_to_be64(OWNER_NO_OWNER);
-	snd_fw_transaction(dice->unit, TCODE_LOCK_COMPARE_SWAP,
-			   get_subaddr(dice, SND_DICE_ADDR_TYPE_GLOBAL,
-				       GLOBAL_OWNER),
-			   buffer, 2 * 8, FW_QUIET |
-			   FW_FIXED_GENERATION | dice->owner_generation);
+	snd_fw_transaction_counted(&dice->transaction_stats,
+				   TCODE_LOCK_COMPARE_SWAP,
+				   get_subaddr(dice, SND_DICE_ADDR_TYPE_GLOBAL,
+					       GLOBAL_OWNER),
+				   buffer, 2 * 8, FW_QUIET |
+				   FW_FIXED_GENERATION | dice->owner_generation);
+	snd_dice_transaction_invalidate(dice, SND_DICE_ADDR_TYPE_GLOBAL);
 
 	kfree(buffer);
 
 	dice->owner_generation = -1;
 }
 
+static void free_shadows(struct snd_dice *dice)
+{
+	unsigned int i;
+
+	for (i = 0; i < SND_DICE_SHADOWS; i++) {
+		kfree(dice->shadows[i].regs);
+		dice->shadows[i].regs = NULL;
+		dice->shadows[i].size = 0;
+	}
+}
+
+/* The sizes of the sections are in the odd quadlets of the pointers. */
+static int alloc_shadows(struct snd_dice *dice, __be32 *pointers)
+{
+	struct snd_dice_shadow *shadow;
+	unsigned int i;
+
+	for (i = 0; i < SND_DICE_SHADOWS; i++) {
+		shadow = &dice->shadows[i];
+		shadow->size = min_t(unsigned int,
+				     be32_to_cpu(pointers[i * 2 + 1]) * 4,
+				     SHADOW_MAX_SIZE);
+		shadow->regs = kmalloc(shadow->size, GFP_KERNEL);
+		if (shadow->regs == NULL) {
+			free_shadows(dice);
+			return -ENOMEM;
+		}
+		shadow->valid = false;
+	}
+
+	return 0;
+}
+
 void snd_dice_transaction_destroy(struct snd_dice *dice)
 {
 	struct fw_address_handler *handler = &dice->notification_handler;
@@ -319,6 +517,8 @@ void snd_dice_transaction_destroy(struct snd_dice *dice)
 
 	fw_core_remove_address_handler(handler);
 	handler->callback_data = NULL;
+
+	free_shadows(dice);
 }
 
 int snd_dice_transaction_reinit(struct snd_dice *dice)
@@ -328,6 +528,9 @@ int snd_dice_transaction_reinit(struct snd_dice *dice)
 	if (handler->callback_data == NULL)
 		return -EINVAL;
 
+	/* The device may have changed anything while we were not looking. */
+	snd_dice_transaction_invalidate_all(dice);
+
 	return register_notification_address(dice, false);
 }
 
@@ -343,9 +546,14 @@ int snd_dice_transaction_init(struct snd_dice *dice)
 		return -ENOMEM;
 
 	/* Get offsets for sub-addresses */
-	err = snd_fw_transaction(dice->unit, TCODE_READ_BLOCK_REQUEST,
-				 DICE_PRIVATE_SPACE,
-				 pointers, sizeof(__be32) * 10, 0);
+	err = snd_fw_transaction_counted(&dice->transaction_stats,
+					 TCODE_READ_BLOCK_REQUEST,
+					 DICE_PRIVATE_SPACE,
+					 pointers, sizeof(__be32) * 10, 0);
+	if (err < 0)
+		goto end;
+
+	err = alloc_shadows(dice, pointers);
 	if (err < 0)
 		goto end;
 
@@ -356,6 +564,7 @@ int snd_dice_transaction_init(struct snd_dice *dice)
 	err = fw_core_add_address_handler(handler, &fw_high_memory_region);
 	if (err < 0) {
 		handler->callback_data = NULL;
+		free_shadows(dice);
 		goto end;
 	}
 
@@ -364,6 +573,7 @@ int snd_dice_transaction_init(struct snd_dice *dice)
 	if (err < 0) {
 		fw_core_remove_address_handler(handler);
 		handler->callback_data = NULL;
+		free_shadows(dice);
 		goto end;
 	}
 
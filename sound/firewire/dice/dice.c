@@ -124,17 +124,79 @@ static int highest_supported_mode_rate(struct snd_dice *dice,
 	return 0;
 }
 
-static int dice_read_mode_params(struct snd_dice *dice, unsigned int mode)
+/*
+ * The registers of each stream follow the ones of the previous stream. The
+ * first stream is counted even if the device reports none, because the
+ * driver always uses it.
+ */
+static int read_stream_params(struct snd_dice *dice,
+			      enum snd_dice_addr_type type, unsigned int mode)
 {
 	__be32 values[2];
+	unsigned int i, count, size, number, offset, *channels, *midi_ports;
+	unsigned int *pcm_chs, *stream_count, *stream_midi_ports, *stream_size;
+	int err;
+
+	if (type == SND_DICE_ADDR_TYPE_TX) {
+		number = TX_NUMBER;
+		offset = TX_NUMBER_AUDIO;
+		channels = &dice->tx_channels[mode];
+		midi_ports = &dice->tx_midi_ports[mode];
+		stream_count = &dice->tx_stream_count[mode];
+		stream_size = &dice->tx_stream_size;
+		pcm_chs = dice->tx_stream_channels[mode];
+		stream_midi_ports = dice->tx_stream_midi_ports[mode];
+	} else {
+		number = RX_NUMBER;
+		offset = RX_NUMBER_AUDIO;
+		channels = &dice->rx_channels[mode];
+		midi_ports = &dice->rx_midi_ports[mode];
+		stream_count = &dice->rx_stream_count[mode];
+		stream_size = &dice->rx_stream_size;
+		pcm_chs = dice->rx_stream_channels[mode];
+		stream_midi_ports = dice->rx_stream_midi_ports[mode];
+	}
+
+	/* The number of streams and the size of their registers. */
+	err = snd_dice_transaction_read_cached(dice, type, number,
+					       values, sizeof(values));
+	if (err < 0)
+		return err;
+	count = clamp_t(unsigned int, be32_to_cpu(values[0]),
+			1, SND_DICE_MAX_STREAMS);
+	size = be32_to_cpu(values[1]) * 4;
+	*stream_size = size;
+
+	*channels = 0;
+	for (i = 0; i < count; i++) {
+		err = snd_dice_transaction_read_cached(dice, type,
+						       offset + i * size,
+						       values, sizeof(values));
+		if (err < 0)
+			return err;
+
+		pcm_chs[i] = be32_to_cpu(values[0]);
+		stream_midi_ports[i] = be32_to_cpu(values[1]);
+		*channels += pcm_chs[i];
+	}
+	*midi_ports = stream_midi_ports[0];
+	*stream_count = count;
+
+	return 0;
+}
+
+static int dice_read_mode_params(struct snd_dice *dice, unsigned int mode)
+{
 	unsigned int rate;
 	int err;
 
 	if (highest_supported_mode_rate(dice, mode, &rate) < 0) {
 		dice->tx_channels[mode] = 0;
 		dice->tx_midi_ports[mode] = 0;
+		dice->tx_stream_count[mode] = 0;
 		dice->rx_channels[mode] = 0;
 		dice->rx_midi_ports[mode] = 0;
+		dice->rx_stream_count[mode] = 0;
 		return 0;
 	}
 
@@ -142,23 +204,11 @@ static int dice_read_mode_params(struct snd_dice *dice, unsigned int mode)
 	if (err < 0)
 		return err;
 
-	err = snd_dice_transaction_read_tx(dice, TX_NUMBER_AUDIO,
-					   values, sizeof(values));
-	if (err < 0)
-		return err;
-
-	dice->tx_channels[mode]   = be32_to_cpu(values[0]);
-	dice->tx_midi_ports[mode] = be32_to_cpu(values[1]);
-
-	err = snd_dice_transaction_read_rx(dice, RX_NUMBER_AUDIO,
-					   values, sizeof(values));
+	err = read_stream_params(dice, SND_DICE_ADDR_TYPE_TX, mode);
 	if (err < 0)
 		return err;
 
-	dice->rx_channels[mode]   = be32_to_cpu(values[0]);
-	dice->rx_midi_ports[mode] = be32_to_cpu(values[1]);
-
-	return 0;
+	return read_stream_params(dice, SND_DICE_ADDR_TYPE_RX, mode);
 }
 
 static int dice_read_params(struct snd_dice *dice)
@@ -168,7 +218,8 @@ static int dice_read_params(struct snd_dice *dice)
 
 	/* some very old firmwares don't tell about their clock support */
 	if (dice->clock_caps > 0) {
-		err = snd_dice_transaction_read_global(dice,
+		err = snd_dice_transaction_read_cached(dice,
+						SND_DICE_ADDR_TYPE_GLOBAL,
 						GLOBAL_CLOCK_CAPABILITIES,
 						&value, 4);
 		if (err < 0)
@@ -240,6 +291,7 @@ static void dice_card_free(struct snd_card *card)
 	snd_dice_transaction_destroy(dice);
 	fw_unit_put(dice->unit);
 
+	mutex_destroy(&dice->shadow_mutex);
 	mutex_destroy(&dice->mutex);
 }
 
@@ -262,9 +314,11 @@ static int dice_probe(struct fw_unit *unit, const struct ieee1394_device_id *id)
 	dice->card = card;
 	dice->unit = fw_unit_get(unit);
 	card->private_free = dice_card_free;
+	snd_fw_transaction_stats_init(&dice->transaction_stats, dice->unit);
 
 	spin_lock_init(&dice->lock);
 	mutex_init(&dice->mutex);
+	mutex_init(&dice->shadow_mutex);
 	init_completion(&dice->clock_accepted);
 	init_waitqueue_head(&dice->hwdep_wait);
 
@@ -296,6 +350,13 @@ static int dice_probe(struct fw_unit *unit, const struct ieee1394_device_id *id)
 	if (err < 0)
 		goto error;
 
+	err = amdtp_stream_add_pcm_meters(&dice->rx_stream[0], card);
+	if (err < 0)
+		goto error;
+	err = amdtp_stream_add_pcm_meters(&dice->tx_stream[0], card);
+	if (err < 0)
+		goto error;
+
 	err = snd_card_register(card);
 	if (err < 0) {
 		snd_dice_stream_destroy_duplex(dice);
@@ -17,6 +17,7 @@
 #include <linux/firewire.h>
 #include <linux/firewire-constants.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mod_devicetable.h>
 #include <linux/mutex.h>
@@ -42,6 +43,32 @@
 #include "../lib.h"
 #include "dice-interface.h"
 
+/* the number of streams in each direction, as ARX1..ARX4 clock sources */
+#define SND_DICE_MAX_STREAMS	4
+
+/* the number of notifications queued for userspace, a power of two */
+#define SND_DICE_NOTIFICATIONS	64
+
+struct snd_dice_notification {
+	u32 bits;
+	u32 generation;
+	u64 timestamp;
+};
+
+/*
+ * A copy of one register section. It is filled by block reads and
+ * invalidated by the notifications which tell that the device changed it.
+ */
+struct snd_dice_shadow {
+	__be32 *regs;
+	unsigned int size;	/* in bytes */
+	unsigned int seq;	/* bumped at each invalidation */
+	bool valid;
+};
+
+/* the global, tx, rx and ext_sync sections */
+#define SND_DICE_SHADOWS	4
+
 struct snd_dice {
 	struct snd_card *card;
 	struct fw_unit *unit;
@@ -55,26 +82,59 @@ struct snd_dice {
 	unsigned int sync_offset;
 	unsigned int rsrv_offset;
 
+	/*
+	 * Shadows of the sections. The mutex serializes the readers, and the
+	 * valid flags and sequence numbers are protected by the spinlock.
+	 */
+	struct snd_dice_shadow shadows[SND_DICE_SHADOWS];
+	struct mutex shadow_mutex;
+
 	unsigned int clock_caps;
+	/* The PCM channels of all streams, and the MIDI ports of the first. */
 	unsigned int tx_channels[3];
 	unsigned int rx_channels[3];
 	unsigned int tx_midi_ports[3];
 	unsigned int rx_midi_ports[3];
 
+	/* The streams in each rate mode, and the size of their registers. */
+	unsigned int tx_stream_count[3];
+	unsigned int rx_stream_count[3];
+	unsigned int tx_stream_channels[3][SND_DICE_MAX_STREAMS];
+	unsigned int rx_stream_channels[3][SND_DICE_MAX_STREAMS];
+	unsigned int tx_stream_midi_ports[3][SND_DICE_MAX_STREAMS];
+	unsigned int rx_stream_midi_ports[3][SND_DICE_MAX_STREAMS];
+	unsigned int tx_stream_size;
+	unsigned int rx_stream_size;
+
 	struct fw_address_handler notification_handler;
 	int owner_generation;
-	u32 notification_bits;
+
+	struct snd_fw_transaction_stats transaction_stats;
+
+	/*
+	 * The ring of notifications for userspace. The oldest ones are dropped
+	 * when it is full, and counted for the next one to read.
+	 */
+	struct snd_dice_notification notifications[SND_DICE_NOTIFICATIONS];
+	unsigned int notification_head;
+	unsigned int notification_tail;
+	unsigned int notifications_dropped;
 
 	/* For uapi */
 	int dev_lock_count; /* > 0 driver, < 0 userspace */
 	bool dev_lock_changed;
 	wait_queue_head_t hwdep_wait;
 
-	/* For streaming */
-	struct fw_iso_resources tx_resources;
-	struct fw_iso_resources rx_resources;
-	struct amdtp_stream tx_stream;
-	struct amdtp_stream rx_stream;
+	/*
+	 * For streaming. The first stream in each direction carries the PCM
+	 * substream and drives the others, which carry further channels.
+	 */
+	struct fw_iso_resources tx_resources[SND_DICE_MAX_STREAMS];
+	struct fw_iso_resources rx_resources[SND_DICE_MAX_STREAMS];
+	struct amdtp_stream tx_stream[SND_DICE_MAX_STREAMS];
+	struct amdtp_stream rx_stream[SND_DICE_MAX_STREAMS];
+	unsigned int tx_streams;
+	unsigned int rx_streams;
 	bool global_enabled;
 	struct completion clock_accepted;
 	unsigned int substreams_counter;
@@ -96,6 +156,13 @@ int snd_dice_transaction_write(struct snd_dice *dice,
 int snd_dice_transaction_read(struct snd_dice *dice,
 			      enum snd_dice_addr_type type, unsigned int offset,
 			      void *buf, unsigned int len);
+int snd_dice_transaction_read_cached(struct snd_dice *dice,
+				     enum snd_dice_addr_type type,
+				     unsigned int offset,
+				     void *buf, unsigned int len);
+void snd_dice_transaction_invalidate(struct snd_dice *dice,
+				     enum snd_dice_addr_type type);
+void snd_dice_transaction_invalidate_all(struct snd_dice *dice);
 
 static inline int snd_dice_transaction_write_global(struct snd_dice *dice,
 						    unsigned int offset,
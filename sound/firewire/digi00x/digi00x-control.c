@@ -7,118 +7,157 @@
 
 #include "digi00x.h"
 
-enum control_action { CTL_READ, CTL_WRITE };
-
-static int snd_dg00x_read_quadlet(struct snd_dg00x *dg00x,
-				  unsigned long long reg, u32 *dat)
-{
-	__be32 data;
-	int err;
-		
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
-				 reg, &data, sizeof(data), 0);
-	if (err < 0)
-		return err;
-
-	*dat = be32_to_cpu(data);
-	return err;
-}
-
 static int snd_dg00x_write_quadlet(struct snd_dg00x *dg00x,
 				   unsigned long long reg, u32 dat)
 {
 	__be32 data;
 
 	data = cpu_to_be32(dat);
-	return snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+	return snd_fw_transaction_counted(&dg00x->transaction_stats,
+				  TCODE_WRITE_QUADLET_REQUEST,
 				  reg, &data, sizeof(data), 0);
 }
 
-static int dg00x_clock_command(struct snd_dg00x *dg00x, int *value,
-			       enum control_action action)
+static void notify_value(struct snd_dg00x *dg00x, struct snd_kcontrol *ctl)
 {
-	int err;
-	if (action == CTL_READ) {
-		err = snd_dg00x_stream_get_clock(dg00x, value);
-	} else {
-		err = snd_dg00x_stream_set_clock(dg00x, *value);
-	}
-	return err;
+	/* The elements are not added yet at the first update. */
+	if (ctl != NULL)
+		snd_ctl_notify(dg00x->card, SNDRV_CTL_EVENT_MASK_VALUE,
+			       &ctl->id);
 }
 
 static int dg00x_clock_get(struct snd_kcontrol *control,
 			 struct snd_ctl_elem_value *value)
 {
-	struct snd_dg00x *dg00x;
-	dg00x = control->private_data;
+	struct snd_dg00x *dg00x = control->private_data;
+
+	spin_lock_irq(&dg00x->lock);
 	value->value.enumerated.item[0] = dg00x->clock;
+	spin_unlock_irq(&dg00x->lock);
+
 	return 0;
 }
 
 static int dg00x_clock_put(struct snd_kcontrol *control,
 			 struct snd_ctl_elem_value *value)
 {
-	struct snd_dg00x *dg00x;
+	struct snd_dg00x *dg00x = control->private_data;
+	unsigned int new_val = value->value.enumerated.item[0];
 	int err;
-	int cur_val, new_val;
-	dg00x = control->private_data;
 
-	cur_val = dg00x->clock;
-	new_val = value->value.enumerated.item[0];
+	mutex_lock(&dg00x->mutex);
+
+	if (new_val == dg00x->clock) {
+		err = 0;
+		goto end;
+	}
 
-	err = dg00x_clock_command(dg00x, &new_val, CTL_WRITE);
+	err = snd_dg00x_stream_set_clock(dg00x, new_val);
 	if (err < 0)
-		goto err;
+		goto end;
+
+	spin_lock_irq(&dg00x->lock);
 	dg00x->clock = new_val;
+	spin_unlock_irq(&dg00x->lock);
+	err = 1;
+end:
+	mutex_unlock(&dg00x->mutex);
+	return err;
+}
+
+static int dg00x_optical_get(struct snd_kcontrol *control,
+			     struct snd_ctl_elem_value *value)
+{
+	struct snd_dg00x *dg00x = control->private_data;
+
+	spin_lock_irq(&dg00x->lock);
+	value->value.enumerated.item[0] = dg00x->optical_mode;
+	spin_unlock_irq(&dg00x->lock);
 
-err:
-	return err < 0 ? err : 1;
+	return 0;
+}
+
+static int dg00x_optical_put(struct snd_kcontrol *control,
+			     struct snd_ctl_elem_value *value)
+{
+	struct snd_dg00x *dg00x = control->private_data;
+	unsigned int new_val = value->value.enumerated.item[0];
+	int err;
+
+	if (new_val >= SND_DG00X_OPT_IFACE_MODE_COUNT)
+		return -EINVAL;
+
+	mutex_lock(&dg00x->mutex);
+
+	if (new_val == dg00x->optical_mode) {
+		err = 0;
+		goto end;
+	}
+
+	err = snd_dg00x_stream_set_optical_mode(dg00x, new_val);
+	if (err < 0)
+		goto end;
+
+	spin_lock_irq(&dg00x->lock);
+	dg00x->optical_mode = new_val;
+	spin_unlock_irq(&dg00x->lock);
+	err = 1;
+end:
+	mutex_unlock(&dg00x->mutex);
+	return err;
+}
+
+/* the index of the left register of a pair in the shadow */
+static unsigned int mix_index(unsigned long long rawch)
+{
+	return (unsigned int)(rawch - DG00X_MIX) / 4;
 }
 
 static int dg00x_mixmatrix_get(struct snd_kcontrol *control,
 			       struct snd_ctl_elem_value *value,
 			       unsigned long long rawch)
 {
-	int err;
+	struct snd_dg00x *dg00x = control->private_data;
+	unsigned int index = mix_index(rawch);
 	u32 left, right;
 	int v;
-	struct snd_dg00x *dg00x;
-	
-	dg00x = control->private_data;
 
-	err = snd_dg00x_read_quadlet(dg00x, rawch, &left);
-	if (err < 0)
-		goto err;
-	err = snd_dg00x_read_quadlet(dg00x, rawch+0x04, &right);
-	if (err < 0)
-		goto err;
-	
+	spin_lock_irq(&dg00x->lock);
+	left = dg00x->mix[index];
+	right = dg00x->mix[index + 1];
+	spin_unlock_irq(&dg00x->lock);
+
 	if (left == DG00X_MIX_NONE && right == DG00X_MIX_NONE) {
 		v = 0;
 	} else if (left == DG00X_MIX_1_TO_1 && right == DG00X_MIX_NONE) {
 		v = 1;
 	} else if (left == DG00X_MIX_NONE && right == DG00X_MIX_1_TO_1) {
 		v = 2;
-	} else if (left == DG00X_MIX_1_TO_STEREO && 
+	} else if (left == DG00X_MIX_1_TO_STEREO &&
 		   right == DG00X_MIX_1_TO_STEREO) {
 		v = 3;
 	} else {
 		v = 0;
 	}
 	value->value.enumerated.item[0] = v;
-err:
-	return err < 0 ? err : 1;
+
+	return 0;
 }
 
 static int dg00x_mixmatrix_put(struct snd_kcontrol *control,
 				  struct snd_ctl_elem_value *value,
 				  unsigned long long rawch)
 {
+	struct snd_dg00x *dg00x = control->private_data;
+	unsigned int index = mix_index(rawch);
 	int err, new_val;
 	u32 left, right;
-	struct snd_dg00x *dg00x;
+	__be32 data[2];
+	struct snd_fw_register regs[] = {
+		{ rawch, &data[0], sizeof(data[0]) },
+		{ rawch + 0x04, &data[1], sizeof(data[1]) },
+	};
 
-	dg00x = control->private_data;
 	new_val = value->value.enumerated.item[0];
 
 	switch (new_val) {
@@ -132,7 +171,7 @@ static int dg00x_mixmatrix_put(struct snd_kcontrol *control,
 		break;
 	case 2:
 		left = DG00X_MIX_NONE;
-	 	right = DG00X_MIX_1_TO_1;
+		right = DG00X_MIX_1_TO_1;
 		break;
 	default:
 	case 3:
@@ -140,18 +179,33 @@ static int dg00x_mixmatrix_put(struct snd_kcontrol *control,
 		right = DG00X_MIX_1_TO_STEREO;
 		break;
 	}
+
+	mutex_lock(&dg00x->mutex);
+
+	if (left == dg00x->mix[index] && right == dg00x->mix[index + 1]) {
+		err = 0;
+		goto end;
+	}
+
 	err = snd_dg00x_write_quadlet(dg00x, 0xffffe0000124, 1);
 	if (err < 0)
-		goto err;
-	err = snd_dg00x_write_quadlet(dg00x, rawch, left);
-	if (err < 0)
-		goto err;
-	err = snd_dg00x_write_quadlet(dg00x, rawch+0x04, right);
+		goto end;
+	/* The pair is sent in one block request. */
+	data[0] = cpu_to_be32(left);
+	data[1] = cpu_to_be32(right);
+	err = snd_fw_write_registers(&dg00x->transaction_stats, regs,
+				     ARRAY_SIZE(regs));
 	if (err < 0)
-		goto err;
-	control->private_value = new_val;
-err:
-	return err < 0 ? err : 1;
+		goto end;
+
+	spin_lock_irq(&dg00x->lock);
+	dg00x->mix[index] = left;
+	dg00x->mix[index + 1] = right;
+	spin_unlock_irq(&dg00x->lock);
+	err = 1;
+end:
+	mutex_unlock(&dg00x->mutex);
+	return err;
 }
 
 static int dg00x_mixmatrix_get_1(struct snd_kcontrol *control,
@@ -383,6 +437,17 @@ static int dg00x_clock_info(struct snd_kcontrol *control,
 	return snd_ctl_enum_info(info, 1, ARRAY_SIZE(texts), texts);
 }
 
+static int dg00x_optical_info(struct snd_kcontrol *control,
+			      struct snd_ctl_elem_info *info)
+{
+	static const char *const texts[SND_DG00X_OPT_IFACE_MODE_COUNT] = {
+		[SND_DG00X_OPT_IFACE_MODE_ADAT] = "ADAT",
+		[SND_DG00X_OPT_IFACE_MODE_SPDIF] = "S/PDIF",
+	};
+
+	return snd_ctl_enum_info(info, 1, ARRAY_SIZE(texts), texts);
+}
+
 static int dg00x_mixmatrix_info(struct snd_kcontrol *control,
 				struct snd_ctl_elem_info *info)
 {
@@ -396,16 +461,28 @@ static int dg00x_mixmatrix_info(struct snd_kcontrol *control,
 	return snd_ctl_enum_info(info, 1, ARRAY_SIZE(texts), texts);
 }
 
+static struct snd_kcontrol_new snd_dg00x_clock_control = {
+	.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+	.name = "Clock Source",
+	.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,
+	.info = dg00x_clock_info,
+	.get = dg00x_clock_get,
+	.put = dg00x_clock_put,
+	.private_value = 0
+};
+
+static struct snd_kcontrol_new snd_dg00x_optical_control = {
+	.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+	.name = "Optical Mode",
+	.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,
+	.info = dg00x_optical_info,
+	.get = dg00x_optical_get,
+	.put = dg00x_optical_put,
+	.private_value = 0
+};
+
+/* in the order of the pairs in the mixer matrix */
 static struct snd_kcontrol_new snd_dg00x_controls[] = {
-	{
-		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
-		.name = "Clock Source",
-		.access = SNDRV_CTL_ELEM_ACCESS_READWRITE,
-		.info = dg00x_clock_info,
-		.get = dg00x_clock_get,
-		.put = dg00x_clock_put,
-		.private_value = 0
-	},
 	{
 		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
 		.name = "Mix 1",
@@ -570,21 +647,103 @@ static struct snd_kcontrol_new snd_dg00x_controls[] = {
 	},
 };
 
+/*
+ * Read the mixer matrix and the clock registers into the shadows, and notify
+ * the elements whose registers changed. The reads are merged into block
+ * requests. Call this with dg00x->mutex held.
+ */
+int snd_dg00x_update_mixer(struct snd_dg00x *dg00x)
+{
+	__be32 mix[DG00X_MIX_QUADLETS];
+	__be32 clock[2];
+	struct snd_fw_register regs[] = {
+		{ DG00X_MIX, mix, sizeof(mix) },
+		{ DG00X_ADDR_BASE + DG00X_OFFSET_CLOCK_SOURCE,
+		  clock, sizeof(clock) },
+	};
+	bool mix_changed[DG00X_MIX_PAIRS];
+	bool clock_changed, optical_changed;
+	unsigned int i, source, mode;
+	u32 left, right;
+	int err;
+
+	err = snd_fw_read_registers(&dg00x->transaction_stats, regs,
+				    ARRAY_SIZE(regs));
+	if (err < 0)
+		return err;
+
+	source = be32_to_cpu(clock[0]) & 0x0f;
+	if (source >= SND_DG00X_CLOCK_COUNT)
+		return -EIO;
+	mode = be32_to_cpu(clock[1]) & 0x01;
+
+	spin_lock_irq(&dg00x->lock);
+	for (i = 0; i < DG00X_MIX_PAIRS; i++) {
+		left = be32_to_cpu(mix[i * 2]);
+		right = be32_to_cpu(mix[i * 2 + 1]);
+		mix_changed[i] = left != dg00x->mix[i * 2] ||
+				 right != dg00x->mix[i * 2 + 1];
+		dg00x->mix[i * 2] = left;
+		dg00x->mix[i * 2 + 1] = right;
+	}
+	clock_changed = source != dg00x->clock;
+	dg00x->clock = source;
+	optical_changed = mode != dg00x->optical_mode;
+	dg00x->optical_mode = mode;
+	spin_unlock_irq(&dg00x->lock);
+
+	for (i = 0; i < DG00X_MIX_PAIRS; i++) {
+		if (mix_changed[i])
+			notify_value(dg00x, dg00x->mix_ctls[i]);
+	}
+	if (clock_changed)
+		notify_value(dg00x, dg00x->clock_ctl);
+	if (optical_changed)
+		notify_value(dg00x, dg00x->optical_ctl);
+
+	return 0;
+}
+
+static int add_control(struct snd_dg00x *dg00x,
+		       struct snd_kcontrol_new *template,
+		       struct snd_kcontrol **ctl)
+{
+	struct snd_kcontrol *kctl;
+	int err;
+
+	kctl = snd_ctl_new1(template, dg00x);
+	err = snd_ctl_add(dg00x->card, kctl);
+	if (err < 0)
+		return err;
+	*ctl = kctl;
+
+	return 0;
+}
+
 int snd_dg00x_create_mixer(struct snd_dg00x *dg00x)
 {
 	unsigned int i;
 	int err;
 
-	err = dg00x_clock_command(dg00x, &dg00x->clock, CTL_READ);
+	BUILD_BUG_ON(ARRAY_SIZE(snd_dg00x_controls) != DG00X_MIX_PAIRS);
+
+	mutex_lock(&dg00x->mutex);
+	err = snd_dg00x_update_mixer(dg00x);
+	mutex_unlock(&dg00x->mutex);
+	if (err < 0)
+		return err;
+
+	err = add_control(dg00x, &snd_dg00x_clock_control, &dg00x->clock_ctl);
 	if (err < 0)
 		return err;
 
 	for (i = 0; i < ARRAY_SIZE(snd_dg00x_controls); ++i) {
-		err = snd_ctl_add(dg00x->card,
-				  snd_ctl_new1(&snd_dg00x_controls[i], dg00x));
+		err = add_control(dg00x, &snd_dg00x_controls[i],
+				  &dg00x->mix_ctls[i]);
 		if (err < 0)
 			return err;
 	}
 
-	return 0;
+	return add_control(dg00x, &snd_dg00x_optical_control,
+			   &dg00x->optical_ctl);
 }
@@ -0,0 +1,135 @@
+/*
+ * digi00x-dot.h - a part of driver for Digidesign Digi 002/003 family
+ *
+ * Copyright (c) 2014-2015 Takashi Sakamoto
+ * Copyright (C) 2012 Robin Gareus <robin@gareus.org>
+ * Copyright (C) 2012 Damien Zammit <damien@zamaudio.com>
+ *
+ * Licensed under the terms of the GNU General Public License, version 2.
+ */
+
+/*
+ * The scrambler of PCM samples, for digi00x-protocol.c. The includer provides
+ * the types and byte order helpers of the kernel and struct dot_state, so that
+ * dot-bench.c can check this code in userspace.
+ */
+
+#ifndef SOUND_DIGI00X_DOT_H_INCLUDED
+#define SOUND_DIGI00X_DOT_H_INCLUDED
+
+#define BYTE_PER_SAMPLE (4)
+#define MAGIC_DOT_BYTE (2)
+
+/* the position of the magic byte in a quadlet in CPU order */
+#define MAGIC_DOT_SHIFT	((BYTE_PER_SAMPLE - 1 - MAGIC_DOT_BYTE) * 8)
+
+/* The salt is zero at this offset and beyond. */
+#define DOT_OFFSET_MAX	15
+
+/* the salts of dot_scrt(), filled at module init */
+static __u8 dot_salts[256][DOT_OFFSET_MAX + 1];
+
+/*
+ * double-oh-three look up table
+ *
+ * @param idx index byte (audio-sample data) 0x00..0xff
+ * @param off channel offset shift
+ * @return salt to XOR with given data
+ */
+static __u8 dot_scrt(const __u8 idx, const unsigned int off)
+{
+	/*
+	 * the length of the added pattern only depends on the lower nibble
+	 * of the last non-zero data
+	 */
+	static const __u8 len[16] = {0, 1, 3, 5, 7, 9, 11, 13, 14,
+				     12, 10, 8, 6, 4, 2, 0};
+
+	/*
+	 * the lower nibble of the salt. Interleaved sequence.
+	 * this is walked backwards according to len[]
+	 */
+	static const __u8 nib[15] = {0x8, 0x7, 0x9, 0x6, 0xa, 0x5, 0xb, 0x4,
+				     0xc, 0x3, 0xd, 0x2, 0xe, 0x1, 0xf};
+
+	/* circular list for the salt's hi nibble. */
+	static const __u8 hir[15] = {0x0, 0x6, 0xf, 0x8, 0x7, 0x5, 0x3, 0x4,
+				     0xc, 0xd, 0xe, 0x1, 0x2, 0xb, 0xa};
+
+	/*
+	 * start offset for upper nibble mapping.
+	 * note: 9 is /special/. In the case where the high nibble == 0x9,
+	 * hir[] is not used and - coincidentally - the salt's hi nibble is
+	 * 0x09 regardless of the offset.
+	 */
+	static const __u8 hio[16] = {0, 11, 12, 6, 7, 5, 1, 4,
+				     3, 0x00, 14, 13, 8, 9, 10, 2};
+
+	const __u8 ln = idx & 0xf;
+	const __u8 hn = (idx >> 4) & 0xf;
+	const __u8 hr = (hn == 0x9) ? 0x9 : hir[(hio[hn] + off) % 15];
+
+	if (len[ln] < off)
+		return 0x00;
+
+	return ((nib[14 + off - len[ln]]) | (hr << 4));
+}
+
+static void fill_dot_salts(void)
+{
+	unsigned int idx, off;
+
+	for (idx = 0; idx < 256; idx++) {
+		for (off = 0; off <= DOT_OFFSET_MAX; off++)
+			dot_salts[idx][off] = dot_scrt(idx, off);
+	}
+}
+
+/*
+ * Form a labelled quadlet from a 24 bit sample and scramble its magic byte
+ * before it is stored. The offset saturates, because the salt stays zero once
+ * it is exceeded.
+ */
+static __always_inline __be32 dot_encode_sample(struct dot_state *state,
+						u32 sample)
+{
+	u32 quadlet = sample | 0x40000000;
+	__u8 magic = quadlet >> MAGIC_DOT_SHIFT;
+
+	if (magic != 0x00) {
+		state->off = 0;
+		state->idx = magic ^ state->carry;
+	}
+	quadlet ^= (u32)state->carry << MAGIC_DOT_SHIFT;
+	if (state->off < DOT_OFFSET_MAX)
+		state->off++;
+	state->carry = dot_salts[state->idx][state->off];
+
+	return cpu_to_be32(quadlet);
+}
+
+/*
+ * Each salt depends on the samples before it, thus a data block is encoded
+ * in one pass. A constant @channels lets the compiler unroll the loop.
+ */
+static __always_inline void encode_block_s16(struct dot_state *state,
+					     __be32 *buffer, const u16 *src,
+					     unsigned int channels)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; ++c)
+		buffer[c] = dot_encode_sample(state, src[c] << 8);
+}
+
+static __always_inline void encode_block_s32(struct dot_state *state,
+					     __be32 *buffer, const u32 *src,
+					     unsigned int channels)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; ++c)
+		buffer[c] = dot_encode_sample(state, src[c] >> 8);
+}
+
+#endif
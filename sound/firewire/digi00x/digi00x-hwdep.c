@@ -97,6 +97,13 @@ static int hwdep_get_info(struct snd_dg00x *dg00x, void __user *arg)
 	return 0;
 }
 
+static void refresh_mixer(struct snd_dg00x *dg00x)
+{
+	mutex_lock(&dg00x->mutex);
+	snd_dg00x_update_mixer(dg00x);
+	mutex_unlock(&dg00x->mutex);
+}
+
 static int hwdep_lock(struct snd_dg00x *dg00x)
 {
 	int err;
@@ -130,18 +137,28 @@ static int hwdep_unlock(struct snd_dg00x *dg00x)
 
 	spin_unlock_irq(&dg00x->lock);
 
+	/* Userspace may have changed the mixer and the clock. */
+	if (err == 0)
+		refresh_mixer(dg00x);
+
 	return err;
 }
 
 static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 {
 	struct snd_dg00x *dg00x = hwdep->private_data;
+	bool unlocked = false;
 
 	spin_lock_irq(&dg00x->lock);
-	if (dg00x->dev_lock_count == -1)
+	if (dg00x->dev_lock_count == -1) {
 		dg00x->dev_lock_count = 0;
+		unlocked = true;
+	}
 	spin_unlock_irq(&dg00x->lock);
 
+	if (unlocked)
+		refresh_mixer(dg00x);
+
 	return 0;
 }
 
@@ -14,7 +14,8 @@ static int get_optical_iface_mode(struct snd_dg00x *dg00x,
 	__be32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_READ_QUADLET_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_OPT_IFACE_MODE,
 				 &data, sizeof(data), 0);
 	if (err >= 0)
@@ -51,11 +52,45 @@ static void proc_read_clock(struct snd_info_entry *entry,
 	snd_iprintf(buf, "Sampling Rate: %d\n", rate);
 	snd_iprintf(buf, "Clock Source: %s\n", source_name[clock]);
 	snd_iprintf(buf, "Optical mode: %s\n", optical_name[mode]);
+	snd_iprintf(buf, "Session transition: %u msec (max %u msec)\n",
+		    dg00x->transition_ms, dg00x->max_transition_ms);
+}
+
+static void proc_read_bandwidth(struct snd_info_entry *entry,
+				struct snd_info_buffer *buf)
+{
+	struct snd_dg00x *dg00x = entry->private_data;
+
+	fw_iso_resources_dump_plan(dg00x->unit, buf);
+}
+
+static void proc_read_transactions(struct snd_info_entry *entry,
+				   struct snd_info_buffer *buf)
+{
+	struct snd_dg00x *dg00x = entry->private_data;
+
+	snd_fw_transaction_stats_dump(&dg00x->transaction_stats, buf);
+}
+
+static void add_node(struct snd_dg00x *dg00x, struct snd_info_entry *root,
+		     const char *name,
+		     void (*op)(struct snd_info_entry *e,
+				struct snd_info_buffer *b))
+{
+	struct snd_info_entry *entry;
+
+	entry = snd_info_create_card_entry(dg00x->card, name, root);
+	if (entry == NULL)
+		return;
+
+	snd_info_set_text_ops(entry, dg00x, op);
+	if (snd_info_register(entry) < 0)
+		snd_info_free_entry(entry);
 }
 
 void snd_dg00x_proc_init(struct snd_dg00x *dg00x)
 {
-	struct snd_info_entry *root, *entry;
+	struct snd_info_entry *root;
 
 	/*
 	 * All nodes are automatically removed at snd_card_disconnect(),
@@ -72,15 +107,7 @@ void snd_dg00x_proc_init(struct snd_dg00x *dg00x)
 		return;
 	}
 
-	entry = snd_info_create_card_entry(dg00x->card, "clock", root);
-	if (entry == NULL) {
-		snd_info_free_entry(root);
-		return;
-	}
-
-	snd_info_set_text_ops(entry, dg00x, proc_read_clock);
-	if (snd_info_register(entry) < 0) {
-		snd_info_free_entry(entry);
-		snd_info_free_entry(root);
-	}
+	add_node(dg00x, root, "bandwidth", proc_read_bandwidth);
+	add_node(dg00x, root, "clock", proc_read_clock);
+	add_node(dg00x, root, "transactions", proc_read_transactions);
 }
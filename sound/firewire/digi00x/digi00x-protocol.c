@@ -10,77 +10,24 @@
 
 #include <sound/asound.h>
 #include "digi00x.h"
-
-#define BYTE_PER_SAMPLE (4)
-#define MAGIC_DOT_BYTE (2)
+#include "digi00x-dot.h"
 
 #define MAGIC_BYTE_OFF(x) (((x) * BYTE_PER_SAMPLE) + MAGIC_DOT_BYTE)
 
 /*
- * double-oh-three look up table
- *
- * @param idx index byte (audio-sample data) 0x00..0xff
- * @param off channel offset shift
- * @return salt to XOR with given data
+ * The PCM samples are in consecutive quadlets of each data block. The state
+ * of the scrambler is kept in a local copy over the packet.
  */
-static const __u8 dot_scrt(const __u8 idx, const unsigned int off)
-{
-	/*
-	 * the length of the added pattern only depends on the lower nibble
-	 * of the last non-zero data
-	 */
-	static const __u8 len[16] = {0, 1, 3, 5, 7, 9, 11, 13, 14,
-				     12, 10, 8, 6, 4, 2, 0};
-
-	/*
-	 * the lower nibble of the salt. Interleaved sequence.
-	 * this is walked backwards according to len[]
-	 */
-	static const __u8 nib[15] = {0x8, 0x7, 0x9, 0x6, 0xa, 0x5, 0xb, 0x4,
-				     0xc, 0x3, 0xd, 0x2, 0xe, 0x1, 0xf};
-
-	/* circular list for the salt's hi nibble. */
-	static const __u8 hir[15] = {0x0, 0x6, 0xf, 0x8, 0x7, 0x5, 0x3, 0x4,
-				     0xc, 0xd, 0xe, 0x1, 0x2, 0xb, 0xa};
-
-	/*
-	 * start offset for upper nibble mapping.
-	 * note: 9 is /special/. In the case where the high nibble == 0x9,
-	 * hir[] is not used and - coincidentally - the salt's hi nibble is
-	 * 0x09 regardless of the offset.
-	 */
-	static const __u8 hio[16] = {0, 11, 12, 6, 7, 5, 1, 4,
-				     3, 0x00, 14, 13, 8, 9, 10, 2};
-
-	const __u8 ln = idx & 0xf;
-	const __u8 hn = (idx >> 4) & 0xf;
-	const __u8 hr = (hn == 0x9) ? 0x9 : hir[(hio[hn] + off) % 15];
-
-	if (len[ln] < off)
-		return 0x00;
-
-	return ((nib[14 + off - len[ln]]) | (hr << 4));
-}
-
-static void dot_encode_step(struct dot_state *state, __be32 *const buffer)
-{
-	__u8 * const data = (__u8 *) buffer;
-
-	if (data[MAGIC_DOT_BYTE] != 0x00) {
-		state->off = 0;
-		state->idx = data[MAGIC_DOT_BYTE] ^ state->carry;
-	}
-	data[MAGIC_DOT_BYTE] ^= state->carry;
-	state->carry = dot_scrt(state->idx, ++(state->off));
-}
-
 static void write_pcm_s16(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 			  __be32 *buffer, unsigned int frames)
 {
 	struct snd_dg00x *dg00x =
 			container_of(s, struct snd_dg00x, rx_stream);
 	struct snd_pcm_runtime *runtime = pcm->runtime;
+	struct dot_state state = dg00x->state;
 	unsigned int channels, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	__be32 *samples;
 	const u16 *src;
 
 	channels = s->pcm_channels;
@@ -89,18 +36,32 @@ static void write_pcm_s16(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
 
 	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			buffer[s->pcm_positions[c]] =
-					cpu_to_be32((*src << 8) | 0x40000000);
-			dot_encode_step(&dg00x->state,
-					&buffer[s->pcm_positions[c]]);
-			src++;
+		samples = &buffer[s->pcm_positions[0]];
+		switch (channels) {
+		case 18:
+			encode_block_s16(&state, samples, src, 18);
+			break;
+		case 10:
+			encode_block_s16(&state, samples, src, 10);
+			break;
+		default:
+			encode_block_s16(&state, samples, src, channels);
+			break;
+		}
+
+		if (meter) {
+			for (c = 0; c < channels; ++c)
+				amdtp_stream_pcm_meter(s, c,
+						       (s16)src[c] * 256);
 		}
 
+		src += channels;
 		buffer += s->data_block_quadlets;
 		if (--remaining_frames == 0)
 			src = (void *)runtime->dma_area;
 	}
+
+	dg00x->state = state;
 }
 
 static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
@@ -109,7 +70,10 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 	struct snd_dg00x *dg00x =
 			container_of(s, struct snd_dg00x, rx_stream);
 	struct snd_pcm_runtime *runtime = pcm->runtime;
+	struct dot_state state = dg00x->state;
 	unsigned int channels, remaining_frames, i, c;
+	bool meter = s->pcm_meter;
+	__be32 *samples;
 	const u32 *src;
 
 	channels = s->pcm_channels;
@@ -118,18 +82,31 @@ static void write_pcm_s32(struct amdtp_stream *s, struct snd_pcm_substream *pcm,
 	remaining_frames = runtime->buffer_size - s->pcm_buffer_pointer;
 
 	for (i = 0; i < frames; ++i) {
-		for (c = 0; c < channels; ++c) {
-			buffer[s->pcm_positions[c]] =
-					cpu_to_be32((*src >> 8) | 0x40000000);
-			dot_encode_step(&dg00x->state,
-					&buffer[s->pcm_positions[c]]);
-			src++;
+		samples = &buffer[s->pcm_positions[0]];
+		switch (channels) {
+		case 18:
+			encode_block_s32(&state, samples, src, 18);
+			break;
+		case 10:
+			encode_block_s32(&state, samples, src, 10);
+			break;
+		default:
+			encode_block_s32(&state, samples, src, channels);
+			break;
 		}
 
+		if (meter) {
+			for (c = 0; c < channels; ++c)
+				amdtp_stream_pcm_meter(s, c, (s32)src[c] >> 8);
+		}
+
+		src += channels;
 		buffer += s->data_block_quadlets;
 		if (--remaining_frames == 0)
 			src = (void *)runtime->dma_area;
 	}
+
+	dg00x->state = state;
 }
 
 static void fill_midi(struct amdtp_stream *s, __be32 *buffer,
@@ -328,7 +305,8 @@ int snd_dg00x_protocol_add_instance(struct snd_dg00x *dg00x)
 	data[0] = cpu_to_be32((device->card->node_id << 16) |
 			      (async_handler.offset >> 32));
 	data[1] = cpu_to_be32(async_handler.offset);
-	err = snd_fw_transaction(dg00x->unit, TCODE_WRITE_BLOCK_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_WRITE_BLOCK_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_MESSAGE_ADDR,
 				 &data, sizeof(data), 0);
 	if (err < 0)
@@ -338,7 +316,8 @@ int snd_dg00x_protocol_add_instance(struct snd_dg00x *dg00x)
 	data[0] = cpu_to_be32((device->card->node_id << 16) |
 			      (async_handler.offset >> 32));
 	data[1] = cpu_to_be32(async_handler.offset + 4);
-	err = snd_fw_transaction(dg00x->unit, TCODE_WRITE_BLOCK_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_WRITE_BLOCK_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_MIDI_CTL_ADDR,
 				 &data, sizeof(data), 0);
 	if (err < 0)
@@ -380,6 +359,8 @@ int snd_dg00x_protocol_register(void)
 	};
 	int err;
 
+	fill_dot_salts();
+
 	midi_wq = alloc_workqueue("snd-digi00x",
 				  WQ_SYSFS | WQ_POWER_EFFICIENT, 0);
 	if (midi_wq == NULL)
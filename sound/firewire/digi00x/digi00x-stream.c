@@ -40,7 +40,8 @@ int snd_dg00x_stream_get_rate(struct snd_dg00x *dg00x, unsigned int *rate)
 	__be32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_READ_QUADLET_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_RATE_GET,
 				 &data, sizeof(data), 0);
 	if (err < 0)
@@ -70,7 +71,8 @@ int snd_dg00x_stream_set_rate(struct snd_dg00x *dg00x, unsigned int rate)
 		return -EIO;
 
 	data = cpu_to_be32(i);
-	return snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+	return snd_fw_transaction_counted(&dg00x->transaction_stats,
+				  TCODE_WRITE_QUADLET_REQUEST,
 				  DG00X_ADDR_BASE + DG00X_OFFSET_RATE_SET,
 				  &data, sizeof(data), 0);
 }
@@ -81,7 +83,8 @@ int snd_dg00x_stream_get_clock(struct snd_dg00x *dg00x,
 	__be32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_READ_QUADLET_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_CLOCK_SOURCE,
 				 &data, sizeof(data), 0);
 	if (err < 0)
@@ -107,7 +110,8 @@ int snd_dg00x_stream_set_clock(struct snd_dg00x *dg00x, unsigned int clock)
 		return -EIO;
 
 	data = cpu_to_be32(i);
-	return snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+	return snd_fw_transaction_counted(&dg00x->transaction_stats,
+				  TCODE_WRITE_QUADLET_REQUEST,
 				  0xffffe0000118ull, &data, sizeof(data), 0);
 }
 
@@ -117,7 +121,8 @@ int snd_dg00x_stream_get_optical_mode(struct snd_dg00x *dg00x,
 	__be32 data;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_READ_QUADLET_REQUEST,
 				 0xffffe000011c, &data, sizeof(data), 0);
 	if (err >= 0)
 		*mode = be32_to_cpu(data) & 0x01;
@@ -131,26 +136,54 @@ int snd_dg00x_stream_set_optical_mode(struct snd_dg00x *dg00x,
 	__be32 data;
 
 	data = cpu_to_be32(mode);
-	return snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
-				 0xffffe000011c, &data, sizeof(data), 0);
+	return snd_fw_transaction_counted(&dg00x->transaction_stats,
+				  TCODE_WRITE_QUADLET_REQUEST,
+				  0xffffe000011c, &data, sizeof(data), 0);
 }
 
 static void finish_session(struct snd_dg00x *dg00x)
 {
 	__be32 data = cpu_to_be32(0x00000003);
 
-	snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+	snd_fw_transaction_counted(&dg00x->transaction_stats,
+			   TCODE_WRITE_QUADLET_REQUEST,
 			   DG00X_ADDR_BASE + DG00X_OFFSET_STREAMING_SET,
 			   &data, sizeof(data), 0);
 }
 
+struct session_transition {
+	struct snd_dg00x *dg00x;
+	u32 state;
+};
+
+static int check_streaming_state(void *private_data)
+{
+	struct session_transition *t = private_data;
+	__be32 data;
+	int err;
+
+	err = snd_fw_transaction_counted(&t->dg00x->transaction_stats,
+				 TCODE_READ_QUADLET_REQUEST,
+				 DG00X_ADDR_BASE + DG00X_OFFSET_STREAMING_STATE,
+				 &data, sizeof(data), 0);
+	if (err < 0)
+		return err;
+
+	return be32_to_cpu(data) == t->state;
+}
+
 static int begin_session(struct snd_dg00x *dg00x)
 {
+	struct session_transition t = {
+		.dg00x = dg00x,
+	};
+	unsigned int elapsed;
 	__be32 data;
 	u32 curr;
 	int err;
 
-	err = snd_fw_transaction(dg00x->unit, TCODE_READ_QUADLET_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_READ_QUADLET_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_STREAMING_STATE,
 				 &data, sizeof(data), 0);
 	if (err < 0)
@@ -161,9 +194,10 @@ static int begin_session(struct snd_dg00x *dg00x)
 		curr = 2;
 
 	curr--;
+	dg00x->transition_ms = 0;
 	while (curr > 0) {
 		data = cpu_to_be32(curr);
-		err = snd_fw_transaction(dg00x->unit,
+		err = snd_fw_transaction_counted(&dg00x->transaction_stats,
 					 TCODE_WRITE_QUADLET_REQUEST,
 					 DG00X_ADDR_BASE +
 					 DG00X_OFFSET_STREAMING_SET,
@@ -171,9 +205,15 @@ static int begin_session(struct snd_dg00x *dg00x)
 		if (err < 0)
 			goto error;
 
-		msleep(20);
+		/* Each step takes 20 msec at the worst. */
+		t.state = curr;
+		snd_fw_wait_transition(check_streaming_state, &t, 20,
+				       &elapsed);
+		dg00x->transition_ms += elapsed;
 		curr--;
 	}
+	dg00x->max_transition_ms = max(dg00x->max_transition_ms,
+				       dg00x->transition_ms);
 
 	err = snd_dg00x_stream_get_clock(dg00x, &curr);
 	if (err < 0)
@@ -190,7 +230,8 @@ static void release_resources(struct snd_dg00x *dg00x)
 	__be32 data = 0;
 
 	/* Unregister isochronous channels for both direction. */
-	snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+	snd_fw_transaction_counted(&dg00x->transaction_stats,
+			   TCODE_WRITE_QUADLET_REQUEST,
 			   DG00X_ADDR_BASE + DG00X_OFFSET_ISOC_CHANNELS,
 			   &data, sizeof(data), 0);
 
@@ -201,6 +242,10 @@ static void release_resources(struct snd_dg00x *dg00x)
 
 static int keep_resources(struct snd_dg00x *dg00x, unsigned int rate)
 {
+	struct fw_iso_resources *resources[] = {
+		&dg00x->rx_resources, &dg00x->tx_resources
+	};
+	unsigned int max_payload_bytes[ARRAY_SIZE(resources)];
 	unsigned int i, c;
 	__be32 data;
 	int err;
@@ -213,28 +258,33 @@ static int keep_resources(struct snd_dg00x *dg00x, unsigned int rate)
 	if (i == SND_DG00X_RATE_COUNT)
 		return -EINVAL;
 
-	/* Keep resources for out-stream. */
 	amdtp_stream_set_parameters(&dg00x->rx_stream, rate,
 				    snd_dg00x_stream_mbla_data_channels[i], 2);
-	err = fw_iso_resources_allocate(&dg00x->rx_resources,
-				amdtp_stream_get_max_payload(&dg00x->rx_stream),
-				fw_parent_device(dg00x->unit)->max_speed);
-	if (err < 0)
-		return err;
-
-	/* Keep resources for in-stream. */
 	amdtp_stream_set_parameters(&dg00x->tx_stream, rate,
 				    snd_dg00x_stream_mbla_data_channels[i], 1);
-	err = fw_iso_resources_allocate(&dg00x->tx_resources,
-				amdtp_stream_get_max_payload(&dg00x->tx_stream),
+
+	/* Keep resources for both direction at once. */
+	max_payload_bytes[0] = amdtp_stream_get_max_payload(&dg00x->rx_stream);
+	max_payload_bytes[1] = amdtp_stream_get_max_payload(&dg00x->tx_stream);
+	err = fw_iso_resources_check(resources, max_payload_bytes,
+				     ARRAY_SIZE(resources),
+				     fw_parent_device(dg00x->unit)->max_speed);
+	if (err < 0) {
+		dev_err(&dg00x->unit->device,
+			"no bandwidth for the streams at %u Hz\n", rate);
+		return err;
+	}
+	err = fw_iso_resources_allocate_batch(resources, max_payload_bytes,
+				ARRAY_SIZE(resources),
 				fw_parent_device(dg00x->unit)->max_speed);
 	if (err < 0)
-		goto error;
+		return err;
 
 	/* Register isochronous channels for both direction. */
 	data = cpu_to_be32((dg00x->tx_resources.channel << 16) |
 			   dg00x->rx_resources.channel);
-	err = snd_fw_transaction(dg00x->unit, TCODE_WRITE_QUADLET_REQUEST,
+	err = snd_fw_transaction_counted(&dg00x->transaction_stats,
+				 TCODE_WRITE_QUADLET_REQUEST,
 				 DG00X_ADDR_BASE + DG00X_OFFSET_ISOC_CHANNELS,
 				 &data, sizeof(data), 0);
 	if (err < 0)
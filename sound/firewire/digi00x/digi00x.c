@@ -73,6 +73,7 @@ static int snd_dg00x_probe(struct fw_unit *unit,
 	dg00x = card->private_data;
 	dg00x->card = card;
 	dg00x->unit = fw_unit_get(unit);
+	snd_fw_transaction_stats_init(&dg00x->transaction_stats, dg00x->unit);
 
 	mutex_init(&dg00x->mutex);
 	spin_lock_init(&dg00x->lock);
@@ -86,6 +87,13 @@ static int snd_dg00x_probe(struct fw_unit *unit,
 	if (err < 0)
 		goto error;
 
+	err = amdtp_stream_add_pcm_meters(&dg00x->rx_stream, card);
+	if (err < 0)
+		goto error;
+	err = amdtp_stream_add_pcm_meters(&dg00x->tx_stream, card);
+	if (err < 0)
+		goto error;
+
 	snd_dg00x_proc_init(dg00x);
 
 	err = snd_dg00x_create_pcm_devices(dg00x);
@@ -126,6 +134,8 @@ static void snd_dg00x_update(struct fw_unit *unit)
 
 	mutex_lock(&dg00x->mutex);
 	snd_dg00x_stream_update_duplex(dg00x);
+	/* The shadows are kept at failure, and refreshed at next bus reset. */
+	snd_dg00x_update_mixer(dg00x);
 	mutex_unlock(&dg00x->mutex);
 }
 
@@ -22,6 +22,7 @@
 /* TODO: remove when merging to upstream. */
 #include "../../../backport.h"
 
+#include <sound/control.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/pcm.h>
@@ -73,6 +74,10 @@
 #define DG00X_MIX_ADAT_8L        (0x88 | DG00X_MIX)
 #define DG00X_MIX_ADAT_8R        (0x8c | DG00X_MIX)
 
+/* the left and right registers of the pairs in the mixer matrix */
+#define DG00X_MIX_PAIRS		18
+#define DG00X_MIX_QUADLETS	(DG00X_MIX_PAIRS * 2)
+
 #define DG00X_MIX_NONE           0x00000000
 #define DG00X_MIX_1_TO_STEREO    0x18000000
 #define DG00X_MIX_1_TO_1         0x20000000
@@ -91,7 +96,6 @@ struct snd_dg00x {
 	struct snd_card *card;
 	struct fw_unit *unit;
 	int card_index;
-	unsigned int clock;
 
 	struct mutex mutex;
 	spinlock_t lock;
@@ -106,11 +110,29 @@ struct snd_dg00x {
 	unsigned int playback_substreams;
 	unsigned int capture_substreams;
 
+	/* the time for the last transition to streaming, and the longest */
+	unsigned int transition_ms;
+	unsigned int max_transition_ms;
+
+	struct snd_fw_transaction_stats transaction_stats;
+
 	/* for uapi */
 	int dev_lock_count;
 	bool dev_lock_changed;
 	wait_queue_head_t hwdep_wait;
 
+	/*
+	 * Shadows of the mixer matrix and the clock registers, for control
+	 * elements. The writers hold the mutex, and the values are protected
+	 * by the spinlock.
+	 */
+	u32 mix[DG00X_MIX_QUADLETS];
+	unsigned int clock;
+	unsigned int optical_mode;
+	struct snd_kcontrol *mix_ctls[DG00X_MIX_PAIRS];
+	struct snd_kcontrol *clock_ctl;
+	struct snd_kcontrol *optical_ctl;
+
 	/* For asynchronous messages. */
 	u32 msg;
 
@@ -215,6 +237,7 @@ void snd_dg00x_proc_init(struct snd_dg00x *dg00x);
 int snd_dg00x_create_pcm_devices(struct snd_dg00x *dg00x);
 
 int snd_dg00x_create_mixer(struct snd_dg00x *dg00x);
+int snd_dg00x_update_mixer(struct snd_dg00x *dg00x);
 
 int snd_dg00x_create_midi_devices(struct snd_dg00x *dg00x);
 
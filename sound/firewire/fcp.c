@@ -5,15 +5,20 @@
  * Licensed under the terms of the GNU General Public License, version 2.
  */
 
+#include <linux/completion.h>
 #include <linux/device.h>
 #include <linux/firewire.h>
 #include <linux/firewire-constants.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/delay.h>
 #include "fcp.h"
 #include "lib.h"
@@ -25,6 +30,18 @@
 #define ERROR_DELAY_MS	5
 #define FCP_TIMEOUT_MS	125
 
+#define AVC_CTYPE_CONTROL	0x00
+#define AVC_CTYPE_STATUS	0x01
+#define AVC_RESPONSE_STABLE	0x0c
+
+/* The maximum number of cached responses per unit. */
+#define AVC_CACHE_ENTRIES	64
+
+static unsigned int avc_cache_ttl_ms = 1000;
+module_param(avc_cache_ttl_ms, uint, 0644);
+MODULE_PARM_DESC(avc_cache_ttl_ms,
+		 "lifetime of cached AV/C status responses in msec, 0 to disable");
+
 int avc_general_set_sig_fmt(struct fw_unit *unit, unsigned int rate,
 			    enum avc_general_plug_dir dir,
 			    unsigned short pid)
@@ -79,9 +96,9 @@ end:
 }
 EXPORT_SYMBOL(avc_general_set_sig_fmt);
 
-int avc_general_get_sig_fmt(struct fw_unit *unit, unsigned int *rate,
-			    enum avc_general_plug_dir dir,
-			    unsigned short pid)
+static int get_sig_fmt(struct fw_unit *unit, unsigned int *rate,
+		       enum avc_general_plug_dir dir, unsigned short pid,
+		       bool cached)
 {
 	unsigned int sfc;
 	u8 *buf;
@@ -104,8 +121,12 @@ int avc_general_get_sig_fmt(struct fw_unit *unit, unsigned int *rate,
 	buf[7] = 0xff;		/* FDF-low. AM824, SYT lo (not used) */
 
 	/* do transaction and check buf[1-4] are the same against command */
-	err = fcp_avc_transaction(unit, buf, 8, buf, 8,
-				  BIT(1) | BIT(2) | BIT(3) | BIT(4));
+	if (cached)
+		err = fcp_avc_transaction(unit, buf, 8, buf, 8,
+					  BIT(1) | BIT(2) | BIT(3) | BIT(4));
+	else
+		err = fcp_avc_transaction_uncached(unit, buf, 8, buf, 8,
+					BIT(1) | BIT(2) | BIT(3) | BIT(4));
 	if (err >= 0 && err < 8)
 		err = -EIO;
 	else if (buf[0] == 0x08) /* NOT IMPLEMENTED */
@@ -130,8 +151,27 @@ end:
 	kfree(buf);
 	return err;
 }
+
+int avc_general_get_sig_fmt(struct fw_unit *unit, unsigned int *rate,
+			    enum avc_general_plug_dir dir,
+			    unsigned short pid)
+{
+	return get_sig_fmt(unit, rate, dir, pid, true);
+}
 EXPORT_SYMBOL(avc_general_get_sig_fmt);
 
+/*
+ * The device can answer with the former rate for a while after changing it.
+ * Polling the transition must not be served by, nor fill, the cache.
+ */
+int avc_general_poll_sig_fmt(struct fw_unit *unit, unsigned int *rate,
+			     enum avc_general_plug_dir dir,
+			     unsigned short pid)
+{
+	return get_sig_fmt(unit, rate, dir, pid, false);
+}
+EXPORT_SYMBOL(avc_general_poll_sig_fmt);
+
 int avc_general_get_plug_info(struct fw_unit *unit, unsigned int subunit_type,
 			      unsigned int subunit_id, unsigned int subfunction,
 			      u8 info[AVC_PLUG_INFO_BUF_BYTES])
@@ -177,8 +217,27 @@ end:
 }
 EXPORT_SYMBOL(avc_general_get_plug_info);
 
-static DEFINE_SPINLOCK(transactions_lock);
-static LIST_HEAD(transactions);
+/*
+ * Pending transactions are hashed by the card, the node ID of the target and
+ * the subunit/opcode bytes of the expected response. fcp_response() then walks
+ * only the transactions which can match, and responses from different units
+ * don't contend for one lock. Transactions which don't match on both of these
+ * bytes are hashed with FCP_KEY_ANY.
+ *
+ * Transactions of one unit can be pending at the same time as long as their
+ * response match bytes differ. Otherwise the responses can't be told apart,
+ * thus the later transaction waits in its bucket till the former finishes.
+ */
+#define FCP_HASH_BITS	6
+#define FCP_HASH_SIZE	(1 << FCP_HASH_BITS)
+#define FCP_KEY_ANY	0x10000
+
+struct fcp_bucket {
+	spinlock_t lock;
+	struct list_head transactions;
+	wait_queue_head_t wait;
+};
+static struct fcp_bucket fcp_buckets[FCP_HASH_SIZE];
 
 enum fcp_state {
 	STATE_PENDING,
@@ -189,6 +248,7 @@ enum fcp_state {
 
 struct fcp_transaction {
 	struct list_head list;
+	struct fcp_bucket *bucket;
 	struct fw_unit *unit;
 	void *response_buffer;
 	unsigned int response_size;
@@ -198,36 +258,120 @@ struct fcp_transaction {
 	bool deferrable;
 };
 
-/**
- * fcp_avc_transaction - send an AV/C command and wait for its response
- * @unit: a unit on the target device
- * @command: a buffer containing the command frame; must be DMA-able
- * @command_size: the size of @command
- * @response: a buffer for the response frame
- * @response_size: the maximum size of @response
- * @response_match_bytes: a bitmap specifying the bytes used to detect the
- *                        correct response frame
- *
- * This function sends a FCP command frame to the target and waits for the
- * corresponding response frame to be returned.
- *
- * Because it is possible for multiple FCP transactions to be active at the
- * same time, the correct response frame is detected by the value of certain
- * bytes.  These bytes must be set in @response before calling this function,
- * and the corresponding bits must be set in @response_match_bytes.
- *
- * @command and @response can point to the same buffer.
- *
- * Returns the actual size of the response frame, or a negative error code.
+static struct fcp_bucket *fcp_bucket(struct fw_card *card, int node_id,
+				     unsigned int key)
+{
+	u32 hash = jhash_3words((u32)(unsigned long)card, node_id, key, 0);
+
+	return &fcp_buckets[hash & (FCP_HASH_SIZE - 1)];
+}
+
+static unsigned int transaction_key(struct fcp_transaction *t)
+{
+	const u8 *buf = t->response_buffer;
+
+	if ((t->response_match_bytes & (BIT(1) | BIT(2))) !=
+							(BIT(1) | BIT(2)))
+		return FCP_KEY_ANY;
+
+	return (buf[1] << 8) | buf[2];
+}
+
+/* checks whether both transactions wait for the same response */
+static bool is_same_match(struct fcp_transaction *t1,
+			  struct fcp_transaction *t2)
+{
+	const u8 *p1, *p2;
+	unsigned int mask, i;
+
+	if (t1->unit != t2->unit ||
+	    t1->response_match_bytes != t2->response_match_bytes)
+		return false;
+
+	p1 = t1->response_buffer;
+	p2 = t2->response_buffer;
+	mask = t1->response_match_bytes;
+
+	for (i = 0; mask; ++i, mask >>= 1) {
+		if ((mask & 1) && p1[i] != p2[i])
+			return false;
+	}
+
+	return true;
+}
+
+static bool transaction_try_add(struct fcp_bucket *bucket,
+				struct fcp_transaction *t)
+{
+	struct fcp_transaction *pending;
+
+	spin_lock_irq(&bucket->lock);
+	list_for_each_entry(pending, &bucket->transactions, list) {
+		if (pending->state != STATE_COMPLETE &&
+		    is_same_match(t, pending)) {
+			spin_unlock_irq(&bucket->lock);
+			return false;
+		}
+	}
+	list_add_tail(&t->list, &bucket->transactions);
+	t->bucket = bucket;
+	t->state = STATE_PENDING;
+	spin_unlock_irq(&bucket->lock);
+
+	return true;
+}
+
+static void transaction_dequeue(struct fcp_transaction *t)
+{
+	struct fcp_bucket *bucket = t->bucket;
+
+	spin_lock_irq(&bucket->lock);
+	list_del(&t->list);
+	spin_unlock_irq(&bucket->lock);
+	t->bucket = NULL;
+
+	wake_up(&bucket->wait);
+}
+
+/*
+ * The node ID can change at bus reset, thus the transaction is hashed again
+ * before each command frame is sent. A transaction which moves to another
+ * bucket is added to it like a new one, so that it doesn't wait for the same
+ * response as one which is already pending there.
  */
-int fcp_avc_transaction(struct fw_unit *unit,
-			const void *command, unsigned int command_size,
-			void *response, unsigned int response_size,
-			unsigned int response_match_bytes)
+static void transaction_queue(struct fcp_transaction *t)
+{
+	struct fw_device *device = fw_parent_device(t->unit);
+	struct fcp_bucket *bucket;
+	int node_id;
+
+	node_id = ACCESS_ONCE(device->node_id);
+	bucket = fcp_bucket(device->card, node_id, transaction_key(t));
+
+	if (t->bucket != NULL && t->bucket != bucket)
+		transaction_dequeue(t);
+
+	if (t->bucket == NULL) {
+		wait_event(bucket->wait, transaction_try_add(bucket, t));
+		return;
+	}
+
+	spin_lock_irq(&bucket->lock);
+	t->state = STATE_PENDING;
+	spin_unlock_irq(&bucket->lock);
+}
+
+static int avc_transaction_run(struct fw_unit *unit,
+			       struct snd_fw_transaction_stats *stats,
+			       const void *command, unsigned int command_size,
+			       void *response, unsigned int response_size,
+			       unsigned int response_match_bytes)
 {
 	struct fcp_transaction t;
+	unsigned int resets = 0;
 	int tcode, ret, tries = 0;
 
+	t.bucket = NULL;
 	t.unit = unit;
 	t.response_buffer = response;
 	t.response_size = response_size;
@@ -235,19 +379,22 @@ int fcp_avc_transaction(struct fw_unit *unit,
 	t.state = STATE_PENDING;
 	init_waitqueue_head(&t.wait);
 
-	if (*(const u8 *)command == 0x00 || *(const u8 *)command == 0x03)
-		t.deferrable = true;
-
-	spin_lock_irq(&transactions_lock);
-	list_add_tail(&t.list, &transactions);
-	spin_unlock_irq(&transactions_lock);
+	t.deferrable = *(const u8 *)command == 0x00 ||
+		       *(const u8 *)command == 0x03;
 
 	for (;;) {
+		transaction_queue(&t);
+
 		tcode = command_size == 4 ? TCODE_WRITE_QUADLET_REQUEST
 					  : TCODE_WRITE_BLOCK_REQUEST;
-		ret = snd_fw_transaction(t.unit, tcode,
-					 CSR_REGISTER_BASE + CSR_FCP_COMMAND,
-					 (void *)command, command_size, 0);
+		if (stats != NULL)
+			ret = snd_fw_transaction_counted(stats, tcode,
+					CSR_REGISTER_BASE + CSR_FCP_COMMAND,
+					(void *)command, command_size, 0);
+		else
+			ret = snd_fw_transaction(t.unit, tcode,
+					CSR_REGISTER_BASE + CSR_FCP_COMMAND,
+					(void *)command, command_size, 0);
 		if (ret < 0)
 			break;
 deferred:
@@ -268,7 +415,7 @@ deferred:
 			ret = t.response_size;
 			break;
 		} else if (t.state == STATE_BUS_RESET) {
-			msleep(ERROR_DELAY_MS);
+			msleep(snd_fw_retry_delay_ms(ERROR_DELAY_MS, ++resets));
 		} else if (++tries >= ERROR_RETRIES) {
 			dev_err(&t.unit->device, "FCP command timed out\n");
 			ret = -EIO;
@@ -276,36 +423,475 @@ deferred:
 		}
 	}
 
-	spin_lock_irq(&transactions_lock);
-	list_del(&t.list);
-	spin_unlock_irq(&transactions_lock);
+	transaction_dequeue(&t);
+
+	return ret;
+}
+
+static LIST_HEAD(avc_caches);
+static DEFINE_SPINLOCK(avc_caches_lock);
+
+struct avc_cache_entry {
+	struct list_head list;
+	unsigned long expires;
+	unsigned int command_size;
+	unsigned int response_size;
+	unsigned int length;
+	u8 *command;
+	u8 *response;
+};
+
+/**
+ * fcp_avc_cache_init - register a cache of AV/C status responses for a unit
+ * @cache: the cache to initialize
+ * @unit: the unit whose responses are cached
+ * @stats: the statistics to count the command frames to @unit in, or %NULL
+ *
+ * The responses to STATUS commands of PLUG INFO, INPUT/OUTPUT PLUG SIGNAL
+ * FORMAT, STREAM FORMAT SUPPORT and EXTENDED STREAM FORMAT INFORMATION are
+ * kept for avc_cache_ttl_ms. The whole cache is invalidated by any CONTROL
+ * command to the unit, because it can change the state of plugs (i.e. a
+ * selector for clock source changes the signal format), and by
+ * fcp_bus_reset(). A driver which polls a state until it changes uses
+ * fcp_avc_transaction_uncached() instead.
+ */
+void fcp_avc_cache_init(struct fcp_avc_cache *cache, struct fw_unit *unit,
+			struct snd_fw_transaction_stats *stats)
+{
+	cache->unit = unit;
+	cache->stats = stats;
+	kref_init(&cache->kref);
+	init_completion(&cache->released);
+	mutex_init(&cache->mutex);
+	INIT_LIST_HEAD(&cache->entries);
+	cache->count = 0;
+	cache->generation = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+
+	spin_lock_irq(&avc_caches_lock);
+	list_add_tail(&cache->list, &avc_caches);
+	spin_unlock_irq(&avc_caches_lock);
+}
+EXPORT_SYMBOL(fcp_avc_cache_init);
+
+static void avc_cache_entry_free(struct fcp_avc_cache *cache,
+				 struct avc_cache_entry *entry)
+{
+	list_del(&entry->list);
+	kfree(entry);
+	cache->count--;
+}
+
+static void avc_cache_flush(struct fcp_avc_cache *cache)
+{
+	struct avc_cache_entry *entry, *next;
+
+	mutex_lock(&cache->mutex);
+	list_for_each_entry_safe(entry, next, &cache->entries, list)
+		avc_cache_entry_free(cache, entry);
+	/* The responses to transactions running now are not stored. */
+	cache->generation++;
+	mutex_unlock(&cache->mutex);
+}
+
+static void avc_cache_release(struct kref *kref)
+{
+	struct fcp_avc_cache *cache =
+			container_of(kref, struct fcp_avc_cache, kref);
+
+	complete(&cache->released);
+}
+
+/**
+ * fcp_avc_cache_destroy - unregister the cache and release its entries
+ * @cache: the cache no longer needed
+ */
+void fcp_avc_cache_destroy(struct fcp_avc_cache *cache)
+{
+	spin_lock_irq(&avc_caches_lock);
+	list_del(&cache->list);
+	spin_unlock_irq(&avc_caches_lock);
+
+	/* Wait for the transactions which found the cache. */
+	kref_put(&cache->kref, avc_cache_release);
+	wait_for_completion(&cache->released);
+
+	avc_cache_flush(cache);
+	mutex_destroy(&cache->mutex);
+}
+EXPORT_SYMBOL(fcp_avc_cache_destroy);
+
+/* The reference to the cache should be released by avc_cache_put(). */
+static struct fcp_avc_cache *avc_cache_find(struct fw_unit *unit)
+{
+	struct fcp_avc_cache *cache;
+
+	spin_lock_irq(&avc_caches_lock);
+	list_for_each_entry(cache, &avc_caches, list) {
+		if (cache->unit == unit) {
+			kref_get(&cache->kref);
+			spin_unlock_irq(&avc_caches_lock);
+			return cache;
+		}
+	}
+	spin_unlock_irq(&avc_caches_lock);
+
+	return NULL;
+}
+
+static void avc_cache_put(struct fcp_avc_cache *cache)
+{
+	kref_put(&cache->kref, avc_cache_release);
+}
+
+static bool avc_is_cacheable(const u8 *command, unsigned int command_size)
+{
+	if (command_size < 3 || command[0] != AVC_CTYPE_STATUS)
+		return false;
+
+	switch (command[2]) {
+	case 0x02:	/* PLUG INFO */
+	case 0x18:	/* OUTPUT PLUG SIGNAL FORMAT */
+	case 0x19:	/* INPUT PLUG SIGNAL FORMAT */
+	case 0x2f:	/* STREAM FORMAT SUPPORT */
+	case 0xbf:	/* EXTENDED STREAM FORMAT INFORMATION */
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * The generation of the cache is returned in @generation for a miss, to be
+ * passed to avc_cache_store().
+ */
+static int avc_cache_lookup(struct fcp_avc_cache *cache,
+			    const void *command, unsigned int command_size,
+			    void *response, unsigned int response_size,
+			    unsigned int *generation)
+{
+	struct avc_cache_entry *entry, *next;
+	int length = -ENOENT;
+
+	mutex_lock(&cache->mutex);
+	list_for_each_entry_safe(entry, next, &cache->entries, list) {
+		if (time_after(jiffies, entry->expires)) {
+			avc_cache_entry_free(cache, entry);
+			continue;
+		}
+		if (entry->command_size == command_size &&
+		    entry->response_size == response_size &&
+		    memcmp(entry->command, command, command_size) == 0) {
+			memcpy(response, entry->response, entry->length);
+			length = entry->length;
+			break;
+		}
+	}
+	if (length < 0)
+		cache->misses++;
+	else
+		cache->hits++;
+	*generation = cache->generation;
+	mutex_unlock(&cache->mutex);
+
+	return length;
+}
+
+static void avc_cache_store(struct fcp_avc_cache *cache,
+			    const void *command, unsigned int command_size,
+			    const void *response, unsigned int response_size,
+			    unsigned int length, unsigned int generation)
+{
+	struct avc_cache_entry *entry;
+
+	entry = kmalloc(sizeof(*entry) + command_size + length, GFP_KERNEL);
+	if (entry == NULL)
+		return;
+
+	entry->expires = jiffies + msecs_to_jiffies(avc_cache_ttl_ms);
+	entry->command_size = command_size;
+	entry->response_size = response_size;
+	entry->length = length;
+	entry->command = (u8 *)(entry + 1);
+	entry->response = entry->command + command_size;
+	memcpy(entry->command, command, command_size);
+	memcpy(entry->response, response, length);
+
+	mutex_lock(&cache->mutex);
+	/* The cache was flushed while the transaction was running. */
+	if (cache->generation != generation) {
+		mutex_unlock(&cache->mutex);
+		kfree(entry);
+		return;
+	}
+	if (cache->count >= AVC_CACHE_ENTRIES)
+		avc_cache_entry_free(cache,
+				     list_first_entry(&cache->entries,
+						      struct avc_cache_entry,
+						      list));
+	list_add_tail(&entry->list, &cache->entries);
+	cache->count++;
+	mutex_unlock(&cache->mutex);
+}
+
+/**
+ * fcp_avc_transaction - send an AV/C command and wait for its response
+ * @unit: a unit on the target device
+ * @command: a buffer containing the command frame; must be DMA-able
+ * @command_size: the size of @command
+ * @response: a buffer for the response frame
+ * @response_size: the maximum size of @response
+ * @response_match_bytes: a bitmap specifying the bytes used to detect the
+ *                        correct response frame
+ *
+ * This function sends a FCP command frame to the target and waits for the
+ * corresponding response frame to be returned.
+ *
+ * Because it is possible for multiple FCP transactions to be active at the
+ * same time, the correct response frame is detected by the value of certain
+ * bytes.  These bytes must be set in @response before calling this function,
+ * and the corresponding bits must be set in @response_match_bytes.
+ *
+ * @command and @response can point to the same buffer.
+ *
+ * When a cache is registered for @unit, STATUS commands about plugs and stream
+ * formats can be answered from it without bus transactions, and the command
+ * frames are counted in the statistics of the cache. See fcp_avc_cache_init().
+ *
+ * Returns the actual size of the response frame, or a negative error code.
+ */
+int fcp_avc_transaction(struct fw_unit *unit,
+			const void *command, unsigned int command_size,
+			void *response, unsigned int response_size,
+			unsigned int response_match_bytes)
+{
+	struct fcp_avc_cache *cache;
+	unsigned int generation;
+	void *copy = NULL;
+	int ret;
+
+	cache = avc_cache_find(unit);
+	if (cache == NULL)
+		return avc_transaction_run(unit, NULL, command, command_size,
+					   response, response_size,
+					   response_match_bytes);
+
+	if (*(const u8 *)command == AVC_CTYPE_CONTROL) {
+		ret = avc_transaction_run(unit, cache->stats,
+					  command, command_size,
+					  response, response_size,
+					  response_match_bytes);
+		avc_cache_flush(cache);
+		goto end;
+	}
+
+	if (avc_cache_ttl_ms == 0 ||
+	    !avc_is_cacheable(command, command_size)) {
+		ret = avc_transaction_run(unit, cache->stats,
+					  command, command_size,
+					  response, response_size,
+					  response_match_bytes);
+		goto end;
+	}
+
+	ret = avc_cache_lookup(cache, command, command_size,
+			       response, response_size, &generation);
+	if (ret >= 0)
+		goto end;
+
+	/* The response overwrites the command when they share the buffer. */
+	if (command == response) {
+		copy = kmemdup(command, command_size, GFP_KERNEL);
+		if (copy == NULL) {
+			ret = -ENOMEM;
+			goto end;
+		}
+		command = copy;
+	}
+
+	ret = avc_transaction_run(unit, cache->stats, command, command_size,
+				  response, response_size,
+				  response_match_bytes);
+	if (ret > 0 && *(const u8 *)response == AVC_RESPONSE_STABLE)
+		avc_cache_store(cache, command, command_size,
+				response, response_size, ret, generation);
 
+	kfree(copy);
+end:
+	avc_cache_put(cache);
 	return ret;
 }
 EXPORT_SYMBOL(fcp_avc_transaction);
 
+/**
+ * fcp_avc_transaction_uncached - send an AV/C command bypassing the cache
+ * @unit: a unit on the target device
+ * @command: a buffer containing the command frame; must be DMA-able
+ * @command_size: the size of @command
+ * @response: a buffer for the response frame
+ * @response_size: the maximum size of @response
+ * @response_match_bytes: a bitmap specifying the bytes used to detect the
+ *                        correct response frame
+ *
+ * The same as fcp_avc_transaction(), except that a STATUS command is always
+ * sent to the device and its response is not stored in the cache.
+ *
+ * Returns the actual size of the response frame, or a negative error code.
+ */
+int fcp_avc_transaction_uncached(struct fw_unit *unit,
+				 const void *command, unsigned int command_size,
+				 void *response, unsigned int response_size,
+				 unsigned int response_match_bytes)
+{
+	struct fcp_avc_cache *cache;
+	int ret;
+
+	if (*(const u8 *)command != AVC_CTYPE_STATUS)
+		return fcp_avc_transaction(unit, command, command_size,
+					   response, response_size,
+					   response_match_bytes);
+
+	/* The cache is still referred to for the statistics. */
+	cache = avc_cache_find(unit);
+	if (cache == NULL)
+		return avc_transaction_run(unit, NULL, command, command_size,
+					   response, response_size,
+					   response_match_bytes);
+
+	ret = avc_transaction_run(unit, cache->stats, command, command_size,
+				  response, response_size,
+				  response_match_bytes);
+	avc_cache_put(cache);
+	return ret;
+}
+EXPORT_SYMBOL(fcp_avc_transaction_uncached);
+
+static struct workqueue_struct *fcp_wq;
+
+struct fcp_avc_batch {
+	atomic_t pending;
+	struct completion done;
+};
+
+static void avc_request_work(struct work_struct *work)
+{
+	struct fcp_avc_request *r =
+			container_of(work, struct fcp_avc_request, work);
+	struct fcp_avc_batch *batch = r->batch;
+
+	r->result = fcp_avc_transaction(r->unit,
+					r->command, r->command_size,
+					r->response, r->response_size,
+					r->response_match_bytes);
+
+	/* The callback can release the request. */
+	if (r->callback)
+		r->callback(r);
+
+	if (batch && atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+static void avc_request_queue(struct fcp_avc_request *r,
+			      struct fcp_avc_batch *batch)
+{
+	r->batch = batch;
+	INIT_WORK(&r->work, avc_request_work);
+	queue_work(fcp_wq, &r->work);
+}
+
+/**
+ * fcp_avc_submit - send an AV/C command without waiting for its response
+ * @r: the request, filled as the arguments of fcp_avc_transaction()
+ *
+ * This function queues the request and returns immediately. The transaction
+ * runs in process context and @r->callback is called with @r->result set to
+ * the value fcp_avc_transaction() would return. Until the callback is called,
+ * @r and its buffers must stay available.
+ *
+ * Several requests to one unit are processed at the same time if their
+ * response match bytes differ, otherwise one after another.
+ */
+void fcp_avc_submit(struct fcp_avc_request *r)
+{
+	avc_request_queue(r, NULL);
+}
+EXPORT_SYMBOL(fcp_avc_submit);
+
+/**
+ * fcp_avc_transaction_batch - send AV/C commands and wait for all responses
+ * @requests: an array of requests
+ * @count: the number of elements in @requests
+ *
+ * This function submits all of the requests with fcp_avc_submit() and waits
+ * for their completion, so that round trips to the device overlap. The result
+ * of each transaction is in ->result of each request.
+ *
+ * Returns zero when all of the transactions succeeded, or the first negative
+ * error code in @requests.
+ */
+int fcp_avc_transaction_batch(struct fcp_avc_request *requests,
+			      unsigned int count)
+{
+	struct fcp_avc_batch batch;
+	unsigned int i;
+
+	if (count == 0)
+		return 0;
+
+	atomic_set(&batch.pending, count);
+	init_completion(&batch.done);
+
+	for (i = 0; i < count; i++)
+		avc_request_queue(&requests[i], &batch);
+
+	wait_for_completion(&batch.done);
+
+	for (i = 0; i < count; i++) {
+		if (requests[i].result < 0)
+			return requests[i].result;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(fcp_avc_transaction_batch);
+
 /**
  * fcp_bus_reset - inform the target handler about a bus reset
  * @unit: the unit that might be used by fcp_avc_transaction()
  *
  * This function must be called from the driver's .update handler to inform
  * the FCP transaction handler that a bus reset has happened.  Any pending FCP
- * transactions are retried.
+ * transactions are retried, and cached responses for the unit are dropped.
  */
 void fcp_bus_reset(struct fw_unit *unit)
 {
+	struct fcp_avc_cache *cache;
+	struct fcp_bucket *bucket;
 	struct fcp_transaction *t;
+	unsigned int i;
 
-	spin_lock_irq(&transactions_lock);
-	list_for_each_entry(t, &transactions, list) {
-		if (t->unit == unit &&
-		    (t->state == STATE_PENDING ||
-		     t->state == STATE_DEFERRED)) {
-			t->state = STATE_BUS_RESET;
-			wake_up(&t->wait);
+	cache = avc_cache_find(unit);
+	if (cache != NULL) {
+		avc_cache_flush(cache);
+		avc_cache_put(cache);
+	}
+
+	/* The transactions of the unit can be in any bucket. */
+	for (i = 0; i < FCP_HASH_SIZE; i++) {
+		bucket = &fcp_buckets[i];
+		spin_lock_irq(&bucket->lock);
+		list_for_each_entry(t, &bucket->transactions, list) {
+			if (t->unit == unit &&
+			    (t->state == STATE_PENDING ||
+			     t->state == STATE_DEFERRED)) {
+				t->state = STATE_BUS_RESET;
+				wake_up(&t->wait);
+			}
 		}
+		spin_unlock_irq(&bucket->lock);
 	}
-	spin_unlock_irq(&transactions_lock);
 }
 EXPORT_SYMBOL(fcp_bus_reset);
 
@@ -331,19 +917,15 @@ static bool is_matching_response(struct fcp_transaction *transaction,
 	}
 }
 
-static void fcp_response(struct fw_card *card, struct fw_request *request,
-			 int tcode, int destination, int source,
-			 int generation, unsigned long long offset,
-			 void *data, size_t length, void *callback_data)
+static void handle_response(struct fcp_bucket *bucket, struct fw_card *card,
+			    int source, int generation,
+			    void *data, size_t length)
 {
 	struct fcp_transaction *t;
 	unsigned long flags;
 
-	if (length < 1 || (*(const u8 *)data & 0xf0) != CTS_AVC)
-		return;
-
-	spin_lock_irqsave(&transactions_lock, flags);
-	list_for_each_entry(t, &transactions, list) {
+	spin_lock_irqsave(&bucket->lock, flags);
+	list_for_each_entry(t, &bucket->transactions, list) {
 		struct fw_device *device = fw_parent_device(t->unit);
 		if (device->card != card ||
 		    device->generation != generation)
@@ -366,7 +948,28 @@ static void fcp_response(struct fw_card *card, struct fw_request *request,
 			wake_up(&t->wait);
 		}
 	}
-	spin_unlock_irqrestore(&transactions_lock, flags);
+	spin_unlock_irqrestore(&bucket->lock, flags);
+}
+
+static void fcp_response(struct fw_card *card, struct fw_request *request,
+			 int tcode, int destination, int source,
+			 int generation, unsigned long long offset,
+			 void *data, size_t length, void *callback_data)
+{
+	const u8 *frame = data;
+	struct fcp_bucket *bucket, *any;
+
+	if (length < 1 || (frame[0] & 0xf0) != CTS_AVC)
+		return;
+
+	any = fcp_bucket(card, source, FCP_KEY_ANY);
+	if (length >= 3) {
+		bucket = fcp_bucket(card, source, (frame[1] << 8) | frame[2]);
+		if (bucket != any)
+			handle_response(bucket, card, source, generation,
+					data, length);
+	}
+	handle_response(any, card, source, generation, data, length);
 }
 
 static struct fw_address_handler response_register_handler = {
@@ -374,12 +977,24 @@ static struct fw_address_handler response_register_handler = {
 	.address_callback = fcp_response,
 };
 
-static int __init fcp_module_init(void)
+/* This is called at loading the module. */
+int __init snd_fw_fcp_init(void)
 {
 	static const struct fw_address_region response_register_region = {
 		.start = CSR_REGISTER_BASE + CSR_FCP_RESPONSE,
 		.end = CSR_REGISTER_BASE + CSR_FCP_END,
 	};
+	unsigned int i;
+
+	for (i = 0; i < FCP_HASH_SIZE; i++) {
+		spin_lock_init(&fcp_buckets[i].lock);
+		INIT_LIST_HEAD(&fcp_buckets[i].transactions);
+		init_waitqueue_head(&fcp_buckets[i].wait);
+	}
+
+	fcp_wq = alloc_workqueue("snd-firewire-fcp", WQ_UNBOUND, 0);
+	if (fcp_wq == NULL)
+		return -ENOMEM;
 
 	fw_core_add_address_handler(&response_register_handler,
 				    &response_register_region);
@@ -387,11 +1002,14 @@ static int __init fcp_module_init(void)
 	return 0;
 }
 
-static void __exit fcp_module_exit(void)
+/* This is called at unloading the module. */
+void snd_fw_fcp_exit(void)
 {
-	WARN_ON(!list_empty(&transactions));
+	unsigned int i;
+
+	destroy_workqueue(fcp_wq);
+
+	for (i = 0; i < FCP_HASH_SIZE; i++)
+		WARN_ON(!list_empty(&fcp_buckets[i].transactions));
 	fw_core_remove_address_handler(&response_register_handler);
 }
-
-module_init(fcp_module_init);
-module_exit(fcp_module_exit);
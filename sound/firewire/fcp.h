@@ -1,9 +1,17 @@
 #ifndef SOUND_FIREWIRE_FCP_H_INCLUDED
 #define SOUND_FIREWIRE_FCP_H_INCLUDED
 
+#include <linux/completion.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+
 #define	AVC_PLUG_INFO_BUF_BYTES	4
 
 struct fw_unit;
+struct fcp_avc_batch;
+struct snd_fw_transaction_stats;
 
 /*
  * AV/C Digital Interface Command Set General Specification 4.2
@@ -20,6 +28,9 @@ int avc_general_set_sig_fmt(struct fw_unit *unit, unsigned int rate,
 int avc_general_get_sig_fmt(struct fw_unit *unit, unsigned int *rate,
 			    enum avc_general_plug_dir dir,
 			    unsigned short plug);
+int avc_general_poll_sig_fmt(struct fw_unit *unit, unsigned int *rate,
+			     enum avc_general_plug_dir dir,
+			     unsigned short plug);
 int avc_general_get_plug_info(struct fw_unit *unit, unsigned int subunit_type,
 			      unsigned int subunit_id, unsigned int subfunction,
 			      u8 info[AVC_PLUG_INFO_BUF_BYTES]);
@@ -28,6 +39,70 @@ int fcp_avc_transaction(struct fw_unit *unit,
 			const void *command, unsigned int command_size,
 			void *response, unsigned int response_size,
 			unsigned int response_match_bytes);
+int fcp_avc_transaction_uncached(struct fw_unit *unit,
+				 const void *command, unsigned int command_size,
+				 void *response, unsigned int response_size,
+				 unsigned int response_match_bytes);
 void fcp_bus_reset(struct fw_unit *unit);
 
+/**
+ * struct fcp_avc_cache - caches AV/C status responses of a unit
+ * @hits: the number of commands answered from the cache
+ * @misses: the number of cacheable commands sent to the unit
+ */
+struct fcp_avc_cache {
+	unsigned long hits;
+	unsigned long misses;
+	/* private: */
+	struct list_head list;
+	struct fw_unit *unit;
+	struct snd_fw_transaction_stats *stats;
+	struct kref kref;
+	struct completion released;
+	struct mutex mutex;
+	struct list_head entries;
+	unsigned int count;
+	unsigned int generation;
+};
+
+void fcp_avc_cache_init(struct fcp_avc_cache *cache, struct fw_unit *unit,
+			struct snd_fw_transaction_stats *stats);
+void fcp_avc_cache_destroy(struct fcp_avc_cache *cache);
+
+/**
+ * struct fcp_avc_request - an AV/C command sent asynchronously
+ * @unit: a unit on the target device
+ * @command: a buffer containing the command frame; must be DMA-able
+ * @command_size: the size of @command
+ * @response: a buffer for the response frame
+ * @response_size: the maximum size of @response
+ * @response_match_bytes: a bitmap specifying the bytes used to detect the
+ *                        correct response frame
+ * @callback: called in process context when the transaction finishes, or NULL
+ * @private_data: for the use of the caller
+ * @result: the actual size of the response frame, or a negative error code
+ */
+struct fcp_avc_request {
+	struct fw_unit *unit;
+	const void *command;
+	unsigned int command_size;
+	void *response;
+	unsigned int response_size;
+	unsigned int response_match_bytes;
+	void (*callback)(struct fcp_avc_request *r);
+	void *private_data;
+	int result;
+	/* private: */
+	struct work_struct work;
+	struct fcp_avc_batch *batch;
+};
+
+void fcp_avc_submit(struct fcp_avc_request *r);
+int fcp_avc_transaction_batch(struct fcp_avc_request *requests,
+			      unsigned int count);
+
+/* for the module init and exit of snd-firewire-lib */
+int snd_fw_fcp_init(void);
+void snd_fw_fcp_exit(void);
+
 #endif
@@ -35,7 +35,7 @@ module_param_array(enable, bool, NULL, 0444);
 MODULE_PARM_DESC(enable, "enable Fireworks sound card");
 module_param_named(resp_buf_size, snd_efw_resp_buf_size, uint, 0444);
 MODULE_PARM_DESC(resp_buf_size,
-		 "response buffer size (max 4096, default 1024)");
+		 "response buffer size, rounded up to power-of-two pages (default 1024)");
 module_param_named(resp_buf_debug, snd_efw_resp_buf_debug, bool, 0444);
 MODULE_PARM_DESC(resp_buf_debug, "store all responses to buffer");
 
@@ -173,6 +173,56 @@ end:
 	return err;
 }
 
+/* Physical output meters, followed by physical input meters. */
+static int
+get_meters(void *private_data, u32 *values, unsigned int channels)
+{
+	struct snd_efw *efw = private_data;
+	struct snd_efw_phys_meters *meters;
+	unsigned int outs, ins, size;
+	int err;
+
+	size = sizeof(struct snd_efw_phys_meters) + channels * sizeof(u32);
+	meters = kzalloc(size, GFP_KERNEL);
+	if (meters == NULL)
+		return -ENOMEM;
+
+	err = snd_efw_command_get_phys_meters(efw, meters, size);
+	if (err < 0)
+		goto end;
+
+	/* input meters follow all output meters in the response */
+	outs = min(efw->phys_out, meters->out_meters);
+	ins = min3(efw->phys_in, meters->in_meters,
+		   channels - min_t(u32, meters->out_meters, channels));
+
+	memset(values, 0, channels * sizeof(u32));
+	memcpy(values, meters->values, outs * sizeof(u32));
+	memcpy(values + efw->phys_out, meters->values + meters->out_meters,
+	       ins * sizeof(u32));
+end:
+	kfree(meters);
+	return err;
+}
+
+static int
+init_meters(struct snd_efw *efw)
+{
+	int err;
+
+	if (efw->phys_out + efw->phys_in == 0)
+		return 0;
+
+	err = snd_fw_meter_sampler_init(&efw->meter,
+					efw->phys_out + efw->phys_in,
+					get_meters, efw);
+	if (err < 0)
+		return err;
+
+	return snd_fw_meter_sampler_add_control(&efw->meter, efw->card,
+						"Hardware Meter");
+}
+
 /*
  * This module releases the FireWire unit data after all ALSA character devices
  * are released by applications. This is for releasing stream data or finishing
@@ -184,11 +234,12 @@ efw_card_free(struct snd_card *card)
 {
 	struct snd_efw *efw = card->private_data;
 
+	snd_fw_meter_sampler_destroy(&efw->meter);
 	snd_efw_stream_destroy_duplex(efw);
 	snd_efw_transaction_remove_instance(efw);
 	fw_unit_put(efw->unit);
 
-	kfree(efw->resp_buf);
+	snd_efw_resp_ring_free(efw);
 
 	if (efw->card_index >= 0) {
 		mutex_lock(&devices_mutex);
@@ -196,6 +247,7 @@ efw_card_free(struct snd_card *card)
 		mutex_unlock(&devices_mutex);
 	}
 
+	mutex_destroy(&efw->resp_mutex);
 	mutex_destroy(&efw->mutex);
 }
 
@@ -230,19 +282,16 @@ efw_probe(struct fw_unit *unit,
 
 	efw->card = card;
 	efw->unit = fw_unit_get(unit);
+	snd_fw_transaction_stats_init(&efw->transaction_stats, efw->unit);
 	mutex_init(&efw->mutex);
+	mutex_init(&efw->resp_mutex);
 	spin_lock_init(&efw->lock);
 	init_waitqueue_head(&efw->hwdep_wait);
 
 	/* prepare response buffer */
-	snd_efw_resp_buf_size = clamp(snd_efw_resp_buf_size,
-				      SND_EFW_RESPONSE_MAXIMUM_BYTES, 4096U);
-	efw->resp_buf = kzalloc(snd_efw_resp_buf_size, GFP_KERNEL);
-	if (efw->resp_buf == NULL) {
-		err = -ENOMEM;
+	err = snd_efw_resp_ring_resize(efw, snd_efw_resp_buf_size);
+	if (err < 0)
 		goto error;
-	}
-	efw->pull_ptr = efw->push_ptr = efw->resp_buf;
 	snd_efw_transaction_add_instance(efw);
 
 	err = get_hardware_info(efw);
@@ -251,6 +300,10 @@ efw_probe(struct fw_unit *unit,
 	if (entry->model_id == MODEL_ECHO_AUDIOFIRE_9)
 		efw->is_af9 = true;
 
+	err = init_meters(efw);
+	if (err < 0)
+		goto error;
+
 	snd_efw_proc_init(efw);
 
 	if (efw->midi_out_ports || efw->midi_in_ports) {
@@ -271,6 +324,13 @@ efw_probe(struct fw_unit *unit,
 	if (err < 0)
 		goto error;
 
+	err = amdtp_stream_add_pcm_meters(&efw->rx_stream, card);
+	if (err < 0)
+		goto error;
+	err = amdtp_stream_add_pcm_meters(&efw->tx_stream, card);
+	if (err < 0)
+		goto error;
+
 	err = snd_card_register(card);
 	if (err < 0) {
 		snd_efw_stream_destroy_duplex(efw);
@@ -292,7 +352,7 @@ static void efw_update(struct fw_unit *unit)
 {
 	struct snd_efw *efw = dev_get_drvdata(&unit->device);
 
-	snd_efw_transaction_bus_reset(efw->unit);
+	snd_efw_transaction_bus_reset(efw);
 	snd_efw_stream_update_duplex(efw);
 }
 
@@ -16,7 +16,9 @@
 #include <linux/module.h>
 #include <linux/mod_devicetable.h>
 #include <linux/delay.h>
+#include <linux/rculist.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 /* TODO: remove when merging to upstream. */
 #include "../../../backport.h"
@@ -35,6 +37,7 @@
 #include "../amdtp.h"
 #include "../cmp.h"
 #include "../lib.h"
+#include "../meter.h"
 
 #define SND_EFW_MAX_MIDI_OUT_PORTS	2
 #define SND_EFW_MAX_MIDI_IN_PORTS	2
@@ -52,6 +55,12 @@
  */
 #define SND_EFW_RESPONSE_MAXIMUM_BYTES	0x200U
 
+/* pending transactions of the kernel are hashed by sequence number */
+#define SND_EFW_TRANSACTION_SLOTS	8
+
+/* the maximum size of the ring of responses, in a power of two */
+#define SND_EFW_RESP_RING_MAX_BYTES	(256 * 1024)
+
 extern unsigned int snd_efw_resp_buf_size;
 extern bool snd_efw_resp_buf_debug;
 
@@ -71,6 +80,11 @@ struct snd_efw {
 	/* for transaction */
 	u32 seqnum;
 	bool resp_addr_changable;
+	struct hlist_node instance_node;
+	unsigned int instance_bucket;
+	spinlock_t transactions_lock;
+	struct hlist_head transactions[SND_EFW_TRANSACTION_SLOTS];
+	struct snd_fw_transaction_stats transaction_stats;
 
 	/* for quirks */
 	bool is_af9;
@@ -98,27 +112,34 @@ struct snd_efw {
 	unsigned int phys_in_grp_count;
 	struct snd_efw_phys_grp phys_out_grps[HWINFO_MAX_CAPS_GROUPS];
 	struct snd_efw_phys_grp phys_in_grps[HWINFO_MAX_CAPS_GROUPS];
+	struct snd_fw_meter_sampler meter;
 
 	/* for uapi */
 	int dev_lock_count;
 	bool dev_lock_changed;
 	wait_queue_head_t hwdep_wait;
 
-	/* response queue */
+	/* response queue, which userspace can map */
+	struct mutex resp_mutex;
+	struct snd_efw_response_ring *resp_ring;
 	u8 *resp_buf;
-	u8 *pull_ptr;
-	u8 *push_ptr;
-	unsigned int resp_queues;
+	unsigned int resp_buf_size;
+	u32 resp_head;
+	u32 resp_dropped;
+	bool resp_ring_mapped;
 };
 
-int snd_efw_transaction_cmd(struct fw_unit *unit,
+int snd_efw_resp_ring_resize(struct snd_efw *efw, unsigned int size);
+void snd_efw_resp_ring_free(struct snd_efw *efw);
+
+int snd_efw_transaction_cmd(struct snd_efw *efw,
 			    const void *cmd, unsigned int size);
-int snd_efw_transaction_run(struct fw_unit *unit,
+int snd_efw_transaction_run(struct snd_efw *efw,
 			    const void *cmd, unsigned int cmd_size,
 			    void *resp, unsigned int resp_size);
 int snd_efw_transaction_register(void);
 void snd_efw_transaction_unregister(void);
-void snd_efw_transaction_bus_reset(struct fw_unit *unit);
+void snd_efw_transaction_bus_reset(struct snd_efw *efw);
 void snd_efw_transaction_add_instance(struct snd_efw *efw);
 void snd_efw_transaction_remove_instance(struct snd_efw *efw);
 
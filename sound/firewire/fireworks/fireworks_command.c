@@ -142,8 +142,7 @@ efw_transaction(struct snd_efw *efw, unsigned int category,
 	/* fill transaction command parameters */
 	memcpy(header->params, params, param_bytes);
 
-	err = snd_efw_transaction_run(efw->unit, buf, cmd_bytes,
-				      buf, buf_bytes);
+	err = snd_efw_transaction_run(efw, buf, cmd_bytes, buf, buf_bytes);
 	if (err < 0)
 		goto end;
 
@@ -13,18 +13,33 @@
  * 2.get notification about starting/stopping stream
  * 3.lock/unlock streaming
  * 4.transmit command of EFW transaction
- * 5.receive response of EFW transaction
+ * 5.receive response of EFW transaction, by read() or by mmap()
  *
  */
 
 #include "fireworks.h"
 
+static bool
+resp_ring_pending(struct snd_efw *efw)
+{
+	struct snd_efw_response_ring *ring = efw->resp_ring;
+
+	return READ_ONCE(ring->head) != READ_ONCE(ring->tail);
+}
+
+/*
+ * The only consumer of the ring besides a client with the mapping. This runs
+ * without efw->lock; the indices are published with acquire/release pairs.
+ */
 static long
 hwdep_read_resp_buf(struct snd_efw *efw, char __user *buf, long remained,
 		    loff_t *offset)
 {
-	unsigned int length, till_end, type;
+	struct snd_efw_response_ring *ring = efw->resp_ring;
+	unsigned int size = efw->resp_buf_size;
+	unsigned int length, pos, till_end, type;
 	struct snd_efw_transaction *t;
+	u32 head, tail;
 	long count = 0;
 
 	if (remained < sizeof(type) + sizeof(struct snd_efw_transaction))
@@ -37,38 +52,45 @@ hwdep_read_resp_buf(struct snd_efw *efw, char __user *buf, long remained,
 	remained -= sizeof(type);
 	buf += sizeof(type);
 
+	/* pairs with the release by the producer, which stored the data */
+	head = smp_load_acquire(&ring->head);
+	tail = READ_ONCE(ring->tail);
+
 	/* write into buffer as many responses as possible */
-	while (efw->resp_queues > 0) {
-		t = (struct snd_efw_transaction *)(efw->pull_ptr);
-		length = be32_to_cpu(t->length) * sizeof(__be32);
+	while (tail != head) {
+		pos = tail & (size - 1);
+		t = (struct snd_efw_transaction *)(efw->resp_buf + pos);
+		length = be32_to_cpu(READ_ONCE(t->length)) * sizeof(__be32);
+
+		/* the client with the mapping may have broken the tail */
+		if (head - tail > size || length == 0 ||
+		    length > head - tail) {
+			tail = head;
+			break;
+		}
 
 		/* confirm enough space for this response */
 		if (remained < length)
 			break;
 
 		/* copy from ring buffer to user buffer */
-		while (length > 0) {
-			till_end = snd_efw_resp_buf_size -
-				(unsigned int)(efw->pull_ptr - efw->resp_buf);
-			till_end = min_t(unsigned int, length, till_end);
-
-			if (copy_to_user(buf, efw->pull_ptr, till_end))
-				return -EFAULT;
-
-			efw->pull_ptr += till_end;
-			if (efw->pull_ptr >= efw->resp_buf +
-					     snd_efw_resp_buf_size)
-				efw->pull_ptr -= snd_efw_resp_buf_size;
-
-			length -= till_end;
-			buf += till_end;
-			count += till_end;
-			remained -= till_end;
+		till_end = min_t(unsigned int, length, size - pos);
+		if (copy_to_user(buf, efw->resp_buf + pos, till_end) ||
+		    copy_to_user(buf + till_end, efw->resp_buf,
+				 length - till_end)) {
+			count = -EFAULT;
+			break;
 		}
 
-		efw->resp_queues--;
+		tail += length;
+		buf += length;
+		count += length;
+		remained -= length;
 	}
 
+	/* pairs with the acquire by the producer, before it reuses the space */
+	smp_store_release(&ring->tail, tail);
+
 	return count;
 }
 
@@ -101,7 +123,7 @@ hwdep_read(struct snd_hwdep *hwdep, char __user *buf, long count,
 
 	spin_lock_irq(&efw->lock);
 
-	while ((!efw->dev_lock_changed) && (efw->resp_queues == 0)) {
+	while ((!efw->dev_lock_changed) && !resp_ring_pending(efw)) {
 		prepare_to_wait(&efw->hwdep_wait, &wait, TASK_INTERRUPTIBLE);
 		spin_unlock_irq(&efw->lock);
 		schedule();
@@ -111,12 +133,16 @@ hwdep_read(struct snd_hwdep *hwdep, char __user *buf, long count,
 		spin_lock_irq(&efw->lock);
 	}
 
-	if (efw->dev_lock_changed)
+	if (efw->dev_lock_changed) {
 		count = hwdep_read_locked(efw, buf, count, offset);
-	else if (efw->resp_queues > 0)
-		count = hwdep_read_resp_buf(efw, buf, count, offset);
+		spin_unlock_irq(&efw->lock);
+	} else {
+		spin_unlock_irq(&efw->lock);
 
-	spin_unlock_irq(&efw->lock);
+		mutex_lock(&efw->resp_mutex);
+		count = hwdep_read_resp_buf(efw, buf, count, offset);
+		mutex_unlock(&efw->resp_mutex);
+	}
 
 	return count;
 }
@@ -144,7 +170,7 @@ hwdep_write(struct snd_hwdep *hwdep, const char __user *data, long count,
 		goto end;
 	}
 
-	if (snd_efw_transaction_cmd(efw->unit, buf, count) < 0)
+	if (snd_efw_transaction_cmd(efw, buf, count) < 0)
 		count = -EIO;
 end:
 	kfree(buf);
@@ -160,7 +186,7 @@ hwdep_poll(struct snd_hwdep *hwdep, struct file *file, poll_table *wait)
 	poll_wait(file, &efw->hwdep_wait, wait);
 
 	spin_lock_irq(&efw->lock);
-	if (efw->dev_lock_changed || (efw->resp_queues > 0))
+	if (efw->dev_lock_changed || resp_ring_pending(efw))
 		events = POLLIN | POLLRDNORM;
 	else
 		events = 0;
@@ -169,6 +195,48 @@ hwdep_poll(struct snd_hwdep *hwdep, struct file *file, poll_table *wait)
 	return events | POLLOUT;
 }
 
+/*
+ * The first mapping after open() chooses the size of the ring. The mapping
+ * keeps the file open, so the ring stays as it is until hwdep_release().
+ */
+static int
+hwdep_mmap(struct snd_hwdep *hwdep, struct file *file,
+	   struct vm_area_struct *area)
+{
+	struct snd_efw *efw = hwdep->private_data;
+	unsigned long size = area->vm_end - area->vm_start;
+	int err;
+
+	if (area->vm_pgoff != 0 || size <= PAGE_SIZE)
+		return -EINVAL;
+
+	/* check the size before the current ring is replaced */
+	if (!is_power_of_2(size - PAGE_SIZE) ||
+	    size - PAGE_SIZE > SND_EFW_RESP_RING_MAX_BYTES)
+		return -EINVAL;
+
+	mutex_lock(&efw->resp_mutex);
+
+	if (!efw->resp_ring_mapped &&
+	    size - PAGE_SIZE != efw->resp_buf_size) {
+		err = snd_efw_resp_ring_resize(efw, size - PAGE_SIZE);
+		if (err < 0)
+			goto end;
+	}
+
+	if (size != PAGE_SIZE + efw->resp_buf_size) {
+		err = -EINVAL;
+		goto end;
+	}
+
+	err = remap_vmalloc_range(area, efw->resp_ring, 0);
+	if (err >= 0)
+		efw->resp_ring_mapped = true;
+end:
+	mutex_unlock(&efw->resp_mutex);
+	return err;
+}
+
 static int
 hwdep_get_info(struct snd_efw *efw, void __user *arg)
 {
@@ -237,6 +305,10 @@ hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 		efw->dev_lock_count = 0;
 	spin_unlock_irq(&efw->lock);
 
+	mutex_lock(&efw->resp_mutex);
+	efw->resp_ring_mapped = false;
+	mutex_unlock(&efw->resp_mutex);
+
 	return 0;
 }
 
@@ -277,6 +349,7 @@ static const struct snd_hwdep_ops hwdep_ops = {
 	.poll		= hwdep_poll,
 	.ioctl		= hwdep_ioctl,
 	.ioctl_compat	= hwdep_compat_ioctl,
+	.mmap		= hwdep_mmap,
 };
 
 int snd_efw_create_hwdep_device(struct snd_efw *efw)
@@ -129,50 +129,44 @@ proc_read_phys_meters(struct snd_info_entry *entry,
 		      struct snd_info_buffer *buffer)
 {
 	struct snd_efw *efw = entry->private_data;
-	struct snd_efw_phys_meters *meters;
-	unsigned int g, c, m, max, size;
+	unsigned int g, c, m;
 	const char *name;
 	u32 *linear;
-	int err;
 
-	size = sizeof(struct snd_efw_phys_meters) +
-	       (efw->phys_in + efw->phys_out) * sizeof(u32);
-	meters = kzalloc(size, GFP_KERNEL);
-	if (meters == NULL)
+	if (efw->meter.channels == 0)
 		return;
 
-	err = snd_efw_command_get_phys_meters(efw, meters, size);
-	if (err < 0)
+	linear = kcalloc(efw->meter.channels, sizeof(u32), GFP_KERNEL);
+	if (linear == NULL)
+		return;
+
+	if (snd_fw_meter_sampler_read(&efw->meter, linear) < 0)
 		goto end;
 
 	snd_iprintf(buffer, "Physical Meters:\n");
 
 	m = 0;
-	max = min(efw->phys_out, meters->out_meters);
-	linear = meters->values;
-	snd_iprintf(buffer, " %d Outputs:\n", max);
+	snd_iprintf(buffer, " %d Outputs:\n", efw->phys_out);
 	for (g = 0; g < efw->phys_out_grp_count; g++) {
 		name = get_phys_name(&efw->phys_out_grps[g], false);
 		for (c = 0; c < efw->phys_out_grps[g].count; c++) {
-			if (m < max)
+			if (m < efw->phys_out)
 				snd_iprintf(buffer, "\t%s [%d]: %d\n",
 					    name, c, linear[m++]);
 		}
 	}
 
 	m = 0;
-	max = min(efw->phys_in, meters->in_meters);
-	linear = meters->values + meters->out_meters;
-	snd_iprintf(buffer, " %d Inputs:\n", max);
+	snd_iprintf(buffer, " %d Inputs:\n", efw->phys_in);
 	for (g = 0; g < efw->phys_in_grp_count; g++) {
 		name = get_phys_name(&efw->phys_in_grps[g], true);
 		for (c = 0; c < efw->phys_in_grps[g].count; c++)
-			if (m < max)
-				snd_iprintf(buffer, "\t%s [%d]: %d\n",
-					    name, c, linear[m++]);
+			if (m < efw->phys_in)
+				snd_iprintf(buffer, "\t%s [%d]: %d\n", name, c,
+					    linear[efw->phys_out + m++]);
 	}
 end:
-	kfree(meters);
+	kfree(linear);
 }
 
 static void
@@ -180,16 +174,37 @@ proc_read_queues_state(struct snd_info_entry *entry,
 		       struct snd_info_buffer *buffer)
 {
 	struct snd_efw *efw = entry->private_data;
-	unsigned int consumed;
+	u32 head, tail;
 
-	if (efw->pull_ptr > efw->push_ptr)
-		consumed = snd_efw_resp_buf_size -
-			   (unsigned int)(efw->pull_ptr - efw->push_ptr);
-	else
-		consumed = (unsigned int)(efw->push_ptr - efw->pull_ptr);
+	/* the ring may be replaced by mmap() */
+	mutex_lock(&efw->resp_mutex);
+
+	head = READ_ONCE(efw->resp_ring->head);
+	tail = READ_ONCE(efw->resp_ring->tail);
+
+	snd_iprintf(buffer, "%u/%u, dropped %u%s\n",
+		    head - tail, efw->resp_buf_size, efw->resp_dropped,
+		    efw->resp_ring_mapped ? ", mapped" : "");
+
+	mutex_unlock(&efw->resp_mutex);
+}
+
+static void
+proc_read_bandwidth(struct snd_info_entry *entry,
+		    struct snd_info_buffer *buffer)
+{
+	struct snd_efw *efw = entry->private_data;
+
+	fw_iso_resources_dump_plan(efw->unit, buffer);
+}
+
+static void
+proc_read_transactions(struct snd_info_entry *entry,
+		       struct snd_info_buffer *buffer)
+{
+	struct snd_efw *efw = entry->private_data;
 
-	snd_iprintf(buffer, "%d %d/%d\n",
-		    efw->resp_queues, consumed, snd_efw_resp_buf_size);
+	snd_fw_transaction_stats_dump(&efw->transaction_stats, buffer);
 }
 
 static void
@@ -225,8 +240,10 @@ void snd_efw_proc_init(struct snd_efw *efw)
 		return;
 	}
 
+	add_node(efw, root, "bandwidth", proc_read_bandwidth);
 	add_node(efw, root, "clock", proc_read_clock);
 	add_node(efw, root, "firmware", proc_read_hwinfo);
 	add_node(efw, root, "meters", proc_read_phys_meters);
 	add_node(efw, root, "queues", proc_read_queues_state);
+	add_node(efw, root, "transactions", proc_read_transactions);
 }
@@ -27,7 +27,8 @@ init_stream(struct snd_efw *efw, struct amdtp_stream *stream)
 		s_dir = AMDTP_OUT_STREAM;
 	}
 
-	err = cmp_connection_init(conn, efw->unit, c_dir, 0);
+	err = cmp_connection_init(conn, efw->unit, &efw->transaction_stats,
+				  c_dir, 0);
 	if (err < 0)
 		goto end;
 
@@ -52,29 +53,90 @@ stop_stream(struct snd_efw *efw, struct amdtp_stream *stream)
 		cmp_connection_break(&efw->in_conn);
 }
 
+/* The connection is kept for a while to be reused by next start. */
+static void
+release_stream(struct snd_efw *efw, struct amdtp_stream *stream)
+{
+	amdtp_stream_pcm_abort(stream);
+	amdtp_stream_stop(stream);
+
+	if (stream == &efw->tx_stream)
+		cmp_connection_release(&efw->out_conn);
+	else
+		cmp_connection_release(&efw->in_conn);
+}
+
 static int
-start_stream(struct snd_efw *efw, struct amdtp_stream *stream,
-	     unsigned int sampling_rate)
+set_stream_parameters(struct snd_efw *efw, struct amdtp_stream *stream,
+		      unsigned int sampling_rate)
 {
-	struct cmp_connection *conn;
 	unsigned int mode, pcm_channels, midi_ports;
 	int err;
 
 	err = snd_efw_get_multiplier_mode(sampling_rate, &mode);
 	if (err < 0)
-		goto end;
+		return err;
 	if (stream == &efw->tx_stream) {
-		conn = &efw->out_conn;
 		pcm_channels = efw->pcm_capture_channels[mode];
 		midi_ports = efw->midi_out_ports;
 	} else {
-		conn = &efw->in_conn;
 		pcm_channels = efw->pcm_playback_channels[mode];
 		midi_ports = efw->midi_in_ports;
 	}
 
 	amdtp_stream_set_parameters(stream, sampling_rate,
 				    pcm_channels, midi_ports);
+	return 0;
+}
+
+/*
+ * The streams are checked together against the bandwidth left on the bus,
+ * thus the slave can not fail for bandwidth after the master starts.
+ */
+static int
+check_bandwidth(struct snd_efw *efw, struct amdtp_stream **streams,
+		unsigned int count, unsigned int sampling_rate)
+{
+	struct fw_iso_resources *resources[2];
+	unsigned int max_payload_bytes[2];
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < count; i++) {
+		err = set_stream_parameters(efw, streams[i], sampling_rate);
+		if (err < 0)
+			return err;
+		if (streams[i] == &efw->tx_stream)
+			resources[i] = &efw->out_conn.resources;
+		else
+			resources[i] = &efw->in_conn.resources;
+		max_payload_bytes[i] = amdtp_stream_get_max_payload(streams[i]);
+	}
+
+	err = fw_iso_resources_check(resources, max_payload_bytes, count,
+				     fw_parent_device(efw->unit)->max_speed);
+	if (err < 0)
+		dev_err(&efw->unit->device,
+			"no bandwidth for the streams at %u Hz\n",
+			sampling_rate);
+	return err;
+}
+
+static int
+start_stream(struct snd_efw *efw, struct amdtp_stream *stream,
+	     unsigned int sampling_rate)
+{
+	struct cmp_connection *conn;
+	int err;
+
+	if (stream == &efw->tx_stream)
+		conn = &efw->out_conn;
+	else
+		conn = &efw->in_conn;
+
+	err = set_stream_parameters(efw, stream, sampling_rate);
+	if (err < 0)
+		goto end;
 
 	/*  establish connection via CMP */
 	err = cmp_connection_establish(conn,
@@ -115,7 +177,7 @@ destroy_stream(struct snd_efw *efw, struct amdtp_stream *stream)
 		conn = &efw->in_conn;
 
 	amdtp_stream_destroy(stream);
-	cmp_connection_destroy(&efw->out_conn);
+	cmp_connection_destroy(conn);
 }
 
 static int
@@ -198,9 +260,11 @@ end:
 int snd_efw_stream_start_duplex(struct snd_efw *efw, unsigned int rate)
 {
 	struct amdtp_stream *master, *slave;
+	struct amdtp_stream *streams[2];
+	struct cmp_connection *master_conn;
 	atomic_t *slave_substreams;
 	enum cip_flags sync_mode;
-	unsigned int curr_rate;
+	unsigned int curr_rate, count;
 	int err = 0;
 
 	mutex_lock(&efw->mutex);
@@ -215,10 +279,12 @@ int snd_efw_stream_start_duplex(struct snd_efw *efw, unsigned int rate)
 		goto end;
 	if (sync_mode == CIP_SYNC_TO_DEVICE) {
 		master = &efw->tx_stream;
+		master_conn = &efw->out_conn;
 		slave  = &efw->rx_stream;
 		slave_substreams  = &efw->playback_substreams;
 	} else {
 		master = &efw->rx_stream;
+		master_conn = &efw->in_conn;
 		slave  = &efw->tx_stream;
 		slave_substreams = &efw->capture_substreams;
 	}
@@ -253,9 +319,26 @@ int snd_efw_stream_start_duplex(struct snd_efw *efw, unsigned int rate)
 		amdtp_stream_set_sync(sync_mode, master, slave);
 		efw->master = master;
 
-		err = snd_efw_command_set_sampling_rate(efw, rate);
-		if (err < 0)
+		/*
+		 * The connection released at last stop still keeps the device
+		 * at the same rate. Then it is not needed to set it again.
+		 */
+		if (!cmp_connection_reclaim(master_conn)) {
+			err = snd_efw_command_set_sampling_rate(efw, rate);
+			if (err < 0)
+				goto end;
+		}
+
+		streams[0] = master;
+		count = 1;
+		if (atomic_read(slave_substreams) > 0 &&
+		    !amdtp_stream_running(slave))
+			streams[count++] = slave;
+		err = check_bandwidth(efw, streams, count, rate);
+		if (err < 0) {
+			stop_stream(efw, master);
 			goto end;
+		}
 
 		err = start_stream(efw, master, rate);
 		if (err < 0) {
@@ -299,10 +382,10 @@ void snd_efw_stream_stop_duplex(struct snd_efw *efw)
 	mutex_lock(&efw->mutex);
 
 	if (atomic_read(slave_substreams) == 0) {
-		stop_stream(efw, slave);
+		release_stream(efw, slave);
 
 		if (atomic_read(master_substreams) == 0)
-			stop_stream(efw, master);
+			release_stream(efw, master);
 	}
 
 	mutex_unlock(&efw->mutex);
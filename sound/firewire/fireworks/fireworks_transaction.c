@@ -38,11 +38,15 @@
 #define ERROR_DELAY_MS 5
 #define EFC_TIMEOUT_MS 125
 
-static DEFINE_SPINLOCK(instances_lock);
-static struct snd_efw *instances[SNDRV_CARDS] = SNDRV_DEFAULT_PTR;
+/*
+ * Instances are hashed by the physical ID of their node, which is the source
+ * of responses. Writers take instances_lock, the handler of responses reads
+ * under RCU.
+ */
+#define INSTANCE_BUCKETS	64
 
-static DEFINE_SPINLOCK(transaction_queues_lock);
-static LIST_HEAD(transaction_queues);
+static DEFINE_SPINLOCK(instances_lock);
+static struct hlist_head instances[INSTANCE_BUCKETS];
 
 enum transaction_queue_state {
 	STATE_PENDING,
@@ -51,7 +55,7 @@ enum transaction_queue_state {
 };
 
 struct transaction_queue {
-	struct list_head list;
+	struct hlist_node node;
 	struct fw_unit *unit;
 	void *buf;
 	unsigned int size;
@@ -60,36 +64,49 @@ struct transaction_queue {
 	wait_queue_head_t wait;
 };
 
-int snd_efw_transaction_cmd(struct fw_unit *unit,
+int snd_efw_transaction_cmd(struct snd_efw *efw,
 			    const void *cmd, unsigned int size)
 {
-	return snd_fw_transaction(unit, TCODE_WRITE_BLOCK_REQUEST,
-				  MEMORY_SPACE_EFW_COMMAND,
-				  (void *)cmd, size, 0);
+	return snd_fw_transaction_counted(&efw->transaction_stats,
+					  TCODE_WRITE_BLOCK_REQUEST,
+					  MEMORY_SPACE_EFW_COMMAND,
+					  (void *)cmd, size, 0);
 }
 
-int snd_efw_transaction_run(struct fw_unit *unit,
+static unsigned int instance_bucket(int node_id)
+{
+	return node_id & (INSTANCE_BUCKETS - 1);
+}
+
+/* Kernel transactions use every other sequence number. */
+static struct hlist_head *transaction_slot(struct snd_efw *efw, u32 seqnum)
+{
+	return &efw->transactions[(seqnum >> 1) % SND_EFW_TRANSACTION_SLOTS];
+}
+
+int snd_efw_transaction_run(struct snd_efw *efw,
 			    const void *cmd, unsigned int cmd_size,
 			    void *resp, unsigned int resp_size)
 {
 	struct transaction_queue t;
-	unsigned int tries;
+	unsigned int tries, resets;
 	int ret;
 
-	t.unit = unit;
+	t.unit = efw->unit;
 	t.buf = resp;
 	t.size = resp_size;
 	t.seqnum = be32_to_cpu(((struct snd_efw_transaction *)cmd)->seqnum) + 1;
 	t.state = STATE_PENDING;
 	init_waitqueue_head(&t.wait);
 
-	spin_lock_irq(&transaction_queues_lock);
-	list_add_tail(&t.list, &transaction_queues);
-	spin_unlock_irq(&transaction_queues_lock);
+	spin_lock_irq(&efw->transactions_lock);
+	hlist_add_head(&t.node, transaction_slot(efw, t.seqnum));
+	spin_unlock_irq(&efw->transactions_lock);
 
 	tries = 0;
+	resets = 0;
 	do {
-		ret = snd_efw_transaction_cmd(t.unit, (void *)cmd, cmd_size);
+		ret = snd_efw_transaction_cmd(efw, (void *)cmd, cmd_size);
 		if (ret < 0)
 			break;
 
@@ -100,7 +117,7 @@ int snd_efw_transaction_run(struct fw_unit *unit,
 			ret = t.size;
 			break;
 		} else if (t.state == STATE_BUS_RESET) {
-			msleep(ERROR_DELAY_MS);
+			msleep(snd_fw_retry_delay_ms(ERROR_DELAY_MS, ++resets));
 		} else if (++tries >= ERROR_RETRIES) {
 			dev_err(&t.unit->device, "EFW transaction timed out\n");
 			ret = -EIO;
@@ -108,54 +125,105 @@ int snd_efw_transaction_run(struct fw_unit *unit,
 		}
 	} while (1);
 
-	spin_lock_irq(&transaction_queues_lock);
-	list_del(&t.list);
-	spin_unlock_irq(&transaction_queues_lock);
+	spin_lock_irq(&efw->transactions_lock);
+	hlist_del(&t.node);
+	spin_unlock_irq(&efw->transactions_lock);
 
 	return ret;
 }
 
+/*
+ * The ring of responses is a power of two bytes in pages following a page
+ * for struct snd_efw_response_ring, so that userspace can map both at once.
+ * The indices in the header are shared with userspace, thus the driver keeps
+ * its own copy of the head and never trusts the tail beyond the ring.
+ */
+int snd_efw_resp_ring_resize(struct snd_efw *efw, unsigned int size)
+{
+	struct snd_efw_response_ring *ring, *old;
+	int err = 0;
+
+	size = clamp_t(unsigned int, size, PAGE_SIZE,
+		       SND_EFW_RESP_RING_MAX_BYTES);
+	size = roundup_pow_of_two(size);
+
+	ring = vmalloc_user(PAGE_SIZE + size);
+	if (ring == NULL)
+		return -ENOMEM;
+	ring->size = size;
+
+	spin_lock_irq(&efw->lock);
+
+	old = efw->resp_ring;
+	if (old != NULL &&
+	    (efw->resp_ring_mapped || efw->resp_head != old->tail)) {
+		err = -EBUSY;
+	} else {
+		efw->resp_ring = ring;
+		efw->resp_buf = (u8 *)ring + PAGE_SIZE;
+		efw->resp_buf_size = size;
+		efw->resp_head = 0;
+		ring = old;
+	}
+
+	spin_unlock_irq(&efw->lock);
+
+	vfree(ring);
+	return err;
+}
+
+void snd_efw_resp_ring_free(struct snd_efw *efw)
+{
+	vfree(efw->resp_ring);
+	efw->resp_ring = NULL;
+	efw->resp_buf = NULL;
+}
+
 static void
 copy_resp_to_buf(struct snd_efw *efw, void *data, size_t length, int *rcode)
 {
-	size_t capacity, till_end;
+	struct snd_efw_response_ring *ring;
 	struct snd_efw_transaction *t;
+	unsigned int size, pos, till_end;
+	u32 head, tail;
+
+	t = (struct snd_efw_transaction *)data;
+
+	/* the client finds the next response by the length field */
+	if (be32_to_cpu(t->length) * sizeof(u32) > length ||
+	    be32_to_cpu(t->length) * sizeof(u32) < sizeof(*t)) {
+		*rcode = RCODE_DATA_ERROR;
+		return;
+	}
+	length = be32_to_cpu(t->length) * sizeof(u32);
 
 	spin_lock_irq(&efw->lock);
 
-	t = (struct snd_efw_transaction *)data;
-	length = min_t(size_t, be32_to_cpu(t->length) * sizeof(u32), length);
+	ring = efw->resp_ring;
+	size = efw->resp_buf_size;
+	head = efw->resp_head;
 
-	if (efw->push_ptr < efw->pull_ptr)
-		capacity = (unsigned int)(efw->pull_ptr - efw->push_ptr);
-	else
-		capacity = snd_efw_resp_buf_size -
-			   (unsigned int)(efw->push_ptr - efw->pull_ptr);
+	/* pairs with the release by the consumer, which is done with data */
+	tail = smp_load_acquire(&ring->tail);
 
 	/* confirm enough space for this response */
-	if (capacity < length) {
+	if (head - tail > size || size - (head - tail) < length) {
+		WRITE_ONCE(ring->dropped, ++efw->resp_dropped);
 		*rcode = RCODE_CONFLICT_ERROR;
 		goto end;
 	}
 
 	/* copy to ring buffer */
-	while (length > 0) {
-		till_end = snd_efw_resp_buf_size -
-			   (unsigned int)(efw->push_ptr - efw->resp_buf);
-		till_end = min_t(unsigned int, length, till_end);
-
-		memcpy(efw->push_ptr, data, till_end);
+	pos = head & (size - 1);
+	till_end = min_t(unsigned int, length, size - pos);
+	memcpy(efw->resp_buf + pos, data, till_end);
+	memcpy(efw->resp_buf, data + till_end, length - till_end);
 
-		efw->push_ptr += till_end;
-		if (efw->push_ptr >= efw->resp_buf + snd_efw_resp_buf_size)
-			efw->push_ptr -= snd_efw_resp_buf_size;
-
-		length -= till_end;
-		data += till_end;
-	}
+	/* publish the response after its data */
+	efw->resp_head = head + length;
+	smp_store_release(&ring->head, efw->resp_head);
 
 	/* for hwdep */
-	efw->resp_queues++;
 	wake_up(&efw->hwdep_wait);
 
 	*rcode = RCODE_COMPLETE;
@@ -163,65 +231,65 @@ end:
 	spin_unlock_irq(&efw->lock);
 }
 
-static void
-handle_resp_for_user(struct fw_card *card, int generation, int source,
-		     void *data, size_t length, int *rcode)
+static bool
+instance_matches(struct snd_efw *efw, struct fw_card *card, int generation,
+		 int source)
 {
-	struct fw_device *device;
+	struct fw_device *device = fw_parent_device(efw->unit);
+
+	if ((device->card != card) ||
+	    (device->generation != generation))
+		return false;
+	smp_rmb();	/* node id vs. generation */
+
+	return device->node_id == source;
+}
+
+/* This should be called under rcu_read_lock(). */
+static struct snd_efw *
+find_instance(struct fw_card *card, int generation, int source)
+{
+	unsigned int bucket = instance_bucket(source);
 	struct snd_efw *efw;
 	unsigned int i;
 
-	spin_lock_irq(&instances_lock);
+	hlist_for_each_entry_rcu(efw, &instances[bucket], instance_node) {
+		if (instance_matches(efw, card, generation, source))
+			return efw;
+	}
 
-	for (i = 0; i < SNDRV_CARDS; i++) {
-		efw = instances[i];
-		if (efw == NULL)
-			continue;
-		device = fw_parent_device(efw->unit);
-		if ((device->card != card) ||
-		    (device->generation != generation))
-			continue;
-		smp_rmb();	/* node id vs. generation */
-		if (device->node_id != source)
+	/* The node can get a new ID before the bus reset is handled. */
+	for (i = 0; i < INSTANCE_BUCKETS; i++) {
+		if (i == bucket)
 			continue;
-
-		break;
+		hlist_for_each_entry_rcu(efw, &instances[i], instance_node) {
+			if (instance_matches(efw, card, generation, source))
+				return efw;
+		}
 	}
-	if (i == SNDRV_CARDS)
-		goto end;
 
-	copy_resp_to_buf(efw, data, length, rcode);
-end:
-	spin_unlock_irq(&instances_lock);
+	return NULL;
 }
 
 static void
-handle_resp_for_kernel(struct fw_card *card, int generation, int source,
-		       void *data, size_t length, int *rcode, u32 seqnum)
+handle_resp_for_kernel(struct snd_efw *efw, void *data, size_t length,
+		       int *rcode, u32 seqnum)
 {
-	struct fw_device *device;
 	struct transaction_queue *t;
 	unsigned long flags;
 
-	spin_lock_irqsave(&transaction_queues_lock, flags);
-	list_for_each_entry(t, &transaction_queues, list) {
-		device = fw_parent_device(t->unit);
-		if ((device->card != card) ||
-		    (device->generation != generation))
-			continue;
-		smp_rmb();	/* node_id vs. generation */
-		if (device->node_id != source)
-			continue;
-
+	spin_lock_irqsave(&efw->transactions_lock, flags);
+	hlist_for_each_entry(t, transaction_slot(efw, seqnum), node) {
 		if ((t->state == STATE_PENDING) && (t->seqnum == seqnum)) {
 			t->state = STATE_COMPLETE;
 			t->size = min_t(unsigned int, length, t->size);
 			memcpy(t->buf, data, t->size);
 			wake_up(&t->wait);
 			*rcode = RCODE_COMPLETE;
+			break;
 		}
 	}
-	spin_unlock_irqrestore(&transaction_queues_lock, flags);
+	spin_unlock_irqrestore(&efw->transactions_lock, flags);
 }
 
 static void
@@ -230,6 +298,7 @@ efw_response(struct fw_card *card, struct fw_request *request,
 	     int generation, unsigned long long offset,
 	     void *data, size_t length, void *callback_data)
 {
+	struct snd_efw *efw;
 	int rcode, dummy;
 	u32 seqnum;
 
@@ -242,17 +311,22 @@ efw_response(struct fw_card *card, struct fw_request *request,
 		goto end;
 	}
 
+	rcu_read_lock();
+
+	efw = find_instance(card, generation, source);
+	if (efw == NULL)
+		goto unlock;
+
 	seqnum = be32_to_cpu(((struct snd_efw_transaction *)data)->seqnum);
 	if (seqnum > SND_EFW_TRANSACTION_USER_SEQNUM_MAX + 1) {
-		handle_resp_for_kernel(card, generation, source,
-				       data, length, &rcode, seqnum);
+		handle_resp_for_kernel(efw, data, length, &rcode, seqnum);
 		if (snd_efw_resp_buf_debug)
-			handle_resp_for_user(card, generation, source,
-					     data, length, &dummy);
+			copy_resp_to_buf(efw, data, length, &dummy);
 	} else {
-		handle_resp_for_user(card, generation, source,
-				     data, length, &rcode);
+		copy_resp_to_buf(efw, data, length, &rcode);
 	}
+unlock:
+	rcu_read_unlock();
 end:
 	fw_send_response(card, request, rcode);
 }
@@ -261,46 +335,75 @@ void snd_efw_transaction_add_instance(struct snd_efw *efw)
 {
 	unsigned int i;
 
-	spin_lock_irq(&instances_lock);
+	spin_lock_init(&efw->transactions_lock);
+	for (i = 0; i < SND_EFW_TRANSACTION_SLOTS; i++)
+		INIT_HLIST_HEAD(&efw->transactions[i]);
 
-	for (i = 0; i < SNDRV_CARDS; i++) {
-		if (instances[i] != NULL)
-			continue;
-		instances[i] = efw;
-		break;
-	}
+	efw->instance_bucket =
+			instance_bucket(fw_parent_device(efw->unit)->node_id);
 
+	spin_lock_irq(&instances_lock);
+	hlist_add_head_rcu(&efw->instance_node,
+			   &instances[efw->instance_bucket]);
 	spin_unlock_irq(&instances_lock);
 }
 
+/* This can be called twice, or before adding the instance. */
 void snd_efw_transaction_remove_instance(struct snd_efw *efw)
 {
-	unsigned int i;
+	bool added;
 
 	spin_lock_irq(&instances_lock);
-
-	for (i = 0; i < SNDRV_CARDS; i++) {
-		if (instances[i] != efw)
-			continue;
-		instances[i] = NULL;
-	}
-
+	added = !hlist_unhashed(&efw->instance_node);
+	if (added)
+		hlist_del_init_rcu(&efw->instance_node);
 	spin_unlock_irq(&instances_lock);
+
+	/* wait for handlers of responses which may still see the instance */
+	if (added)
+		synchronize_rcu();
 }
 
-void snd_efw_transaction_bus_reset(struct fw_unit *unit)
+void snd_efw_transaction_bus_reset(struct snd_efw *efw)
 {
 	struct transaction_queue *t;
-
-	spin_lock_irq(&transaction_queues_lock);
-	list_for_each_entry(t, &transaction_queues, list) {
-		if ((t->unit == unit) &&
-		    (t->state == STATE_PENDING)) {
-			t->state = STATE_BUS_RESET;
-			wake_up(&t->wait);
+	unsigned int i, bucket;
+	bool moved;
+
+	spin_lock_irq(&efw->transactions_lock);
+	for (i = 0; i < SND_EFW_TRANSACTION_SLOTS; i++) {
+		hlist_for_each_entry(t, &efw->transactions[i], node) {
+			if (t->state == STATE_PENDING) {
+				t->state = STATE_BUS_RESET;
+				wake_up(&t->wait);
+			}
 		}
 	}
-	spin_unlock_irq(&transaction_queues_lock);
+	spin_unlock_irq(&efw->transactions_lock);
+
+	/* follow the new node ID */
+	bucket = instance_bucket(fw_parent_device(efw->unit)->node_id);
+
+	spin_lock_irq(&instances_lock);
+	moved = !hlist_unhashed(&efw->instance_node) &&
+		bucket != efw->instance_bucket;
+	if (moved)
+		hlist_del_init_rcu(&efw->instance_node);
+	spin_unlock_irq(&instances_lock);
+
+	if (!moved)
+		return;
+
+	/*
+	 * A handler of responses which still sees the instance would follow it
+	 * into the new bucket and miss the rest of the old one.
+	 */
+	synchronize_rcu();
+
+	spin_lock_irq(&instances_lock);
+	hlist_add_head_rcu(&efw->instance_node, &instances[bucket]);
+	efw->instance_bucket = bucket;
+	spin_unlock_irq(&instances_lock);
 }
 
 static struct fw_address_handler resp_register_handler = {
@@ -321,6 +424,9 @@ int snd_efw_transaction_register(void)
 
 void snd_efw_transaction_unregister(void)
 {
-	WARN_ON(!list_empty(&transaction_queues));
+	unsigned int i;
+
+	for (i = 0; i < INSTANCE_BUCKETS; i++)
+		WARN_ON(!hlist_empty(&instances[i]));
 	fw_core_remove_address_handler(&resp_register_handler);
 }
@@ -10,11 +10,33 @@
 #include <linux/firewire-constants.h>
 #include <linux/export.h>
 #include <linux/jiffies.h>
+#include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
+#include <sound/core.h>
+#include <sound/info.h>
 #include "iso-resources.h"
 
+/* the initial value of BANDWIDTH_AVAILABLE register of IRM */
+#define BANDWIDTH_AVAILABLE_INITIAL	4915
+
+/*
+ * The bandwidth which the streams of the drivers on a bus intend to use. This
+ * is checked before any transaction to IRM, so that a stream which cannot be
+ * served is rejected before the other streams of its device start.
+ */
+struct bandwidth_plan {
+	struct list_head list;
+	struct fw_card *card;
+	unsigned int planned;
+	unsigned int streams;
+};
+
+static LIST_HEAD(bandwidth_plans);
+static DEFINE_MUTEX(bandwidth_plans_mutex);
+
 /**
  * fw_iso_resources_init - initializes a &struct fw_iso_resources
  * @r: the resource manager to initialize
@@ -76,6 +98,161 @@ static int current_bandwidth_overhead(struct fw_card *card)
 	return card->gap_count < 63 ? card->gap_count * 97 / 10 + 89 : 512;
 }
 
+static struct bandwidth_plan *find_plan(struct fw_card *card)
+{
+	struct bandwidth_plan *plan;
+
+	list_for_each_entry(plan, &bandwidth_plans, list) {
+		if (plan->card == card)
+			return plan;
+	}
+
+	return NULL;
+}
+
+static unsigned int plan_headroom(struct bandwidth_plan *plan)
+{
+	if (plan == NULL)
+		return BANDWIDTH_AVAILABLE_INITIAL;
+	return BANDWIDTH_AVAILABLE_INITIAL - plan->planned;
+}
+
+static int plan_bandwidth(struct fw_card *card, unsigned int bandwidth,
+			  unsigned int streams)
+{
+	struct bandwidth_plan *plan;
+	int err = 0;
+
+	mutex_lock(&bandwidth_plans_mutex);
+
+	plan = find_plan(card);
+	if (bandwidth > plan_headroom(plan)) {
+		err = -ENOSPC;
+		goto end;
+	}
+
+	if (plan == NULL) {
+		plan = kzalloc(sizeof(*plan), GFP_KERNEL);
+		if (plan == NULL) {
+			err = -ENOMEM;
+			goto end;
+		}
+		plan->card = card;
+		list_add_tail(&plan->list, &bandwidth_plans);
+	}
+
+	plan->planned += bandwidth;
+	plan->streams += streams;
+end:
+	mutex_unlock(&bandwidth_plans_mutex);
+
+	return err;
+}
+
+static void unplan_bandwidth(struct fw_card *card, unsigned int bandwidth,
+			     unsigned int streams)
+{
+	struct bandwidth_plan *plan;
+
+	mutex_lock(&bandwidth_plans_mutex);
+
+	plan = find_plan(card);
+	if (!WARN_ON(plan == NULL)) {
+		plan->planned -= bandwidth;
+		plan->streams -= streams;
+		if (plan->streams == 0) {
+			list_del(&plan->list);
+			kfree(plan);
+		}
+	}
+
+	mutex_unlock(&bandwidth_plans_mutex);
+}
+
+static void report_unplanned(struct fw_iso_resources *r)
+{
+	dev_err(&r->unit->device,
+		"isochronous bandwidth of the bus is planned for other streams\n");
+}
+
+/**
+ * fw_iso_resources_check - check whether streams fit into the bus
+ * @resources: the resource managers of the streams
+ * @max_payload_bytes: the amount of data per packet, for each stream
+ * @count: the number of streams
+ * @speed: the speed at which the packets will be sent
+ *
+ * Drivers can call this function to reject a formation of their streams
+ * before starting any of them. The result is based on the bandwidth planned
+ * for the streams which the drivers have already allocated on the same bus.
+ * The resource managers which are already allocated are in the plan, thus
+ * they are not counted again.
+ *
+ * Returns zero if the streams fit, or -ENOSPC.
+ */
+int fw_iso_resources_check(struct fw_iso_resources **resources,
+			   const unsigned int *max_payload_bytes,
+			   unsigned int count, int speed)
+{
+	struct fw_card *card;
+	unsigned int i, bandwidth, overhead;
+	bool allocated;
+	int err = 0;
+
+	if (count == 0)
+		return 0;
+	card = fw_parent_device(resources[0]->unit)->card;
+
+	spin_lock_irq(&card->lock);
+	overhead = current_bandwidth_overhead(card);
+	spin_unlock_irq(&card->lock);
+
+	bandwidth = 0;
+	for (i = 0; i < count; i++) {
+		mutex_lock(&resources[i]->mutex);
+		allocated = resources[i]->allocated;
+		mutex_unlock(&resources[i]->mutex);
+		if (!allocated)
+			bandwidth += packet_bandwidth(max_payload_bytes[i],
+						      speed) + overhead;
+	}
+
+	mutex_lock(&bandwidth_plans_mutex);
+	if (bandwidth > plan_headroom(find_plan(card)))
+		err = -ENOSPC;
+	mutex_unlock(&bandwidth_plans_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(fw_iso_resources_check);
+
+/**
+ * fw_iso_resources_dump_plan - print the bandwidth plan of the bus
+ * @unit: a device unit on the bus
+ * @buffer: the buffer of the proc file
+ */
+void fw_iso_resources_dump_plan(struct fw_unit *unit,
+				struct snd_info_buffer *buffer)
+{
+	struct fw_card *card = fw_parent_device(unit)->card;
+	struct bandwidth_plan *plan;
+	unsigned int planned, streams;
+
+	mutex_lock(&bandwidth_plans_mutex);
+	plan = find_plan(card);
+	planned = (plan != NULL) ? plan->planned : 0;
+	streams = (plan != NULL) ? plan->streams : 0;
+	mutex_unlock(&bandwidth_plans_mutex);
+
+	snd_iprintf(buffer, "Bus:\t\tfw%d\n", card->index);
+	snd_iprintf(buffer, "Streams:\t%u\n", streams);
+	snd_iprintf(buffer, "Capacity:\t%u\n", BANDWIDTH_AVAILABLE_INITIAL);
+	snd_iprintf(buffer, "Planned:\t%u\n", planned);
+	snd_iprintf(buffer, "Headroom:\t%u\n",
+		    BANDWIDTH_AVAILABLE_INITIAL - planned);
+}
+EXPORT_SYMBOL(fw_iso_resources_dump_plan);
+
 static int wait_isoch_resource_delay_after_bus_reset(struct fw_card *card)
 {
 	for (;;) {
@@ -113,6 +290,17 @@ int fw_iso_resources_allocate(struct fw_iso_resources *r,
 
 	r->bandwidth = packet_bandwidth(max_payload_bytes, speed);
 
+	spin_lock_irq(&card->lock);
+	r->planned = r->bandwidth + current_bandwidth_overhead(card);
+	spin_unlock_irq(&card->lock);
+
+	err = plan_bandwidth(card, r->planned, 1);
+	if (err < 0) {
+		if (err == -ENOSPC)
+			report_unplanned(r);
+		return err;
+	}
+
 retry_after_bus_reset:
 	spin_lock_irq(&card->lock);
 	r->generation = card->generation;
@@ -120,8 +308,10 @@ retry_after_bus_reset:
 	spin_unlock_irq(&card->lock);
 
 	err = wait_isoch_resource_delay_after_bus_reset(card);
-	if (err < 0)
+	if (err < 0) {
+		unplan_bandwidth(card, r->planned, 1);
 		return err;
+	}
 
 	mutex_lock(&r->mutex);
 
@@ -142,6 +332,7 @@ retry_after_bus_reset:
 		else
 			dev_err(&r->unit->device,
 				"isochronous resource allocation failed\n");
+		unplan_bandwidth(card, r->planned, 1);
 	}
 
 	mutex_unlock(&r->mutex);
@@ -150,6 +341,148 @@ retry_after_bus_reset:
 }
 EXPORT_SYMBOL(fw_iso_resources_allocate);
 
+static void unlock_batch(struct fw_iso_resources **resources,
+			 unsigned int count)
+{
+	while (count > 0)
+		mutex_unlock(&resources[--count]->mutex);
+}
+
+/**
+ * fw_iso_resources_allocate_batch - allocate resources for several streams
+ * @resources: the resource managers, each for one stream to the same device
+ * @max_payload_bytes: the amount of data per packet, for each of @resources
+ * @count: the number of @resources, up to %FW_ISO_RESOURCES_BATCH_MAX
+ * @speed: the speed at which the packets of all the streams will be sent
+ *
+ * This function works like fw_iso_resources_allocate() for each of
+ * @resources, but it waits for the delay after a bus reset only once, and
+ * allocates the bandwidth for all of the streams in one transaction. When any
+ * of the allocations fails, the resources allocated so far are released
+ * again, thus either all or none of @resources are allocated.
+ *
+ * Returns zero on success, or a negative error code. The channel number of
+ * each stream is available in ->channel of its resource manager.
+ */
+int fw_iso_resources_allocate_batch(struct fw_iso_resources **resources,
+				    const unsigned int *max_payload_bytes,
+				    unsigned int count, int speed)
+{
+	struct fw_card *card;
+	struct fw_iso_resources *r;
+	unsigned int i, j, planned;
+	int generation, overhead, bandwidth, channel, err;
+
+	if (count == 0 || WARN_ON(count > FW_ISO_RESOURCES_BATCH_MAX))
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		r = resources[i];
+		if (WARN_ON(r->allocated))
+			return -EBADFD;
+		r->bandwidth = packet_bandwidth(max_payload_bytes[i], speed);
+	}
+
+	card = fw_parent_device(resources[0]->unit)->card;
+
+	spin_lock_irq(&card->lock);
+	overhead = current_bandwidth_overhead(card);
+	spin_unlock_irq(&card->lock);
+
+	planned = 0;
+	for (i = 0; i < count; i++) {
+		r = resources[i];
+		r->planned = r->bandwidth + overhead;
+		planned += r->planned;
+	}
+	err = plan_bandwidth(card, planned, count);
+	if (err < 0) {
+		if (err == -ENOSPC)
+			report_unplanned(resources[0]);
+		return err;
+	}
+
+retry_after_bus_reset:
+	spin_lock_irq(&card->lock);
+	generation = card->generation;
+	overhead = current_bandwidth_overhead(card);
+	spin_unlock_irq(&card->lock);
+
+	err = wait_isoch_resource_delay_after_bus_reset(card);
+	if (err < 0) {
+		unplan_bandwidth(card, planned, count);
+		return err;
+	}
+
+	for (i = 0; i < count; i++)
+		mutex_lock_nested(&resources[i]->mutex, i);
+
+	/* The bandwidth for all of the streams at once. */
+	bandwidth = 0;
+	for (i = 0; i < count; i++) {
+		r = resources[i];
+		r->generation = generation;
+		r->bandwidth_overhead = overhead;
+		bandwidth += r->bandwidth + r->bandwidth_overhead;
+	}
+	fw_iso_resource_manage(card, generation, 0, &channel, &bandwidth, true);
+	if (bandwidth == 0) {
+		err = channel;
+		goto error;
+	}
+
+	/* Then one channel for each stream. */
+	for (i = 0; i < count; i++) {
+		r = resources[i];
+		bandwidth = 0;
+		fw_iso_resource_manage(card, generation, r->channels_mask,
+				       &channel, &bandwidth, true);
+		if (channel < 0)
+			break;
+		r->channel = channel;
+	}
+	if (i < count) {
+		err = channel;
+
+		/* Roll back. In a new generation, these fail harmlessly. */
+		for (j = 0; j < i; j++) {
+			bandwidth = 0;
+			fw_iso_resource_manage(card, generation,
+					       1uLL << resources[j]->channel,
+					       &channel, &bandwidth, false);
+		}
+		bandwidth = 0;
+		for (j = 0; j < count; j++)
+			bandwidth += resources[j]->bandwidth + overhead;
+		fw_iso_resource_manage(card, generation, 0,
+				       &channel, &bandwidth, false);
+		goto error;
+	}
+
+	for (i = 0; i < count; i++)
+		resources[i]->allocated = true;
+
+	unlock_batch(resources, count);
+
+	return 0;
+error:
+	unlock_batch(resources, count);
+
+	if (err == -EAGAIN)
+		goto retry_after_bus_reset;
+
+	if (err == -EBUSY)
+		dev_err(&resources[0]->unit->device,
+			"isochronous resources exhausted\n");
+	else
+		dev_err(&resources[0]->unit->device,
+			"isochronous resource allocation failed\n");
+	unplan_bandwidth(card, planned, count);
+
+	return err;
+}
+EXPORT_SYMBOL(fw_iso_resources_allocate_batch);
+
 /**
  * fw_iso_resources_update - update resource allocations after a bus reset
  * @r: the resource manager
@@ -194,6 +527,7 @@ int fw_iso_resources_update(struct fw_iso_resources *r)
 		else
 			dev_err(&r->unit->device,
 				"isochronous resource allocation failed\n");
+		unplan_bandwidth(card, r->planned, 1);
 	}
 
 	mutex_unlock(&r->mutex);
@@ -223,6 +557,7 @@ void fw_iso_resources_free(struct fw_iso_resources *r)
 			dev_err(&r->unit->device,
 				"isochronous resource deallocation failed\n");
 
+		unplan_bandwidth(card, r->planned, 1);
 		r->allocated = false;
 	}
 
@@ -5,6 +5,7 @@
 #include <linux/types.h>
 
 struct fw_unit;
+struct snd_info_buffer;
 
 /**
  * struct fw_iso_resources - manages channel/bandwidth allocation
@@ -22,6 +23,7 @@ struct fw_iso_resources {
 	unsigned int channel;
 	unsigned int bandwidth; /* in bandwidth units, without overhead */
 	unsigned int bandwidth_overhead;
+	unsigned int planned; /* in the bandwidth plan of the bus */
 	int generation; /* in which allocation is valid */
 	bool allocated;
 };
@@ -32,7 +34,20 @@ void fw_iso_resources_destroy(struct fw_iso_resources *r);
 
 int fw_iso_resources_allocate(struct fw_iso_resources *r,
 			      unsigned int max_payload_bytes, int speed);
+
+/* limited by the subclasses of lockdep, one for each resource manager */
+#define FW_ISO_RESOURCES_BATCH_MAX	8
+
+int fw_iso_resources_allocate_batch(struct fw_iso_resources **resources,
+				    const unsigned int *max_payload_bytes,
+				    unsigned int count, int speed);
 int fw_iso_resources_update(struct fw_iso_resources *r);
 void fw_iso_resources_free(struct fw_iso_resources *r);
 
+int fw_iso_resources_check(struct fw_iso_resources **resources,
+			   const unsigned int *max_payload_bytes,
+			   unsigned int count, int speed);
+void fw_iso_resources_dump_plan(struct fw_unit *unit,
+				struct snd_info_buffer *buffer);
+
 #endif
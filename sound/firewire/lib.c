@@ -5,36 +5,250 @@
  * Licensed under the terms of the GNU General Public License, version 2.
  */
 
+#include <linux/atomic.h>
+#include <linux/completion.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/firewire.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <sound/core.h>
+#include <sound/info.h>
 #include "lib.h"
+#include "fcp.h"
 
+#define ERROR_RETRIES		3
 #define ERROR_RETRY_DELAY_MS	20
 
+#define TRANSITION_DELAY_MS	5
+#define TRANSITION_DELAY_MAX_MS	40
+
+static unsigned int retry_budget = 32;
+module_param(retry_budget, uint, 0644);
+MODULE_PARM_DESC(retry_budget,
+		 "retries of failed transactions allowed per unit and second");
+
+static bool discovery_cache = true;
+module_param(discovery_cache, bool, 0644);
+MODULE_PARM_DESC(discovery_cache,
+		 "reuse results of stream discovery for the same device and firmware");
+
+static const struct {
+	int tcode;
+	const char *name;
+} tcode_slots[SND_FW_TCODE_SLOTS] = {
+	{ TCODE_WRITE_QUADLET_REQUEST,	"write quadlet" },
+	{ TCODE_WRITE_BLOCK_REQUEST,	"write block" },
+	{ TCODE_READ_QUADLET_REQUEST,	"read quadlet" },
+	{ TCODE_READ_BLOCK_REQUEST,	"read block" },
+	{ TCODE_LOCK_REQUEST,		"lock" },
+};
+
+static int tcode_to_slot(int tcode)
+{
+	unsigned int i;
+
+	/* The extended transaction codes are all sent as lock requests. */
+	if (tcode >= TCODE_LOCK_MASK_SWAP &&
+	    tcode <= TCODE_LOCK_VENDOR_DEPENDENT)
+		tcode = TCODE_LOCK_REQUEST;
+
+	for (i = 0; i < SND_FW_TCODE_SLOTS; i++) {
+		if (tcode_slots[i].tcode == tcode)
+			return i;
+	}
+	return -EINVAL;
+}
+
 /**
- * snd_fw_transaction - send a request and wait for its completion
- * @unit: the driver's unit on the target device
- * @tcode: the transaction code
- * @offset: the address in the target's address space
- * @buffer: input/output data
- * @length: length of @buffer
- * @flags: use %FW_FIXED_GENERATION and add the generation value to attempt the
- *         request only in that generation; use %FW_QUIET to suppress error
- *         messages
+ * snd_fw_retry_delay_ms - calculate the delay before retrying a request
+ * @base_ms: the delay after the first failure
+ * @tries: the number of failed attempts so far, starting from 1
  *
- * Submits an asynchronous request to the target device, and waits for the
- * response.  The node ID and the current generation are derived from @unit.
- * On a bus reset or an error, the transaction is retried a few times.
- * Returns zero on success, or a negative error code.
+ * The delay doubles with each failed attempt, up to 16 times @base_ms, and is
+ * randomized within its upper half so that requests which failed at the same
+ * time, i.e. by a bus reset, are not sent again in lockstep.
  */
-int snd_fw_transaction(struct fw_unit *unit, int tcode,
-		       u64 offset, void *buffer, size_t length,
-		       unsigned int flags)
+unsigned int snd_fw_retry_delay_ms(unsigned int base_ms, unsigned int tries)
+{
+	unsigned int delay;
+
+	delay = base_ms << min_t(unsigned int, max(tries, 1u) - 1, 4);
+
+	return delay - prandom_u32() % (delay / 2 + 1);
+}
+EXPORT_SYMBOL(snd_fw_retry_delay_ms);
+
+/**
+ * snd_fw_wait_transition - wait for a device to finish its transition
+ * @check: returns a positive value when the device is in the new state, zero
+ *	   when not yet, or a negative error code
+ * @private_data: the argument of @check
+ * @ceiling_ms: the time which the device needs at the worst
+ * @elapsed_ms: the pointer to store the time waited, in milliseconds
+ *
+ * Instead of sleeping for @ceiling_ms at once, this function polls the device
+ * with delays doubled from 5 msec, so that the caller continues as soon as the
+ * device reports the new state. When @check fails, the rest of @ceiling_ms is
+ * waited as the fixed delay.
+ *
+ * Returns zero when the device reported the new state, -ETIMEDOUT when it did
+ * not till @ceiling_ms, or the negative error code of @check.
+ */
+int snd_fw_wait_transition(int (*check)(void *private_data),
+			   void *private_data, unsigned int ceiling_ms,
+			   unsigned int *elapsed_ms)
+{
+	ktime_t start = ktime_get();
+	unsigned int delay = TRANSITION_DELAY_MS;
+	unsigned int elapsed;
+	int err;
+
+	for (;;) {
+		err = check(private_data);
+		elapsed = ktime_us_delta(ktime_get(), start) / USEC_PER_MSEC;
+		if (err != 0)
+			break;
+
+		if (elapsed >= ceiling_ms) {
+			err = -ETIMEDOUT;
+			break;
+		}
+
+		msleep(min(delay, ceiling_ms - elapsed));
+		delay = min(delay * 2, (unsigned int)TRANSITION_DELAY_MAX_MS);
+	}
+
+	if (err < 0 && err != -ETIMEDOUT && elapsed < ceiling_ms) {
+		msleep(ceiling_ms - elapsed);
+		elapsed = ceiling_ms;
+	}
+
+	*elapsed_ms = elapsed;
+
+	return (err < 0) ? err : 0;
+}
+EXPORT_SYMBOL(snd_fw_wait_transition);
+
+/**
+ * snd_fw_transaction_stats_init - start collecting statistics of a unit
+ * @stats: the statistics to initialize, in the driver's structure
+ * @unit: the unit whose transactions are counted
+ *
+ * snd_fw_transaction_counted() counts its requests to @unit in @stats, and
+ * limits the number of retries to the unit to retry_budget per second, so
+ * that a device which keeps failing does not hog the bus. The helpers for
+ * FCP, CMP and batches of registers count their requests in the same way,
+ * when the statistics are given to fcp_avc_cache_init(),
+ * cmp_connection_init() and snd_fw_read_registers()/snd_fw_write_registers().
+ */
+void snd_fw_transaction_stats_init(struct snd_fw_transaction_stats *stats,
+				   struct fw_unit *unit)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->unit = unit;
+	spin_lock_init(&stats->lock);
+	stats->budget = retry_budget;
+	stats->budget_refill = jiffies + HZ;
+}
+EXPORT_SYMBOL(snd_fw_transaction_stats_init);
+
+/**
+ * snd_fw_transaction_stats_dump - print statistics to a proc file
+ * @stats: the statistics
+ * @buffer: the buffer of the proc file
+ */
+void snd_fw_transaction_stats_dump(struct snd_fw_transaction_stats *stats,
+				   struct snd_info_buffer *buffer)
+{
+	unsigned int i, rcode;
+
+	for (i = 0; i < SND_FW_TCODE_SLOTS; i++) {
+		if (stats->attempts[i] == 0)
+			continue;
+
+		snd_iprintf(buffer, "%s:\n", tcode_slots[i].name);
+		snd_iprintf(buffer, "\tAttempts:\t%lu\n", stats->attempts[i]);
+		snd_iprintf(buffer, "\tRetries:\t%lu\n", stats->retries[i]);
+		snd_iprintf(buffer, "\tLatency:\t%llu us avg, %u us max\n",
+			    div_u64(stats->latency_us[i], stats->attempts[i]),
+			    stats->max_latency_us[i]);
+
+		for (rcode = 0; rcode < SND_FW_RCODE_SLOTS; rcode++) {
+			if (stats->rcodes[i][rcode] == 0)
+				continue;
+			snd_iprintf(buffer, "\t%s:\t%lu\n",
+				    fw_rcode_string(rcode),
+				    stats->rcodes[i][rcode]);
+		}
+	}
+
+	snd_iprintf(buffer, "Budget exhausted:\t%lu\n",
+		    stats->budget_exhausted);
+}
+EXPORT_SYMBOL(snd_fw_transaction_stats_dump);
+
+static void stats_add(struct snd_fw_transaction_stats *stats, int tcode,
+		      int rcode, s64 latency_us, bool retry)
+{
+	int slot;
+
+	if (stats == NULL)
+		return;
+
+	slot = tcode_to_slot(tcode);
+	if (slot < 0)
+		return;
+
+	spin_lock_irq(&stats->lock);
+	stats->attempts[slot]++;
+	if (retry)
+		stats->retries[slot]++;
+	if (rcode >= 0 && rcode < SND_FW_RCODE_SLOTS)
+		stats->rcodes[slot][rcode]++;
+	stats->latency_us[slot] += latency_us;
+	if (latency_us > stats->max_latency_us[slot])
+		stats->max_latency_us[slot] = latency_us;
+	spin_unlock_irq(&stats->lock);
+}
+
+/* returns false if the unit is not allowed to retry any more requests now */
+static bool stats_take_retry(struct snd_fw_transaction_stats *stats)
+{
+	bool allowed;
+
+	if (stats == NULL)
+		return true;
+
+	spin_lock_irq(&stats->lock);
+	if (time_after_eq(jiffies, stats->budget_refill)) {
+		stats->budget = retry_budget;
+		stats->budget_refill = jiffies + HZ;
+	}
+	allowed = stats->budget > 0;
+	if (allowed)
+		stats->budget--;
+	else
+		stats->budget_exhausted++;
+	spin_unlock_irq(&stats->lock);
+
+	return allowed;
+}
+
+static int transaction_run(struct fw_unit *unit,
+			   struct snd_fw_transaction_stats *stats, int tcode,
+			   u64 offset, void *buffer, size_t length,
+			   unsigned int flags)
 {
 	struct fw_device *device = fw_parent_device(unit);
 	int generation, rcode, tries = 0;
+	ktime_t start;
 
 	generation = flags & FW_GENERATION_MASK;
 	for (;;) {
@@ -42,10 +256,13 @@ int snd_fw_transaction(struct fw_unit *unit, int tcode,
 			generation = device->generation;
 			smp_rmb(); /* node_id vs. generation */
 		}
+		start = ktime_get();
 		rcode = fw_run_transaction(device->card, tcode,
 					   device->node_id, generation,
 					   device->max_speed, offset,
 					   buffer, length);
+		stats_add(stats, tcode, rcode,
+			  ktime_us_delta(ktime_get(), start), tries > 0);
 
 		if (rcode == RCODE_COMPLETE)
 			return 0;
@@ -53,7 +270,8 @@ int snd_fw_transaction(struct fw_unit *unit, int tcode,
 		if (rcode == RCODE_GENERATION && (flags & FW_FIXED_GENERATION))
 			return -EAGAIN;
 
-		if (rcode_is_permanent_error(rcode) || ++tries >= 3) {
+		if (rcode_is_permanent_error(rcode) ||
+		    ++tries >= ERROR_RETRIES || !stats_take_retry(stats)) {
 			if (!(flags & FW_QUIET))
 				dev_err(&unit->device,
 					"transaction failed: %s\n",
@@ -61,11 +279,434 @@ int snd_fw_transaction(struct fw_unit *unit, int tcode,
 			return -EIO;
 		}
 
-		msleep(ERROR_RETRY_DELAY_MS);
+		msleep(snd_fw_retry_delay_ms(ERROR_RETRY_DELAY_MS, tries));
 	}
 }
+
+/**
+ * snd_fw_transaction - send a request and wait for its completion
+ * @unit: the driver's unit on the target device
+ * @tcode: the transaction code
+ * @offset: the address in the target's address space
+ * @buffer: input/output data
+ * @length: length of @buffer
+ * @flags: use %FW_FIXED_GENERATION and add the generation value to attempt the
+ *         request only in that generation; use %FW_QUIET to suppress error
+ *         messages
+ *
+ * Submits an asynchronous request to the target device, and waits for the
+ * response.  The node ID and the current generation are derived from @unit.
+ * On a bus reset or an error, the transaction is retried a few times, with
+ * increasing and randomized delays.
+ * Returns zero on success, or a negative error code.
+ */
+int snd_fw_transaction(struct fw_unit *unit, int tcode,
+		       u64 offset, void *buffer, size_t length,
+		       unsigned int flags)
+{
+	return transaction_run(unit, NULL, tcode, offset, buffer, length,
+			       flags);
+}
 EXPORT_SYMBOL(snd_fw_transaction);
 
+/**
+ * snd_fw_transaction_counted - send a request and count it in statistics
+ * @stats: the statistics initialized for the target unit
+ * @tcode: the transaction code
+ * @offset: the address in the target's address space
+ * @buffer: input/output data
+ * @length: length of @buffer
+ * @flags: the same as snd_fw_transaction()
+ *
+ * Works like snd_fw_transaction() to the unit of @stats, and counts the
+ * requests in @stats. The retries are limited by the budget of the unit.
+ * Returns zero on success, or a negative error code.
+ */
+int snd_fw_transaction_counted(struct snd_fw_transaction_stats *stats,
+			       int tcode, u64 offset, void *buffer,
+			       size_t length, unsigned int flags)
+{
+	return transaction_run(stats->unit, stats, tcode, offset, buffer,
+			       length, flags);
+}
+EXPORT_SYMBOL(snd_fw_transaction_counted);
+
+struct register_batch {
+	atomic_t pending;
+	struct completion done;
+	ktime_t start;
+};
+
+struct register_request {
+	struct fw_transaction transaction;
+	struct register_batch *batch;
+	int tcode;
+	u64 offset;
+	u8 *payload;
+	unsigned int length;
+	/* the range of the sorted registers carried by this request */
+	unsigned int first;
+	unsigned int count;
+	int rcode;
+	s64 latency_us;
+};
+
+static int compare_registers(const void *a, const void *b)
+{
+	const struct snd_fw_register *l = *(struct snd_fw_register **)a;
+	const struct snd_fw_register *r = *(struct snd_fw_register **)b;
+
+	if (l->offset < r->offset)
+		return -1;
+	return l->offset > r->offset;
+}
+
+static int register_tcode(unsigned int length, bool write)
+{
+	if (write)
+		return length == 4 ? TCODE_WRITE_QUADLET_REQUEST
+				   : TCODE_WRITE_BLOCK_REQUEST;
+	else
+		return length == 4 ? TCODE_READ_QUADLET_REQUEST
+				   : TCODE_READ_BLOCK_REQUEST;
+}
+
+static void register_request_callback(struct fw_card *card, int rcode,
+				      void *data, size_t length,
+				      void *callback_data)
+{
+	struct register_request *r = callback_data;
+	struct register_batch *batch = r->batch;
+
+	if (rcode == RCODE_COMPLETE &&
+	    (r->tcode == TCODE_READ_QUADLET_REQUEST ||
+	     r->tcode == TCODE_READ_BLOCK_REQUEST)) {
+		if (length == r->length)
+			memcpy(r->payload, data, length);
+		else
+			rcode = RCODE_DATA_ERROR;
+	}
+	r->rcode = rcode;
+	r->latency_us = ktime_us_delta(ktime_get(), batch->start);
+
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+/* the maximum payload by max_rec of the device and by the speed to it */
+static unsigned int max_payload_bytes(struct fw_device *device)
+{
+	return max(min(2U << device->max_rec, 512U << device->max_speed), 4U);
+}
+
+static int transfer_registers(struct snd_fw_transaction_stats *stats,
+			      struct snd_fw_register *regs, unsigned int count,
+			      bool write)
+{
+	struct fw_device *device = fw_parent_device(stats->unit);
+	struct snd_fw_register **sorted;
+	struct register_request *reqs, *r;
+	struct register_batch batch;
+	unsigned int i, j, reqs_count, max_bytes, total;
+	u8 *payload, *pos;
+	int generation, tcode, e, err;
+
+	if (count == 0)
+		return 0;
+
+	sorted = kmalloc_array(count, sizeof(*sorted), GFP_KERNEL);
+	reqs = kcalloc(count, sizeof(*reqs), GFP_KERNEL);
+	if (sorted == NULL || reqs == NULL) {
+		err = -ENOMEM;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++)
+		sorted[i] = &regs[i];
+	sort(sorted, count, sizeof(*sorted), compare_registers, NULL);
+
+	/* Merge registers at adjacent addresses into block requests. */
+	max_bytes = max_payload_bytes(device);
+	reqs_count = 0;
+	total = 0;
+	r = NULL;
+	for (i = 0; i < count; i++) {
+		if (r != NULL && sorted[i]->offset == r->offset + r->length &&
+		    r->length + sorted[i]->length <= max_bytes) {
+			r->length += sorted[i]->length;
+			r->count++;
+		} else {
+			r = &reqs[reqs_count++];
+			r->offset = sorted[i]->offset;
+			r->length = sorted[i]->length;
+			r->first = i;
+			r->count = 1;
+		}
+		total += sorted[i]->length;
+	}
+
+	/* Payloads should be DMA-able, thus callers' buffers are not used. */
+	payload = kmalloc(total, GFP_KERNEL);
+	if (payload == NULL) {
+		err = -ENOMEM;
+		goto end;
+	}
+
+	pos = payload;
+	for (i = 0; i < reqs_count; i++) {
+		r = &reqs[i];
+		r->payload = pos;
+		r->tcode = register_tcode(r->length, write);
+		r->batch = &batch;
+		for (j = r->first; write && j < r->first + r->count; j++) {
+			memcpy(pos, sorted[j]->buffer, sorted[j]->length);
+			pos += sorted[j]->length;
+		}
+		if (!write)
+			pos += r->length;
+	}
+
+	atomic_set(&batch.pending, reqs_count);
+	init_completion(&batch.done);
+	batch.start = ktime_get();
+
+	generation = device->generation;
+	smp_rmb(); /* node_id vs. generation */
+	for (i = 0; i < reqs_count; i++) {
+		r = &reqs[i];
+		fw_send_request(device->card, &r->transaction, r->tcode,
+				device->node_id, generation, device->max_speed,
+				r->offset, r->payload, r->length,
+				register_request_callback, r);
+	}
+
+	/* The callbacks refer to the batch, thus this should not be aborted. */
+	wait_for_completion(&batch.done);
+
+	err = 0;
+	for (i = 0; i < reqs_count; i++) {
+		r = &reqs[i];
+		stats_add(stats, r->tcode, r->rcode, r->latency_us, false);
+
+		pos = r->payload;
+		for (j = r->first; j < r->first + r->count; j++) {
+			/*
+			 * Failed requests are sent again per register with the
+			 * usual retry policy, because some devices reject block
+			 * requests to their registers.
+			 */
+			if (r->rcode != RCODE_COMPLETE) {
+				tcode = register_tcode(sorted[j]->length,
+						       write);
+				e = snd_fw_transaction_counted(stats, tcode,
+						sorted[j]->offset, pos,
+						sorted[j]->length, 0);
+				if (e < 0) {
+					if (err == 0)
+						err = e;
+					pos += sorted[j]->length;
+					continue;
+				}
+			}
+			if (!write)
+				memcpy(sorted[j]->buffer, pos,
+				       sorted[j]->length);
+			pos += sorted[j]->length;
+		}
+	}
+
+	kfree(payload);
+end:
+	kfree(reqs);
+	kfree(sorted);
+	return err;
+}
+
+/**
+ * snd_fw_read_registers - read several ranges of registers at once
+ * @stats: the statistics initialized for the target unit
+ * @regs: the ranges to read
+ * @count: the number of @regs
+ *
+ * The ranges at adjacent addresses are merged into block requests, up to the
+ * maximum payload of the device, and all of the requests are sent at once.
+ * This function returns when all of them finish. Failed requests are retried
+ * by snd_fw_transaction_counted() per range. All of the requests are counted
+ * in @stats.
+ * Returns zero on success, or the first negative error code.
+ */
+int snd_fw_read_registers(struct snd_fw_transaction_stats *stats,
+			  struct snd_fw_register *regs, unsigned int count)
+{
+	return transfer_registers(stats, regs, count, false);
+}
+EXPORT_SYMBOL(snd_fw_read_registers);
+
+/**
+ * snd_fw_write_registers - write several ranges of registers at once
+ * @stats: the statistics initialized for the target unit
+ * @regs: the ranges to write
+ * @count: the number of @regs
+ *
+ * Like snd_fw_read_registers(), the writes are merged and sent at once, thus
+ * the order in which the device receives them is undefined. Registers which
+ * should be written in a certain order need separate calls.
+ * Returns zero on success, or the first negative error code.
+ */
+int snd_fw_write_registers(struct snd_fw_transaction_stats *stats,
+			   struct snd_fw_register *regs, unsigned int count)
+{
+	return transfer_registers(stats, regs, count, true);
+}
+EXPORT_SYMBOL(snd_fw_write_registers);
+
+/* This is an arbitrary number for convinience. */
+#define DISCOVERY_ENTRIES	32
+
+struct discovery_entry {
+	struct list_head list;
+	char driver[32];
+	u64 guid;
+	u64 firmware;
+	size_t size;
+	u8 data[];
+};
+
+static LIST_HEAD(discovery_entries);
+static DEFINE_MUTEX(discovery_mutex);
+static unsigned int discovery_count;
+
+static u64 unit_guid(struct fw_unit *unit)
+{
+	struct fw_device *device = fw_parent_device(unit);
+
+	return ((u64)device->config_rom[3] << 32) | device->config_rom[4];
+}
+
+/* The mutex should be held. */
+static struct discovery_entry *discovery_find(struct fw_unit *unit,
+					      u64 firmware)
+{
+	const char *driver = dev_driver_string(&unit->device);
+	struct discovery_entry *entry;
+	u64 guid = unit_guid(unit);
+
+	list_for_each_entry(entry, &discovery_entries, list) {
+		if (entry->guid == guid && entry->firmware == firmware &&
+		    strncmp(entry->driver, driver, sizeof(entry->driver)) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void discovery_remove(struct discovery_entry *entry)
+{
+	list_del(&entry->list);
+	discovery_count--;
+	kfree(entry);
+}
+
+/**
+ * snd_fw_discovery_load - get the cached result of stream discovery
+ * @unit: the driver's unit on the target device
+ * @firmware: an identifier of the firmware running on the device
+ * @size: the pointer to store the size of the result
+ *
+ * The result saved by snd_fw_discovery_save() for the same driver, GUID and
+ * firmware is available after the unit is unbound or the bus is reset, so
+ * that the driver can skip AV/C commands which return the same responses.
+ *
+ * Returns a copy of the result, which the caller should release by kfree(),
+ * or NULL.
+ */
+void *snd_fw_discovery_load(struct fw_unit *unit, u64 firmware, size_t *size)
+{
+	struct discovery_entry *entry;
+	void *data = NULL;
+
+	if (!discovery_cache)
+		return NULL;
+
+	mutex_lock(&discovery_mutex);
+	entry = discovery_find(unit, firmware);
+	if (entry != NULL) {
+		data = kmemdup(entry->data, entry->size, GFP_KERNEL);
+		if (data != NULL)
+			*size = entry->size;
+		list_move(&entry->list, &discovery_entries);
+	}
+	mutex_unlock(&discovery_mutex);
+
+	return data;
+}
+EXPORT_SYMBOL(snd_fw_discovery_load);
+
+/**
+ * snd_fw_discovery_save - cache the result of stream discovery
+ * @unit: the driver's unit on the target device
+ * @firmware: an identifier of the firmware running on the device
+ * @data: the result, which includes no pointers
+ * @size: the size of @data
+ *
+ * The least recently used result is dropped when too many devices are cached.
+ * Failure to allocate the entry is not reported because the cache is just an
+ * optimization.
+ */
+void snd_fw_discovery_save(struct fw_unit *unit, u64 firmware,
+			   const void *data, size_t size)
+{
+	struct discovery_entry *entry, *old;
+
+	if (!discovery_cache)
+		return;
+
+	entry = kmalloc(sizeof(*entry) + size, GFP_KERNEL);
+	if (entry == NULL)
+		return;
+	strlcpy(entry->driver, dev_driver_string(&unit->device),
+		sizeof(entry->driver));
+	entry->guid = unit_guid(unit);
+	entry->firmware = firmware;
+	entry->size = size;
+	memcpy(entry->data, data, size);
+
+	mutex_lock(&discovery_mutex);
+	old = discovery_find(unit, firmware);
+	if (old != NULL)
+		discovery_remove(old);
+	list_add(&entry->list, &discovery_entries);
+	if (++discovery_count > DISCOVERY_ENTRIES)
+		discovery_remove(list_entry(discovery_entries.prev,
+					    struct discovery_entry, list));
+	mutex_unlock(&discovery_mutex);
+}
+EXPORT_SYMBOL(snd_fw_discovery_save);
+
+static void discovery_clear(void)
+{
+	struct discovery_entry *entry, *next;
+
+	mutex_lock(&discovery_mutex);
+	list_for_each_entry_safe(entry, next, &discovery_entries, list)
+		discovery_remove(entry);
+	mutex_unlock(&discovery_mutex);
+}
+
+static int __init snd_fw_lib_init(void)
+{
+	return snd_fw_fcp_init();
+}
+
+static void __exit snd_fw_lib_exit(void)
+{
+	snd_fw_fcp_exit();
+	discovery_clear();
+}
+
+module_init(snd_fw_lib_init);
+module_exit(snd_fw_lib_exit);
+
 MODULE_DESCRIPTION("FireWire audio helper functions");
 MODULE_AUTHOR("Clemens Ladisch <clemens@ladisch.de>");
 MODULE_LICENSE("GPL v2");
@@ -1,10 +1,15 @@
 #ifndef SOUND_FIREWIRE_LIB_H_INCLUDED
 #define SOUND_FIREWIRE_LIB_H_INCLUDED
 
+#include <linux/device.h>
 #include <linux/firewire-constants.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
 
 struct fw_unit;
+struct snd_info_buffer;
 
 #define FW_GENERATION_MASK	0x00ff
 #define FW_FIXED_GENERATION	0x0100
@@ -13,6 +18,81 @@ struct fw_unit;
 int snd_fw_transaction(struct fw_unit *unit, int tcode,
 		       u64 offset, void *buffer, size_t length,
 		       unsigned int flags);
+unsigned int snd_fw_retry_delay_ms(unsigned int base_ms, unsigned int tries);
+int snd_fw_wait_transition(int (*check)(void *private_data),
+			   void *private_data, unsigned int ceiling_ms,
+			   unsigned int *elapsed_ms);
+
+/**
+ * struct snd_fw_register - a range of registers accessed in a batch
+ * @offset: the address in the target's address space, quadlet aligned
+ * @buffer: the contents of the registers, in bus byte order
+ * @length: the length of @buffer, a multiple of 4
+ */
+struct snd_fw_register {
+	u64 offset;
+	void *buffer;
+	unsigned int length;
+};
+
+
+/* write quadlet/block, read quadlet/block and lock requests */
+#define SND_FW_TCODE_SLOTS	5
+#define SND_FW_RCODE_SLOTS	(RCODE_NO_ACK + 1)
+
+/**
+ * struct snd_fw_transaction_stats - statistics of transactions to a unit
+ * @attempts: the number of requests sent, per transaction code
+ * @retries: the number of requests sent again after a failure
+ * @rcodes: the number of responses, per transaction code and response code
+ * @latency_us: the total time waited for responses, in microseconds
+ * @max_latency_us: the longest time waited for a response, in microseconds
+ * @budget_exhausted: the number of failures which were not retried because
+ *		      the unit used up its budget of retries
+ */
+struct snd_fw_transaction_stats {
+	unsigned long attempts[SND_FW_TCODE_SLOTS];
+	unsigned long retries[SND_FW_TCODE_SLOTS];
+	unsigned long rcodes[SND_FW_TCODE_SLOTS][SND_FW_RCODE_SLOTS];
+	u64 latency_us[SND_FW_TCODE_SLOTS];
+	unsigned int max_latency_us[SND_FW_TCODE_SLOTS];
+	unsigned long budget_exhausted;
+	/* private: */
+	struct fw_unit *unit;
+	spinlock_t lock;
+	unsigned int budget;
+	unsigned long budget_refill;
+};
+
+void snd_fw_transaction_stats_init(struct snd_fw_transaction_stats *stats,
+				   struct fw_unit *unit);
+int snd_fw_transaction_counted(struct snd_fw_transaction_stats *stats,
+			       int tcode, u64 offset, void *buffer,
+			       size_t length, unsigned int flags);
+void snd_fw_transaction_stats_dump(struct snd_fw_transaction_stats *stats,
+				   struct snd_info_buffer *buffer);
+
+int snd_fw_read_registers(struct snd_fw_transaction_stats *stats,
+			  struct snd_fw_register *regs, unsigned int count);
+int snd_fw_write_registers(struct snd_fw_transaction_stats *stats,
+			   struct snd_fw_register *regs, unsigned int count);
+
+void *snd_fw_discovery_load(struct fw_unit *unit, u64 firmware, size_t *size);
+void snd_fw_discovery_save(struct fw_unit *unit, u64 firmware,
+			   const void *data, size_t size);
+
+/*
+ * Report the time elapsed since @stamp for the phase of probing, then restart
+ * @stamp for the next phase. The reports are enabled by dynamic debug.
+ */
+static inline void snd_fw_trace_phase(struct device *dev, const char *phase,
+				      ktime_t *stamp)
+{
+	ktime_t now = ktime_get();
+
+	dev_dbg(dev, "%s: %lld usec\n", phase, ktime_us_delta(now, *stamp));
+	*stamp = now;
+}
 
 /* returns true if retrying the transaction would not make sense */
 static inline bool rcode_is_permanent_error(int rcode)
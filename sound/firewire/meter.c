@@ -0,0 +1,244 @@
+/*
+ * Background sampler of hardware meters
+ *
+ * Licensed under the terms of the GNU General Public License, version 2.
+ */
+
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <sound/core.h>
+#include <sound/control.h>
+#include "meter.h"
+
+/* stop polling when nobody has read the meters for this time */
+#define IDLE_TIMEOUT_MS		1000
+
+/* the number of values in one control element */
+#define CONTROL_CHANNELS_MAX	128
+
+static unsigned int meter_interval_ms = 100;
+module_param(meter_interval_ms, uint, 0644);
+MODULE_PARM_DESC(meter_interval_ms,
+		 "interval to poll hardware meters, 0 to poll at each read");
+
+static void sample(struct snd_fw_meter_sampler *s)
+{
+	u32 *back;
+	int err;
+
+	mutex_lock(&s->mutex);
+
+	back = s->snapshots[s->front ^ 1];
+	err = s->get(s->private_data, back, s->channels);
+
+	spin_lock_irq(&s->lock);
+	if (err >= 0) {
+		s->front ^= 1;
+		s->samples++;
+		s->err = 0;
+	} else {
+		s->err = err;
+	}
+	spin_unlock_irq(&s->lock);
+
+	mutex_unlock(&s->mutex);
+}
+
+static void sample_work(struct work_struct *work)
+{
+	struct snd_fw_meter_sampler *s =
+		container_of(work, struct snd_fw_meter_sampler, work.work);
+	unsigned int interval = READ_ONCE(meter_interval_ms);
+	bool idle;
+
+	spin_lock_irq(&s->lock);
+	idle = interval == 0 ||
+	       time_after(jiffies,
+			  s->last_read + msecs_to_jiffies(IDLE_TIMEOUT_MS));
+	if (idle)
+		s->running = false;
+	spin_unlock_irq(&s->lock);
+
+	if (idle)
+		return;
+
+	sample(s);
+	schedule_delayed_work(&s->work, msecs_to_jiffies(interval));
+}
+
+/*
+ * Account a reader. The first reader after an idle period takes a snapshot
+ * at once, then leaves further snapshots to the work.
+ */
+static void refresh(struct snd_fw_meter_sampler *s)
+{
+	unsigned int interval = READ_ONCE(meter_interval_ms);
+	bool start;
+
+	spin_lock_irq(&s->lock);
+	s->last_read = jiffies;
+	s->reads++;
+	start = !s->running;
+	s->running = true;
+	spin_unlock_irq(&s->lock);
+
+	if (!start)
+		return;
+
+	sample(s);
+
+	if (interval > 0) {
+		schedule_delayed_work(&s->work, msecs_to_jiffies(interval));
+	} else {
+		spin_lock_irq(&s->lock);
+		s->running = false;
+		spin_unlock_irq(&s->lock);
+	}
+}
+
+/**
+ * snd_fw_meter_sampler_init - initialize a meter sampler
+ * @s: the sampler to initialize
+ * @channels: the number of meter values
+ * @get: the callback to read @channels values from the device
+ * @private_data: the argument for @get
+ *
+ * @get is called in process context and may sleep. It should return a
+ * negative error code on failure.
+ */
+int snd_fw_meter_sampler_init(struct snd_fw_meter_sampler *s,
+			      unsigned int channels,
+			      int (*get)(void *private_data, u32 *values,
+					 unsigned int channels),
+			      void *private_data)
+{
+	u32 *buf;
+
+	if (channels == 0)
+		return -EINVAL;
+
+	buf = kcalloc(channels * 2, sizeof(u32), GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	s->snapshots[0] = buf;
+	s->snapshots[1] = buf + channels;
+	s->front = 0;
+	s->channels = channels;
+	s->samples = 0;
+	s->reads = 0;
+	s->err = -EAGAIN;
+	s->running = false;
+	s->get = get;
+	s->private_data = private_data;
+	mutex_init(&s->mutex);
+	spin_lock_init(&s->lock);
+	INIT_DELAYED_WORK(&s->work, sample_work);
+
+	return 0;
+}
+EXPORT_SYMBOL(snd_fw_meter_sampler_init);
+
+/**
+ * snd_fw_meter_sampler_destroy - stop and free a meter sampler
+ * @s: the sampler, which may be zero-filled if it was never initialized
+ */
+void snd_fw_meter_sampler_destroy(struct snd_fw_meter_sampler *s)
+{
+	if (s->get == NULL)
+		return;
+
+	cancel_delayed_work_sync(&s->work);
+	kfree(s->snapshots[0]);
+	s->snapshots[0] = s->snapshots[1] = NULL;
+	mutex_destroy(&s->mutex);
+	s->get = NULL;
+}
+EXPORT_SYMBOL(snd_fw_meter_sampler_destroy);
+
+/**
+ * snd_fw_meter_sampler_read - read the latest snapshot of meters
+ * @s: the sampler
+ * @values: the buffer for the snapshot, with room for @s->channels values
+ *
+ * Returns zero, or the error of the last attempt to sample the device. The
+ * values are from the last successful sample in both cases.
+ */
+int snd_fw_meter_sampler_read(struct snd_fw_meter_sampler *s, u32 *values)
+{
+	int err;
+
+	refresh(s);
+
+	spin_lock_irq(&s->lock);
+	memcpy(values, s->snapshots[s->front], s->channels * sizeof(u32));
+	err = s->err;
+	spin_unlock_irq(&s->lock);
+
+	return err;
+}
+EXPORT_SYMBOL(snd_fw_meter_sampler_read);
+
+static int meter_ctl_info(struct snd_kcontrol *kctl,
+			  struct snd_ctl_elem_info *einf)
+{
+	struct snd_fw_meter_sampler *s = snd_kcontrol_chip(kctl);
+
+	einf->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	einf->count = min_t(unsigned int, s->channels, CONTROL_CHANNELS_MAX);
+	einf->value.integer.min = 0;
+	einf->value.integer.max = INT_MAX;
+
+	return 0;
+}
+
+static int meter_ctl_get(struct snd_kcontrol *kctl,
+			 struct snd_ctl_elem_value *uval)
+{
+	struct snd_fw_meter_sampler *s = snd_kcontrol_chip(kctl);
+	unsigned int i, count;
+	u32 *front;
+	int err;
+
+	refresh(s);
+
+	count = min_t(unsigned int, s->channels, CONTROL_CHANNELS_MAX);
+
+	spin_lock_irq(&s->lock);
+	front = s->snapshots[s->front];
+	for (i = 0; i < count; i++)
+		uval->value.integer.value[i] = min_t(u32, front[i], INT_MAX);
+	/* the last values stand when the latest sample failed */
+	err = s->samples > 0 ? 0 : s->err;
+	spin_unlock_irq(&s->lock);
+
+	return err;
+}
+
+/**
+ * snd_fw_meter_sampler_add_control - expose a meter sampler to userspace
+ * @s: the initialized sampler
+ * @card: the card to add a control element to
+ * @name: the name of the element
+ *
+ * The element is read-only and volatile. It has one value per channel, up to
+ * the limit of ALSA control elements.
+ */
+int snd_fw_meter_sampler_add_control(struct snd_fw_meter_sampler *s,
+				     struct snd_card *card, const char *name)
+{
+	struct snd_kcontrol_new meter_ctl = {
+		.iface	= SNDRV_CTL_ELEM_IFACE_MIXER,
+		.access	= SNDRV_CTL_ELEM_ACCESS_READ |
+			  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info	= meter_ctl_info,
+		.get	= meter_ctl_get,
+	};
+
+	meter_ctl.name = name;
+
+	return snd_ctl_add(card, snd_ctl_new1(&meter_ctl, s));
+}
+EXPORT_SYMBOL(snd_fw_meter_sampler_add_control);
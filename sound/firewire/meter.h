@@ -0,0 +1,50 @@
+#ifndef SOUND_FIREWIRE_METER_H_INCLUDED
+#define SOUND_FIREWIRE_METER_H_INCLUDED
+
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+struct snd_card;
+
+/**
+ * struct snd_fw_meter_sampler - samples hardware meters in the background
+ * @channels: the number of meter values in a snapshot
+ * @samples: the number of snapshots taken from the device
+ * @reads: the number of snapshots handed out to readers
+ *
+ * This structure polls the meters of a unit while somebody is reading them,
+ * and keeps the latest values in a double-buffered snapshot, so that any
+ * number of readers (proc nodes, control elements) are served by one bus
+ * read per sampling interval.  The sampler stops by itself when nobody has
+ * read it for a while.
+ */
+struct snd_fw_meter_sampler {
+	unsigned int channels;
+	unsigned long samples;
+	unsigned long reads;
+	/* private: */
+	int (*get)(void *private_data, u32 *values, unsigned int channels);
+	void *private_data;
+	struct mutex mutex;
+	spinlock_t lock;
+	u32 *snapshots[2];
+	unsigned int front;
+	int err;
+	bool running;
+	unsigned long last_read;
+	struct delayed_work work;
+};
+
+int snd_fw_meter_sampler_init(struct snd_fw_meter_sampler *s,
+			      unsigned int channels,
+			      int (*get)(void *private_data, u32 *values,
+					 unsigned int channels),
+			      void *private_data);
+void snd_fw_meter_sampler_destroy(struct snd_fw_meter_sampler *s);
+int snd_fw_meter_sampler_read(struct snd_fw_meter_sampler *s, u32 *values);
+int snd_fw_meter_sampler_add_control(struct snd_fw_meter_sampler *s,
+				     struct snd_card *card, const char *name);
+
+#endif
@@ -48,12 +48,10 @@ int avc_stream_set_format(struct fw_unit *unit, enum avc_general_plug_dir dir,
 	return err;
 }
 
-int avc_stream_get_format(struct fw_unit *unit,
-			  enum avc_general_plug_dir dir, unsigned int pid,
-			  u8 *buf, unsigned int *len, unsigned int eid)
+static void fill_get_format_command(u8 *buf, enum avc_general_plug_dir dir,
+				    unsigned int pid, unsigned int eid)
 {
 	unsigned int subfunc;
-	int err;
 
 	if (eid == 0xff)
 		subfunc = 0xc0;	/* SINGLE */
@@ -72,11 +70,26 @@ int avc_stream_get_format(struct fw_unit *unit,
 	buf[9] = 0xff;		/* support status in response */
 	buf[10] = 0xff & eid;	/* entry ID for LIST subfunction */
 	buf[11] = 0xff;		/* padding */
+}
 
-	/* do transaction and check buf[1-7] are the same against command */
-	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
-				  BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
-				  BIT(6) | BIT(7));
+/*
+ * Check buf[1-7] are the same against command. For LIST subfunction, entry ID
+ * is also checked so that responses to several entries can be told apart.
+ */
+static unsigned int get_format_match_bytes(unsigned int eid)
+{
+	unsigned int match = BIT(1) | BIT(2) | BIT(3) | BIT(4) | BIT(5) |
+			     BIT(6) | BIT(7);
+
+	if (eid != 0xff)
+		match |= BIT(10);
+
+	return match;
+}
+
+static int check_get_format(u8 *buf, int err, unsigned int eid,
+			    unsigned int *len)
+{
 	if ((err > 0) && (err < 10))
 		err = -EIO;
 	else if (buf[0] == 0x08)	/* NOT IMPLEMENTED */
@@ -86,13 +99,13 @@ int avc_stream_get_format(struct fw_unit *unit,
 	else if (buf[0] == 0x0b)	/* IN TRANSITION */
 		err = -EAGAIN;
 	/* LIST subfunction has entry ID */
-	else if ((subfunc == 0xc1) && (buf[10] != eid))
+	else if ((eid != 0xff) && (buf[10] != eid))
 		err = -EIO;
 	if (err < 0)
-		goto end;
+		return err;
 
 	/* keep just stream format information */
-	if (subfunc == 0xc0) {
+	if (eid == 0xff) {
 		memmove(buf, buf + 10, err - 10);
 		*len = err - 10;
 	} else {
@@ -100,8 +113,68 @@ int avc_stream_get_format(struct fw_unit *unit,
 		*len = err - 11;
 	}
 
-	err = 0;
+	return 0;
+}
+
+int avc_stream_get_format(struct fw_unit *unit,
+			  enum avc_general_plug_dir dir, unsigned int pid,
+			  u8 *buf, unsigned int *len, unsigned int eid)
+{
+	int err;
+
+	fill_get_format_command(buf, dir, pid, eid);
+
+	err = fcp_avc_transaction(unit, buf, 12, buf, *len,
+				  get_format_match_bytes(eid));
+	return check_get_format(buf, err, eid, len);
+}
+
+/*
+ * Get the entries of the list from the first at once. The entries after the
+ * last one are rejected by the device, thus the number of available entries
+ * is returned, or a negative error code if the first entry is not available.
+ */
+int avc_stream_get_format_list_all(struct fw_unit *unit,
+				   enum avc_general_plug_dir dir,
+				   unsigned int pid, u8 **bufs,
+				   unsigned int *lens, unsigned int count)
+{
+	struct fcp_avc_request *requests;
+	unsigned int eid;
+	int err;
+
+	requests = kcalloc(count, sizeof(*requests), GFP_KERNEL);
+	if (requests == NULL)
+		return -ENOMEM;
+
+	for (eid = 0; eid < count; eid++) {
+		fill_get_format_command(bufs[eid], dir, pid, eid);
+
+		requests[eid].unit = unit;
+		requests[eid].command = bufs[eid];
+		requests[eid].command_size = 12;
+		requests[eid].response = bufs[eid];
+		requests[eid].response_size = lens[eid];
+		requests[eid].response_match_bytes =
+						get_format_match_bytes(eid);
+	}
+
+	err = fcp_avc_transaction_batch(requests, count);
+	if (err < 0)
+		goto end;
+
+	for (eid = 0; eid < count; eid++) {
+		err = check_get_format(bufs[eid], requests[eid].result, eid,
+				       &lens[eid]);
+		/* No entries remained. */
+		if (err == -EINVAL && eid > 0)
+			break;
+		if (err < 0)
+			goto end;
+	}
+	err = eid;
 end:
+	kfree(requests);
 	return err;
 }
 
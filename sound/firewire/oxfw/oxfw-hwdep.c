@@ -122,18 +122,28 @@ static int hwdep_unlock(struct snd_oxfw *oxfw)
 
 	spin_unlock_irq(&oxfw->lock);
 
+	/* Userspace may have changed the formats. */
+	if (err == 0)
+		snd_oxfw_stream_forget_formations(oxfw);
+
 	return err;
 }
 
 static int hwdep_release(struct snd_hwdep *hwdep, struct file *file)
 {
 	struct snd_oxfw *oxfw = hwdep->private_data;
+	bool unlocked = false;
 
 	spin_lock_irq(&oxfw->lock);
-	if (oxfw->dev_lock_count == -1)
+	if (oxfw->dev_lock_count == -1) {
 		oxfw->dev_lock_count = 0;
+		unlocked = true;
+	}
 	spin_unlock_irq(&oxfw->lock);
 
+	if (unlocked)
+		snd_oxfw_stream_forget_formations(oxfw);
+
 	return 0;
 }
 
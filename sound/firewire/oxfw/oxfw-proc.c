@@ -75,6 +75,31 @@ static void proc_read_formation(struct snd_info_entry *entry,
 	}
 }
 
+static void proc_read_avc_cache(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct snd_oxfw *oxfw = entry->private_data;
+
+	snd_iprintf(buffer, "Hits:\t%lu\n", oxfw->avc_cache.hits);
+	snd_iprintf(buffer, "Misses:\t%lu\n", oxfw->avc_cache.misses);
+}
+
+static void proc_read_bandwidth(struct snd_info_entry *entry,
+				struct snd_info_buffer *buffer)
+{
+	struct snd_oxfw *oxfw = entry->private_data;
+
+	fw_iso_resources_dump_plan(oxfw->unit, buffer);
+}
+
+static void proc_read_transactions(struct snd_info_entry *entry,
+				   struct snd_info_buffer *buffer)
+{
+	struct snd_oxfw *oxfw = entry->private_data;
+
+	snd_fw_transaction_stats_dump(&oxfw->transaction_stats, buffer);
+}
+
 static void add_node(struct snd_oxfw *oxfw, struct snd_info_entry *root,
 		     const char *name,
 		     void (*op)(struct snd_info_entry *e,
@@ -109,5 +134,8 @@ void snd_oxfw_proc_init(struct snd_oxfw *oxfw)
 		return;
 	}
 
+	add_node(oxfw, root, "avc_cache", proc_read_avc_cache);
+	add_node(oxfw, root, "bandwidth", proc_read_bandwidth);
 	add_node(oxfw, root, "formation", proc_read_formation);
+	add_node(oxfw, root, "transactions", proc_read_transactions);
 }
@@ -17,7 +17,7 @@
  *  OXFW970: 32.0/44.1/48.0/96.0 Khz, 8 audio channels I/O
  *  OXFW971: 32.0/44.1/48.0/88.2/96.0/192.0 kHz, 16 audio channels I/O, MIDI I/O
  */
-static const unsigned int oxfw_rate_table[] = {
+static const unsigned int oxfw_rate_table[SND_OXFW_RATE_COUNT] = {
 	[0] = 32000,
 	[1] = 44100,
 	[2] = 48000,
@@ -55,6 +55,101 @@ end:
 	return err;
 }
 
+static int rate_index(unsigned int rate)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(oxfw_rate_table); i++) {
+		if (oxfw_rate_table[i] == rate)
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+/* Zero PCM channels give the first format at the rate. */
+static int find_format(struct snd_oxfw *oxfw, struct amdtp_stream *s,
+		       unsigned int rate, unsigned int pcm_channels)
+{
+	u8 (*index)[AMDTP_MAX_CHANNELS_FOR_PCM + 1];
+	int r;
+
+	if (s == &oxfw->tx_stream)
+		index = oxfw->tx_format_index;
+	else
+		index = oxfw->rx_format_index;
+
+	r = rate_index(rate);
+	if (r < 0 || pcm_channels > AMDTP_MAX_CHANNELS_FOR_PCM ||
+	    index[r][pcm_channels] == 0)
+		return -EINVAL;
+
+	return index[r][pcm_channels] - 1;
+}
+
+static void index_formats(u8 **formats,
+			  u8 (*index)[AMDTP_MAX_CHANNELS_FOR_PCM + 1])
+{
+	struct snd_oxfw_stream_formation formation;
+	unsigned int i;
+	int r;
+
+	memset(index, 0, sizeof(u8) * SND_OXFW_RATE_COUNT *
+			 (AMDTP_MAX_CHANNELS_FOR_PCM + 1));
+
+	for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; i++) {
+		if (formats[i] == NULL)
+			break;
+		if (snd_oxfw_stream_parse_format(formats[i], &formation) < 0)
+			continue;
+
+		r = rate_index(formation.rate);
+		if (r < 0)
+			continue;
+		if (index[r][formation.pcm] == 0)
+			index[r][formation.pcm] = i + 1;
+		if (index[r][0] == 0)
+			index[r][0] = i + 1;
+	}
+}
+
+/*
+ * The rate is common to both plugs, thus the formation of the other plug is
+ * forgotten when the rate changes.
+ */
+static void set_current_formation(struct snd_oxfw *oxfw,
+				  enum avc_general_plug_dir dir,
+				  struct snd_oxfw_stream_formation *formation)
+{
+	struct snd_oxfw_stream_formation *curr;
+	bool *known, *opposite_known;
+
+	if (dir == AVC_GENERAL_PLUG_DIR_OUT) {
+		curr = &oxfw->tx_current;
+		known = &oxfw->tx_current_known;
+		opposite_known = &oxfw->rx_current_known;
+	} else {
+		curr = &oxfw->rx_current;
+		known = &oxfw->rx_current_known;
+		opposite_known = &oxfw->tx_current_known;
+	}
+
+	spin_lock_irq(&oxfw->lock);
+	if (!*known || curr->rate != formation->rate)
+		*opposite_known = false;
+	*curr = *formation;
+	*known = true;
+	spin_unlock_irq(&oxfw->lock);
+}
+
+void snd_oxfw_stream_forget_formations(struct snd_oxfw *oxfw)
+{
+	spin_lock_irq(&oxfw->lock);
+	oxfw->tx_current_known = false;
+	oxfw->rx_current_known = false;
+	spin_unlock_irq(&oxfw->lock);
+}
+
 static int set_stream_format(struct snd_oxfw *oxfw, struct amdtp_stream *s,
 			     unsigned int rate, unsigned int pcm_channels)
 {
@@ -73,30 +168,76 @@ static int set_stream_format(struct snd_oxfw *oxfw, struct amdtp_stream *s,
 	}
 
 	/* Seek stream format for requirements. */
-	for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; i++) {
-		err = snd_oxfw_stream_parse_format(formats[i], &formation);
-		if (err < 0)
-			return err;
-
-		if ((formation.rate == rate) && (formation.pcm == pcm_channels))
-			break;
-	}
-	if (i == SND_OXFW_STREAM_FORMAT_ENTRIES)
-		return -EINVAL;
+	i = find_format(oxfw, s, rate, pcm_channels);
+	if (i < 0)
+		return i;
+	err = snd_oxfw_stream_parse_format(formats[i], &formation);
+	if (err < 0)
+		return err;
 
 	/* If assumed, just change rate. */
-	if (oxfw->assumed)
-		return set_rate(oxfw, rate);
+	if (oxfw->assumed) {
+		err = set_rate(oxfw, rate);
+		goto end;
+	}
 
 	/* Calculate format length. */
 	len = 5 + formats[i][4] * 2;
 
 	err = avc_stream_set_format(oxfw->unit, dir, 0, formats[i], len);
 	if (err < 0)
-		return err;
+		goto end;
 
 	/* Some requests just after changing format causes freezing. */
 	msleep(100);
+end:
+	/* A failed request may have changed the plugs partially. */
+	if (err < 0)
+		snd_oxfw_stream_forget_formations(oxfw);
+	else
+		set_current_formation(oxfw, dir, &formation);
+
+	return err;
+}
+
+/*
+ * Seek the formation with the least PCM channels at the rate, which still
+ * transfers MIDI messages. It saves bandwidth on the bus when no PCM
+ * substreams require specific channels.
+ */
+static int select_formation_for_midi(struct snd_oxfw *oxfw,
+				     struct amdtp_stream *stream,
+				     unsigned int rate,
+				     struct snd_oxfw_stream_formation *selected)
+{
+	u8 **formats;
+	struct snd_oxfw_stream_formation formation;
+	unsigned int i;
+	int err;
+
+	if (stream == &oxfw->tx_stream)
+		formats = oxfw->tx_stream_formats;
+	else
+		formats = oxfw->rx_stream_formats;
+
+	selected->pcm = 0;
+	for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; i++) {
+		if (formats[i] == NULL)
+			break;
+
+		err = snd_oxfw_stream_parse_format(formats[i], &formation);
+		if (err < 0)
+			return err;
+		if (formation.rate != rate ||
+		    formation.pcm == 0 || formation.midi == 0)
+			continue;
+
+		if (selected->pcm == 0 || formation.pcm < selected->pcm)
+			*selected = formation;
+	}
+
+	if (selected->pcm == 0)
+		return -EINVAL;
 
 	return 0;
 }
@@ -112,51 +253,118 @@ static void stop_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 		cmp_connection_break(&oxfw->in_conn);
 }
 
-static int start_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream,
-			unsigned int rate, unsigned int pcm_channels)
+/* The connection is kept for a while to be reused by next start. */
+static void release_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
+{
+	amdtp_stream_pcm_abort(stream);
+	amdtp_stream_stop(stream);
+
+	if (stream == &oxfw->tx_stream)
+		cmp_connection_release(&oxfw->out_conn);
+	else
+		cmp_connection_release(&oxfw->in_conn);
+}
+
+static int set_stream_parameters(struct snd_oxfw *oxfw,
+				 struct amdtp_stream *stream,
+				 unsigned int rate, unsigned int pcm_channels)
 {
 	u8 **formats;
-	struct cmp_connection *conn;
 	struct snd_oxfw_stream_formation formation;
-	unsigned int i, midi_ports;
-	int err;
+	unsigned int midi_ports;
+	int i, err;
 
-	if (stream == &oxfw->rx_stream) {
+	if (stream == &oxfw->rx_stream)
 		formats = oxfw->rx_stream_formats;
-		conn = &oxfw->in_conn;
-	} else {
+	else
 		formats = oxfw->tx_stream_formats;
-		conn = &oxfw->out_conn;
-	}
 
 	/* Get stream format */
-	for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; i++) {
-		if (formats[i] == NULL)
-			break;
-
-		err = snd_oxfw_stream_parse_format(formats[i], &formation);
-		if (err < 0)
-			goto end;
-		if (rate != formation.rate)
-			continue;
-		if (pcm_channels == 0 ||  pcm_channels == formation.pcm)
-			break;
-	}
-	if (i == SND_OXFW_STREAM_FORMAT_ENTRIES) {
-		err = -EINVAL;
-		goto end;
-	}
+	i = find_format(oxfw, stream, rate, pcm_channels);
+	if (i < 0)
+		return i;
+	err = snd_oxfw_stream_parse_format(formats[i], &formation);
+	if (err < 0)
+		return err;
 
 	pcm_channels = formation.pcm;
 	midi_ports = DIV_ROUND_UP(formation.midi, 8);
 
 	/* The stream should have one pcm channels at least */
-	if (pcm_channels == 0) {
-		err = -EINVAL;
-		goto end;
-	}
+	if (pcm_channels == 0)
+		return -EINVAL;
 	amdtp_stream_set_parameters(stream, rate, pcm_channels, midi_ports);
 
+	return 0;
+}
+
+/*
+ * The requested stream uses the given PCM channels. The other one keeps the
+ * formation which the device currently uses on its plug.
+ */
+static int set_duplex_parameters(struct snd_oxfw *oxfw,
+				 struct amdtp_stream *stream,
+				 struct amdtp_stream *requested,
+				 unsigned int rate, unsigned int pcm_channels)
+{
+	struct snd_oxfw_stream_formation formation;
+	enum avc_general_plug_dir dir;
+	int err;
+
+	if (stream != requested) {
+		if (stream == &oxfw->tx_stream)
+			dir = AVC_GENERAL_PLUG_DIR_OUT;
+		else
+			dir = AVC_GENERAL_PLUG_DIR_IN;
+
+		err = snd_oxfw_stream_get_current_formation(oxfw, dir,
+							    &formation);
+		if (err < 0)
+			return err;
+		pcm_channels = (formation.rate == rate) ? formation.pcm : 0;
+	}
+
+	return set_stream_parameters(oxfw, stream, rate, pcm_channels);
+}
+
+/*
+ * The streams are checked together against the bandwidth left on the bus,
+ * thus the second one can not fail for bandwidth after the first starts.
+ */
+static int check_bandwidth(struct snd_oxfw *oxfw,
+			   struct amdtp_stream **streams, unsigned int count)
+{
+	struct fw_iso_resources *resources[2];
+	unsigned int max_payload_bytes[2];
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < count; i++) {
+		if (streams[i] == &oxfw->rx_stream)
+			resources[i] = &oxfw->in_conn.resources;
+		else
+			resources[i] = &oxfw->out_conn.resources;
+		max_payload_bytes[i] = amdtp_stream_get_max_payload(streams[i]);
+	}
+
+	err = fw_iso_resources_check(resources, max_payload_bytes, count,
+				     fw_parent_device(oxfw->unit)->max_speed);
+	if (err < 0)
+		dev_err(&oxfw->unit->device,
+			"no bandwidth for the streams: %d\n", err);
+	return err;
+}
+
+static int start_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
+{
+	struct cmp_connection *conn;
+	int err;
+
+	if (stream == &oxfw->rx_stream)
+		conn = &oxfw->in_conn;
+	else
+		conn = &oxfw->out_conn;
+
 	err = cmp_connection_establish(conn,
 				       amdtp_stream_get_max_payload(stream));
 	if (err < 0)
@@ -203,8 +411,7 @@ static int check_connection_used_by_others(struct snd_oxfw *oxfw,
 	return err;
 }
 
-int snd_oxfw_stream_init_simplex(struct snd_oxfw *oxfw,
-				 struct amdtp_stream *stream)
+static int init_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 {
 	struct cmp_connection *conn;
 	enum cmp_direction c_dir;
@@ -221,7 +428,8 @@ int snd_oxfw_stream_init_simplex(struct snd_oxfw *oxfw,
 		s_dir = AMDTP_OUT_STREAM;
 	}
 
-	err = cmp_connection_init(conn, oxfw->unit, c_dir, 0);
+	err = cmp_connection_init(conn, oxfw->unit, &oxfw->transaction_stats,
+				  c_dir, 0);
 	if (err < 0)
 		goto end;
 
@@ -239,64 +447,145 @@ end:
 	return err;
 }
 
-int snd_oxfw_stream_start_simplex(struct snd_oxfw *oxfw,
-				  struct amdtp_stream *stream,
-				  unsigned int rate, unsigned int pcm_channels)
+/*
+ * This function should be called before starting the stream or after stopping
+ * the streams.
+ */
+static void destroy_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 {
-	struct amdtp_stream *opposite;
-	struct snd_oxfw_stream_formation formation;
-	enum avc_general_plug_dir dir;
-	unsigned int substreams, opposite_substreams;
+	struct cmp_connection *conn;
+
+	if (stream == &oxfw->tx_stream)
+		conn = &oxfw->out_conn;
+	else
+		conn = &oxfw->in_conn;
+
+	amdtp_stream_destroy(stream);
+	cmp_connection_destroy(conn);
+}
+
+/*
+ * When the device has both directions, the packets to the device are timed
+ * by the ones from it, so that the two directions never drift apart. Then the
+ * stream from the device runs whenever any of the streams runs.
+ */
+int snd_oxfw_stream_init_duplex(struct snd_oxfw *oxfw)
+{
+	int err;
+
+	err = init_stream(oxfw, &oxfw->rx_stream);
+	if (err < 0)
+		return err;
+
+	if (oxfw->has_output) {
+		err = init_stream(oxfw, &oxfw->tx_stream);
+		if (err < 0) {
+			destroy_stream(oxfw, &oxfw->rx_stream);
+			return err;
+		}
+
+		amdtp_stream_set_sync(CIP_SYNC_TO_DEVICE,
+				      &oxfw->tx_stream, &oxfw->rx_stream);
+	}
+
+	return 0;
+}
+
+int snd_oxfw_stream_start_duplex(struct snd_oxfw *oxfw,
+				 struct amdtp_stream *stream,
+				 unsigned int rate, unsigned int pcm_channels)
+{
+	struct amdtp_stream *tx = NULL, *rx = &oxfw->rx_stream;
+	struct amdtp_stream *streams[2], *opposite;
+	struct snd_oxfw_stream_formation formation, selected;
+	enum avc_general_plug_dir dir, opposite_dir;
+	unsigned int i, count, opposite_channels;
+	bool run_tx, run_rx;
 	int err = 0;
 
+	if (oxfw->has_output)
+		tx = &oxfw->tx_stream;
+	run_rx = oxfw->playback_substreams > 0;
+	run_tx = tx != NULL && (oxfw->capture_substreams > 0 || run_rx);
+
+	if (!run_tx && !run_rx)
+		goto end;
+
 	if (stream == &oxfw->tx_stream) {
-		substreams = oxfw->capture_substreams;
-		opposite = &oxfw->rx_stream;
-		opposite_substreams = oxfw->playback_substreams;
 		dir = AVC_GENERAL_PLUG_DIR_OUT;
+		opposite = rx;
+		opposite_dir = AVC_GENERAL_PLUG_DIR_IN;
 	} else {
-		substreams = oxfw->playback_substreams;
-		opposite_substreams = oxfw->capture_substreams;
-
-		if (oxfw->has_output)
-			opposite = &oxfw->rx_stream;
-		else
-			opposite = NULL;
-
 		dir = AVC_GENERAL_PLUG_DIR_IN;
+		opposite = tx;
+		opposite_dir = AVC_GENERAL_PLUG_DIR_OUT;
 	}
 
-	if (substreams == 0)
-		goto end;
-
 	/*
 	 * Considering JACK/FFADO streaming:
 	 * TODO: This can be removed hwdep functionality becomes popular.
 	 */
-	err = check_connection_used_by_others(oxfw, stream);
-	if (err < 0)
-		goto end;
+	if (run_tx) {
+		err = check_connection_used_by_others(oxfw, tx);
+		if (err < 0)
+			goto end;
+	}
+	if (run_rx) {
+		err = check_connection_used_by_others(oxfw, rx);
+		if (err < 0)
+			goto end;
+	}
 
-	/* packet queueing error */
-	if (amdtp_streaming_error(stream))
-		stop_stream(oxfw, stream);
+	/* packet queueing error, in either direction of the pair */
+	if (amdtp_streaming_error(rx) ||
+	    (tx != NULL && amdtp_streaming_error(tx))) {
+		stop_stream(oxfw, rx);
+		if (tx != NULL)
+			stop_stream(oxfw, tx);
+	}
 
 	err = snd_oxfw_stream_get_current_formation(oxfw, dir, &formation);
 	if (err < 0)
 		goto end;
 	if (rate == 0)
 		rate = formation.rate;
-	if (pcm_channels == 0)
-		pcm_channels = formation.pcm;
+	if (pcm_channels == 0) {
+		/*
+		 * MIDI substreams require no specific PCM channels. Unless any
+		 * streams run, use the least formation for them. Wider PCM
+		 * substreams change the formation later.
+		 */
+		if (!amdtp_stream_running(rx) &&
+		    (tx == NULL || !amdtp_stream_running(tx)) &&
+		    select_formation_for_midi(oxfw, stream, rate,
+					      &selected) >= 0)
+			pcm_channels = selected.pcm;
+		else
+			pcm_channels = formation.pcm;
+	}
 
+	/*
+	 * The rate is common to the device, thus both directions follow. At a
+	 * new rate, the opposite plug keeps its PCM channels if the device has
+	 * such a formation at the rate, else it takes the first one listed at
+	 * the rate. Either is set explicitly, so that the stream is started in
+	 * the formation which the device transfers.
+	 */
 	if ((formation.rate != rate) || (formation.pcm != pcm_channels)) {
+		opposite_channels = 0;
+		if (formation.rate == rate)
+			opposite = NULL;
 		if (opposite != NULL) {
-			err = check_connection_used_by_others(oxfw, opposite);
+			err = snd_oxfw_stream_get_current_formation(oxfw,
+						opposite_dir, &selected);
 			if (err < 0)
 				goto end;
-			stop_stream(oxfw, opposite);
+			opposite_channels = selected.pcm;
 		}
-		stop_stream(oxfw, stream);
+
+		stop_stream(oxfw, rx);
+		if (tx != NULL)
+			stop_stream(oxfw, tx);
 
 		err = set_stream_format(oxfw, stream, rate, pcm_channels);
 		if (err < 0) {
@@ -305,81 +594,134 @@ int snd_oxfw_stream_start_simplex(struct snd_oxfw *oxfw,
 			goto end;
 		}
 
-		/* Start opposite stream if needed. */
-		if (opposite && !amdtp_stream_running(opposite) &&
-		    (opposite_substreams > 0)) {
-			err = start_stream(oxfw, opposite, rate, 0);
+		if (opposite != NULL) {
+			if (find_format(oxfw, opposite, rate,
+					opposite_channels) < 0)
+				opposite_channels = 0;
+			err = set_stream_format(oxfw, opposite, rate,
+						opposite_channels);
 			if (err < 0) {
 				dev_err(&oxfw->unit->device,
-					"fail to restart stream: %d\n", err);
+					"fail to set stream format: %d\n",
+					err);
 				goto end;
 			}
 		}
 	}
 
-	/* Start requested stream. */
-	if (!amdtp_stream_running(stream)) {
-		err = start_stream(oxfw, stream, rate, pcm_channels);
+	/* The stream to the device can not run without its timing source. */
+	if (tx != NULL && !amdtp_stream_running(tx) && amdtp_stream_running(rx))
+		stop_stream(oxfw, rx);
+
+	count = 0;
+	if (run_tx && !amdtp_stream_running(tx)) {
+		err = set_duplex_parameters(oxfw, tx, stream, rate,
+					    pcm_channels);
 		if (err < 0)
+			goto end;
+		streams[count++] = tx;
+	}
+	if (run_rx && !amdtp_stream_running(rx)) {
+		err = set_duplex_parameters(oxfw, rx, stream, rate,
+					    pcm_channels);
+		if (err < 0)
+			goto end;
+		streams[count++] = rx;
+	}
+	err = check_bandwidth(oxfw, streams, count);
+	if (err < 0)
+		goto end;
+
+	for (i = 0; i < count; i++) {
+		err = start_stream(oxfw, streams[i]);
+		if (err < 0) {
 			dev_err(&oxfw->unit->device,
 				"fail to start stream: %d\n", err);
+			break;
+		}
 	}
 end:
 	return err;
 }
 
-void snd_oxfw_stream_stop_simplex(struct snd_oxfw *oxfw,
-				  struct amdtp_stream *stream)
+void snd_oxfw_stream_stop_duplex(struct snd_oxfw *oxfw)
 {
-	if (((stream == &oxfw->tx_stream) && (oxfw->capture_substreams > 0)) ||
-	    ((stream == &oxfw->rx_stream) && (oxfw->playback_substreams > 0)))
+	if (oxfw->playback_substreams > 0)
 		return;
 
-	stop_stream(oxfw, stream);
+	release_stream(oxfw, &oxfw->rx_stream);
+
+	if (oxfw->has_output && oxfw->capture_substreams == 0)
+		release_stream(oxfw, &oxfw->tx_stream);
 }
 
-/*
- * This function should be called before starting the stream or after stopping
- * the streams.
- */
-void snd_oxfw_stream_destroy_simplex(struct snd_oxfw *oxfw,
-				     struct amdtp_stream *stream)
+void snd_oxfw_stream_destroy_duplex(struct snd_oxfw *oxfw)
 {
-	struct cmp_connection *conn;
-
-	if (stream == &oxfw->tx_stream)
-		conn = &oxfw->out_conn;
-	else
-		conn = &oxfw->in_conn;
-
-	amdtp_stream_destroy(stream);
-	cmp_connection_destroy(conn);
+	destroy_stream(oxfw, &oxfw->rx_stream);
+	if (oxfw->has_output)
+		destroy_stream(oxfw, &oxfw->tx_stream);
 }
 
-void snd_oxfw_stream_update_simplex(struct snd_oxfw *oxfw,
-				    struct amdtp_stream *stream)
+static int update_stream(struct snd_oxfw *oxfw, struct amdtp_stream *stream)
 {
 	struct cmp_connection *conn;
+	int err;
 
 	if (stream == &oxfw->tx_stream)
 		conn = &oxfw->out_conn;
 	else
 		conn = &oxfw->in_conn;
 
-	if (cmp_connection_update(conn) < 0)
+	err = cmp_connection_update(conn);
+	if (err < 0)
 		stop_stream(oxfw, stream);
 	else
 		amdtp_stream_update(stream);
+
+	return err;
 }
 
+void snd_oxfw_stream_update_duplex(struct snd_oxfw *oxfw)
+{
+	/* The device may have been reset, or configured by others. */
+	snd_oxfw_stream_forget_formations(oxfw);
+
+	/* Without the stream from the device, the other one has no timing. */
+	if (oxfw->has_output && update_stream(oxfw, &oxfw->tx_stream) < 0) {
+		stop_stream(oxfw, &oxfw->rx_stream);
+		return;
+	}
+
+	update_stream(oxfw, &oxfw->rx_stream);
+}
+
+/* The formation is queried only when it is not known yet. */
 int snd_oxfw_stream_get_current_formation(struct snd_oxfw *oxfw,
 				enum avc_general_plug_dir dir,
 				struct snd_oxfw_stream_formation *formation)
 {
+	struct snd_oxfw_stream_formation *curr;
+	bool *known, cached;
 	u8 *format;
 	unsigned int len;
 	int err;
 
+	if (dir == AVC_GENERAL_PLUG_DIR_OUT) {
+		curr = &oxfw->tx_current;
+		known = &oxfw->tx_current_known;
+	} else {
+		curr = &oxfw->rx_current;
+		known = &oxfw->rx_current_known;
+	}
+
+	spin_lock_irq(&oxfw->lock);
+	cached = *known;
+	if (cached)
+		*formation = *curr;
+	spin_unlock_irq(&oxfw->lock);
+	if (cached)
+		return 0;
+
 	len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
 	format = kmalloc(len, GFP_KERNEL);
 	if (format == NULL)
@@ -394,6 +736,13 @@ int snd_oxfw_stream_get_current_formation(struct snd_oxfw *oxfw,
 	}
 
 	err = snd_oxfw_stream_parse_format(format, formation);
+	if (err < 0)
+		goto end;
+
+	spin_lock_irq(&oxfw->lock);
+	*curr = *formation;
+	*known = true;
+	spin_unlock_irq(&oxfw->lock);
 end:
 	kfree(format);
 	return err;
@@ -544,12 +893,14 @@ static int fill_stream_formats(struct snd_oxfw *oxfw,
 			       enum avc_general_plug_dir dir,
 			       unsigned short pid)
 {
-	u8 *buf, **formats;
-	unsigned int len, eid = 0;
+	u8 *buf, **formats, *bufs[SND_OXFW_STREAM_FORMAT_ENTRIES];
+	unsigned int lens[SND_OXFW_STREAM_FORMAT_ENTRIES];
+	unsigned int count, eid;
 	struct snd_oxfw_stream_formation dummy;
 	int err;
 
-	buf = kmalloc(AVC_GENERIC_FRAME_MAXIMUM_BYTES, GFP_KERNEL);
+	buf = kmalloc_array(SND_OXFW_STREAM_FORMAT_ENTRIES,
+			    AVC_GENERIC_FRAME_MAXIMUM_BYTES, GFP_KERNEL);
 	if (buf == NULL)
 		return -ENOMEM;
 
@@ -558,74 +909,179 @@ static int fill_stream_formats(struct snd_oxfw *oxfw,
 	else
 		formats = oxfw->rx_stream_formats;
 
-	/* get first entry */
-	len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
-	err = avc_stream_get_format_list(oxfw->unit, dir, 0, buf, &len, 0);
+	for (eid = 0; eid < SND_OXFW_STREAM_FORMAT_ENTRIES; eid++) {
+		bufs[eid] = buf + eid * AVC_GENERIC_FRAME_MAXIMUM_BYTES;
+		lens[eid] = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
+	}
+
+	/* Request all of entries at once. */
+	err = avc_stream_get_format_list_all(oxfw->unit, dir, pid, bufs, lens,
+					     SND_OXFW_STREAM_FORMAT_ENTRIES);
 	if (err == -ENOSYS) {
 		/* LIST subfunction is not implemented */
-		len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
-		err = assume_stream_formats(oxfw, dir, pid, buf, &len,
+		lens[0] = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
+		err = assume_stream_formats(oxfw, dir, pid, bufs[0], &lens[0],
 					    formats);
 		goto end;
 	} else if (err < 0) {
 		dev_err(&oxfw->unit->device,
-			"fail to get stream format %d for isoc %s plug %d:%d\n",
-			eid, (dir == AVC_GENERAL_PLUG_DIR_IN) ? "in" : "out",
+			"fail to get stream formats for isoc %s plug %d:%d\n",
+			(dir == AVC_GENERAL_PLUG_DIR_IN) ? "in" : "out",
 			pid, err);
 		goto end;
 	}
+	count = err;
 
 	/* LIST subfunction is implemented */
-	while (eid < SND_OXFW_STREAM_FORMAT_ENTRIES) {
+	for (eid = 0; eid < count; eid++) {
 		/* The format is too short. */
-		if (len < 3) {
+		if (lens[eid] < 3) {
 			err = -EIO;
 			break;
 		}
 
 		/* parse and set stream format */
-		err = snd_oxfw_stream_parse_format(buf, &dummy);
+		err = snd_oxfw_stream_parse_format(bufs[eid], &dummy);
 		if (err < 0)
 			break;
 
-		formats[eid] = kmalloc(len, GFP_KERNEL);
+		formats[eid] = kmemdup(bufs[eid], lens[eid], GFP_KERNEL);
 		if (formats[eid] == NULL) {
 			err = -ENOMEM;
 			break;
 		}
-		memcpy(formats[eid], buf, len);
-
-		/* get next entry */
-		len = AVC_GENERIC_FRAME_MAXIMUM_BYTES;
-		err = avc_stream_get_format_list(oxfw->unit, dir, 0,
-						 buf, &len, ++eid);
-		/* No entries remained. */
-		if (err == -EINVAL) {
-			err = 0;
-			break;
-		} else if (err < 0) {
-			dev_err(&oxfw->unit->device,
-			"fail to get stream format %d for isoc %s plug %d:%d\n",
-				eid, (dir == AVC_GENERAL_PLUG_DIR_IN) ? "in" :
-									"out",
-				pid, err);
-			break;
-		}
 	}
 end:
 	kfree(buf);
 	return err;
 }
 
+/*
+ * The result of discovery is cached per GUID and firmware, so that rebinding
+ * the unit takes no AV/C commands. The formats are packed one after another,
+ * and the length of each is given by the number of its entries.
+ */
+struct oxfw_discovery {
+	bool has_output;
+	bool assumed;
+	u8 tx_formats;
+	u8 rx_formats;
+	u8 formats[];
+};
+
+static unsigned int format_length(const u8 *format)
+{
+	return 5 + format[4] * 2;
+}
+
+static void save_discovery(struct snd_oxfw *oxfw, u32 firmware)
+{
+	u8 **all[2] = { oxfw->tx_stream_formats, oxfw->rx_stream_formats };
+	u8 counts[2] = { 0, 0 };
+	struct oxfw_discovery *discovery;
+	unsigned int i, j, size;
+	u8 *pos;
+
+	size = sizeof(*discovery);
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < SND_OXFW_STREAM_FORMAT_ENTRIES; j++) {
+			if (all[i][j] == NULL)
+				break;
+			size += format_length(all[i][j]);
+			counts[i]++;
+		}
+	}
+
+	discovery = kmalloc(size, GFP_KERNEL);
+	if (discovery == NULL)
+		return;
+	discovery->has_output = oxfw->has_output;
+	discovery->assumed = oxfw->assumed;
+	discovery->tx_formats = counts[0];
+	discovery->rx_formats = counts[1];
+
+	pos = discovery->formats;
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < counts[i]; j++) {
+			memcpy(pos, all[i][j], format_length(all[i][j]));
+			pos += format_length(all[i][j]);
+		}
+	}
+
+	snd_fw_discovery_save(oxfw->unit, firmware, discovery, size);
+	kfree(discovery);
+}
+
+static bool load_discovery(struct snd_oxfw *oxfw, u32 firmware)
+{
+	u8 **all[2] = { oxfw->tx_stream_formats, oxfw->rx_stream_formats };
+	struct oxfw_discovery *discovery;
+	unsigned int i, j, counts[2], len;
+	size_t size;
+	u8 *pos, *end;
+
+	discovery = snd_fw_discovery_load(oxfw->unit, firmware, &size);
+	if (discovery == NULL)
+		return false;
+
+	counts[0] = discovery->tx_formats;
+	counts[1] = discovery->rx_formats;
+	pos = discovery->formats;
+	end = (u8 *)discovery + size;
+
+	for (i = 0; i < 2; i++) {
+		if (counts[i] > SND_OXFW_STREAM_FORMAT_ENTRIES)
+			goto error;
+		for (j = 0; j < counts[i]; j++) {
+			if (pos + 5 > end || pos + format_length(pos) > end)
+				goto error;
+			len = format_length(pos);
+			all[i][j] = kmemdup(pos, len, GFP_KERNEL);
+			if (all[i][j] == NULL)
+				goto error;
+			pos += len;
+		}
+	}
+
+	oxfw->has_output = discovery->has_output;
+	oxfw->assumed = discovery->assumed;
+
+	kfree(discovery);
+	return true;
+error:
+	/* Discover again. */
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < SND_OXFW_STREAM_FORMAT_ENTRIES; j++) {
+			kfree(all[i][j]);
+			all[i][j] = NULL;
+		}
+	}
+	kfree(discovery);
+	return false;
+}
+
 int snd_oxfw_stream_discover(struct snd_oxfw *oxfw)
 {
+	struct device *dev = &oxfw->unit->device;
 	u8 plugs[AVC_PLUG_INFO_BUF_BYTES];
+	ktime_t stamp = ktime_get();
+	__be32 firmware;
+	bool cacheable;
 	int err;
 
+	cacheable = snd_fw_transaction_counted(&oxfw->transaction_stats,
+					       TCODE_READ_QUADLET_REQUEST,
+					       OXFORD_FIRMWARE_ID_ADDRESS,
+					       &firmware, 4, 0) >= 0;
+	if (cacheable && load_discovery(oxfw, be32_to_cpu(firmware))) {
+		snd_fw_trace_phase(dev, "discovery from cache", &stamp);
+		goto index;
+	}
+
 	/* the number of plugs for isoc in/out, ext in/out  */
 	err = avc_general_get_plug_info(oxfw->unit, 0x1f, 0x07, 0x00, plugs);
 	if (err < 0) {
-		dev_err(&oxfw->unit->device,
+		dev_err(dev,
 		"fail to get info for isoc/external in/out plugs: %d\n",
 			err);
 		goto end;
@@ -633,6 +1089,7 @@ int snd_oxfw_stream_discover(struct snd_oxfw *oxfw)
 		err = -ENOSYS;
 		goto end;
 	}
+	snd_fw_trace_phase(dev, "plug info", &stamp);
 
 	/* use oPCR[0] if exists */
 	if (plugs[1] > 0) {
@@ -643,8 +1100,19 @@ int snd_oxfw_stream_discover(struct snd_oxfw *oxfw)
 	}
 
 	/* use iPCR[0] if exists */
-	if (plugs[0] > 0)
+	if (plugs[0] > 0) {
 		err = fill_stream_formats(oxfw, AVC_GENERAL_PLUG_DIR_IN, 0);
+		if (err < 0)
+			goto end;
+	}
+	snd_fw_trace_phase(dev, "stream formats", &stamp);
+
+	if (cacheable)
+		save_discovery(oxfw, be32_to_cpu(firmware));
+index:
+	index_formats(oxfw->tx_stream_formats, oxfw->tx_format_index);
+	index_formats(oxfw->rx_stream_formats, oxfw->rx_format_index);
+	err = 0;
 end:
 	return err;
 }
@@ -7,9 +7,6 @@
 
 #include "oxfw.h"
 
-#define OXFORD_FIRMWARE_ID_ADDRESS	(CSR_REGISTER_BASE + 0x50000)
-/* 0x970?vvvv or 0x971?vvvv, where vvvv = firmware version */
-
 #define OXFORD_HARDWARE_ID_ADDRESS	(CSR_REGISTER_BASE + 0x90020)
 #define OXFORD_HARDWARE_ID_OXFW970	0x39443841
 #define OXFORD_HARDWARE_ID_OXFW971	0x39373100
@@ -74,8 +71,10 @@ static int name_card(struct snd_oxfw *oxfw)
 	if (err < 0)
 		goto end;
 
-	err = snd_fw_transaction(oxfw->unit, TCODE_READ_QUADLET_REQUEST,
-				 OXFORD_FIRMWARE_ID_ADDRESS, &firmware, 4, 0);
+	err = snd_fw_transaction_counted(&oxfw->transaction_stats,
+					 TCODE_READ_QUADLET_REQUEST,
+					 OXFORD_FIRMWARE_ID_ADDRESS,
+					 &firmware, 4, 0);
 	if (err < 0)
 		goto end;
 	be32_to_cpus(&firmware);
@@ -115,10 +114,9 @@ static void oxfw_card_free(struct snd_card *card)
 	struct snd_oxfw *oxfw = card->private_data;
 	unsigned int i;
 
-	snd_oxfw_stream_destroy_simplex(oxfw, &oxfw->rx_stream);
-	if (oxfw->has_output)
-		snd_oxfw_stream_destroy_simplex(oxfw, &oxfw->tx_stream);
+	snd_oxfw_stream_destroy_duplex(oxfw);
 
+	fcp_avc_cache_destroy(&oxfw->avc_cache);
 	fw_unit_put(oxfw->unit);
 
 	for (i = 0; i < SND_OXFW_STREAM_FORMAT_ENTRIES; i++) {
@@ -149,6 +147,9 @@ static int oxfw_probe(struct fw_unit *unit,
 	oxfw->card = card;
 	mutex_init(&oxfw->mutex);
 	oxfw->unit = fw_unit_get(unit);
+	snd_fw_transaction_stats_init(&oxfw->transaction_stats, oxfw->unit);
+	fcp_avc_cache_init(&oxfw->avc_cache, oxfw->unit,
+			   &oxfw->transaction_stats);
 	oxfw->device_info = (const struct device_info *)id->driver_data;
 	spin_lock_init(&oxfw->lock);
 	init_waitqueue_head(&oxfw->hwdep_wait);
@@ -181,20 +182,21 @@ static int oxfw_probe(struct fw_unit *unit,
 	if (err < 0)
 		goto error;
 
-	err = snd_oxfw_stream_init_simplex(oxfw, &oxfw->rx_stream);
+	err = snd_oxfw_stream_init_duplex(oxfw);
+	if (err < 0)
+		goto error;
+	err = amdtp_stream_add_pcm_meters(&oxfw->rx_stream, card);
 	if (err < 0)
 		goto error;
 	if (oxfw->has_output) {
-		err = snd_oxfw_stream_init_simplex(oxfw, &oxfw->tx_stream);
+		err = amdtp_stream_add_pcm_meters(&oxfw->tx_stream, card);
 		if (err < 0)
 			goto error;
 	}
 
 	err = snd_card_register(card);
 	if (err < 0) {
-		snd_oxfw_stream_destroy_simplex(oxfw, &oxfw->rx_stream);
-		if (oxfw->has_output)
-			snd_oxfw_stream_destroy_simplex(oxfw, &oxfw->tx_stream);
+		snd_oxfw_stream_destroy_duplex(oxfw);
 		goto error;
 	}
 	dev_set_drvdata(&unit->device, oxfw);
@@ -213,9 +215,7 @@ static void oxfw_bus_reset(struct fw_unit *unit)
 
 	mutex_lock(&oxfw->mutex);
 
-	snd_oxfw_stream_update_simplex(oxfw, &oxfw->rx_stream);
-	if (oxfw->has_output)
-		snd_oxfw_stream_update_simplex(oxfw, &oxfw->tx_stream);
+	snd_oxfw_stream_update_duplex(oxfw);
 
 	mutex_unlock(&oxfw->mutex);
 }
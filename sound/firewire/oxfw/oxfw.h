@@ -34,6 +34,9 @@
 #include "../amdtp.h"
 #include "../cmp.h"
 
+#define OXFORD_FIRMWARE_ID_ADDRESS	(CSR_REGISTER_BASE + 0x50000)
+/* 0x970?vvvv or 0x971?vvvv, where vvvv = firmware version */
+
 struct device_info {
 	const char *driver_name;
 	const char *vendor_name;
@@ -45,6 +48,16 @@ struct device_info {
 
 /* This is an arbitrary number for convinience. */
 #define	SND_OXFW_STREAM_FORMAT_ENTRIES	10
+
+/* The number of sampling rates which OXFW970/971 support. */
+#define SND_OXFW_RATE_COUNT	6
+
+struct snd_oxfw_stream_formation {
+	unsigned int rate;
+	unsigned int pcm;
+	unsigned int midi;
+};
+
 struct snd_oxfw {
 	struct snd_card *card;
 	struct fw_unit *unit;
@@ -56,6 +69,24 @@ struct snd_oxfw {
 	u8 *tx_stream_formats[SND_OXFW_STREAM_FORMAT_ENTRIES];
 	u8 *rx_stream_formats[SND_OXFW_STREAM_FORMAT_ENTRIES];
 	bool assumed;
+	/*
+	 * The entries of the formats plus one, by the index of the rate and
+	 * the number of PCM channels. Zero channels give the first entry at
+	 * the rate, and zero means no entry.
+	 */
+	u8 tx_format_index[SND_OXFW_RATE_COUNT][AMDTP_MAX_CHANNELS_FOR_PCM + 1];
+	u8 rx_format_index[SND_OXFW_RATE_COUNT][AMDTP_MAX_CHANNELS_FOR_PCM + 1];
+	/*
+	 * The current formations of the plugs, protected by the spinlock.
+	 * They are known from a query or a successful change, until a bus
+	 * reset or the release of the userspace lock.
+	 */
+	struct snd_oxfw_stream_formation tx_current;
+	struct snd_oxfw_stream_formation rx_current;
+	bool tx_current_known;
+	bool rx_current_known;
+	struct fcp_avc_cache avc_cache;
+	struct snd_fw_transaction_stats transaction_stats;
 	struct cmp_connection out_conn;
 	struct cmp_connection in_conn;
 	struct amdtp_stream tx_stream;
@@ -85,6 +116,10 @@ int avc_stream_set_format(struct fw_unit *unit, enum avc_general_plug_dir dir,
 int avc_stream_get_format(struct fw_unit *unit,
 			  enum avc_general_plug_dir dir, unsigned int pid,
 			  u8 *buf, unsigned int *len, unsigned int eid);
+int avc_stream_get_format_list_all(struct fw_unit *unit,
+				   enum avc_general_plug_dir dir,
+				   unsigned int pid, u8 **bufs,
+				   unsigned int *lens, unsigned int count);
 static inline int
 avc_stream_get_format_single(struct fw_unit *unit,
 			     enum avc_general_plug_dir dir, unsigned int pid,
@@ -109,28 +144,20 @@ int avc_general_inquiry_sig_fmt(struct fw_unit *unit, unsigned int rate,
 				enum avc_general_plug_dir dir,
 				unsigned short pid);
 
-int snd_oxfw_stream_init_simplex(struct snd_oxfw *oxfw,
-				 struct amdtp_stream *stream);
-int snd_oxfw_stream_start_simplex(struct snd_oxfw *oxfw,
-				  struct amdtp_stream *stream,
-				  unsigned int rate, unsigned int pcm_channels);
-void snd_oxfw_stream_stop_simplex(struct snd_oxfw *oxfw,
-				  struct amdtp_stream *stream);
-void snd_oxfw_stream_destroy_simplex(struct snd_oxfw *oxfw,
-				     struct amdtp_stream *stream);
-void snd_oxfw_stream_update_simplex(struct snd_oxfw *oxfw,
-				    struct amdtp_stream *stream);
+int snd_oxfw_stream_init_duplex(struct snd_oxfw *oxfw);
+int snd_oxfw_stream_start_duplex(struct snd_oxfw *oxfw,
+				 struct amdtp_stream *stream,
+				 unsigned int rate, unsigned int pcm_channels);
+void snd_oxfw_stream_stop_duplex(struct snd_oxfw *oxfw);
+void snd_oxfw_stream_destroy_duplex(struct snd_oxfw *oxfw);
+void snd_oxfw_stream_update_duplex(struct snd_oxfw *oxfw);
 
-struct snd_oxfw_stream_formation {
-	unsigned int rate;
-	unsigned int pcm;
-	unsigned int midi;
-};
 int snd_oxfw_stream_parse_format(u8 *format,
 				 struct snd_oxfw_stream_formation *formation);
 int snd_oxfw_stream_get_current_formation(struct snd_oxfw *oxfw,
 				enum avc_general_plug_dir dir,
 				struct snd_oxfw_stream_formation *formation);
+void snd_oxfw_stream_forget_formations(struct snd_oxfw *oxfw);
 
 int snd_oxfw_stream_discover(struct snd_oxfw *oxfw);
 